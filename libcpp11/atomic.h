@@ -55,6 +55,70 @@ class atomic_bool
     // atomic types are not CopyAssignable
     atomic_bool& operator=(const atomic_bool&);
 };
+
+
+enum memory_order
+{
+  memory_order_relaxed = __ATOMIC_RELAXED,
+  memory_order_acquire = __ATOMIC_ACQUIRE,
+  memory_order_release = __ATOMIC_RELEASE,
+  memory_order_seq_cst = __ATOMIC_SEQ_CST
+};
+
+/* Lock-free atomic for integral and pointer types, implemented with the GCC
+ * __atomic builtins.  Only the subset of std::atomic used by exio is
+ * provided.  Operations are sequentially consistent, unless an ordering is
+ * given to load(), store(), fetch_add() or fetch_sub(). */
+template <typename T>
+class atomic
+{
+    T m_value;
+
+  public:
+
+             atomic()    : m_value(T()) {}
+    explicit atomic(T v) : m_value(v)   {}
+
+    T load(memory_order m = memory_order_seq_cst) const
+    {
+      return __atomic_load_n(&m_value, m);
+    }
+
+    void store(T v, memory_order m = memory_order_seq_cst)
+    {
+      __atomic_store_n(&m_value, v, m);
+    }
+
+    T exchange(T v)
+    {
+      return __atomic_exchange_n(&m_value, v, __ATOMIC_SEQ_CST);
+    }
+
+    /* On failure, 'expected' is updated with the current value */
+    bool compare_exchange_strong(T& expected, T desired)
+    {
+      return __atomic_compare_exchange_n(&m_value, &expected, desired, false,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+
+    T fetch_add(T v, memory_order m = memory_order_seq_cst)
+    {
+      return __atomic_fetch_add(&m_value, v, m);
+    }
+
+    T fetch_sub(T v, memory_order m = memory_order_seq_cst)
+    {
+      return __atomic_fetch_sub(&m_value, v, m);
+    }
+
+    T operator=(T v) { store(v); return v; }
+    operator T() const { return load(); }
+
+  private:
+    atomic(const atomic&);
+    atomic& operator=(const atomic&);
+};
+
 }
 
 #endif
@@ -86,6 +86,17 @@ void AdminInterface::monitor_update(const std::string& table_name,
                          fields);
 }
 //----------------------------------------------------------------------
+TableHandle AdminInterface::table(const std::string& table_name)
+{
+  return TableHandle( m_impl->monitor_table(table_name) );
+}
+//----------------------------------------------------------------------
+void AdminInterface::monitor_update_batch(const std::string& table_name,
+                                          const AdminInterface::Table& rows)
+{
+  m_impl->monitor_update_batch(table_name, rows);
+}
+//----------------------------------------------------------------------
 void AdminInterface::monitor_update_meta(const std::string& table_name,
                                          const std::string& rowkey,
                                          const std::string& column,
@@ -145,6 +156,22 @@ void AdminInterface::add_columns(const std::string& table_name,
   m_impl->add_columns(table_name, cols);
 }
 
+//----------------------------------------------------------------------
+
+void AdminInterface::table_conflation(const std::string& table_name,
+                                      int interval_ms)
+{
+  m_impl->table_conflation(table_name, interval_ms);
+}
+
+//----------------------------------------------------------------------
+bool AdminInterface::table_update_counts(const std::string& tablename,
+                                         uint64_t& received,
+                                         uint64_t& published) const
+{
+  return m_impl->table_update_counts(tablename, received, published);
+}
+
 
 
 //----------------------------------------------------------------------
@@ -18,12 +18,14 @@
     along with exio.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "exio/AdminInterfaceImpl.h"
+#include "exio/OutboundMsg.h"
 #include "exio/AdminInterface.h"
 #include "exio/AdminCommand.h"
 #include "exio/Logger.h"
 #include "exio/MsgIDs.h"
 #include "exio/utils.h"
 #include "exio/Reactor.h"
+#include "exio/SharedBuffer.h"
 #include "config.h"
 
 #include <algorithm>
@@ -55,9 +57,17 @@ AdminInterfaceImpl::AdminInterfaceImpl(AdminInterface * ai)
     m_serverSocket(this),
     m_monitor(this),
     m_start_time( ::time(NULL) ),
-    m_ai(ai),
-    m_reactor( new Reactor(ai->appsvc().log()))
+    m_ai(ai)
 {
+  const Config& conf = ai->appsvc().conf();
+  m_reactors.next = 0;
+  for (int i = 0; i < std::max(1, conf.reactors); ++i)
+  {
+    m_reactors.items.push_back( new Reactor(ai->appsvc().log(),
+                                            conf.reactor_workers,
+                                            conf.poller) );
+  }
+
   m_sessions.createdCount = 0;
   m_sessions.next = 1;
 
@@ -135,7 +145,15 @@ AdminInterfaceImpl::AdminInterfaceImpl(AdminInterface * ai)
 
 AdminInterfaceImpl::~AdminInterfaceImpl()
 {
-  delete m_reactor;
+  // stop the monitor publishing conflated updates before sessions and
+  // reactors go away
+  m_monitor.stop();
+
+  for (std::vector<Reactor*>::iterator it = m_reactors.items.begin();
+       it != m_reactors.items.end(); ++it)
+  {
+    delete *it;
+  }
 }
 
 //----------------------------------------------------------------------
@@ -337,9 +355,104 @@ void AdminInterfaceImpl::send_one(const std::list<sam::txMessage>& msgs,
   }
 }
 
+//----------------------------------------------------------------------
+void AdminInterfaceImpl::encode_for(OutboundMsg& msg,
+                                    const std::vector<SID>& ids)
+{
+  // Only the formats are found under the sessions lock; the encoding is
+  // done outside it, so that other senders, and sessions logging on and
+  // off, do not wait for it.  A format first used after this is encoded
+  // when the message is queued.
+  bool used[2] = { false, false };
+  {
+    cpp11::lock_guard<cpp11::mutex> guard(m_sessions.lock);
+
+    for (std::vector<SID>::const_iterator it = ids.begin();
+         it != ids.end() and not (used[0] and used[1]); ++it)
+    {
+      const SessionReg& sreg = m_sessions.reg[ it->unique_id() ];
+      if (sreg.used()) used[ sreg.ptr->wire_format() ] = true;
+    }
+  }
+
+  SharedBuffer buf;
+  for (int f = sam::eTextFormat; f <= sam::eBinaryFormat; ++f)
+    if (used[f]) msg.encoded((sam::WireFormat) f, buf);
+}
+
+//----------------------------------------------------------------------
+void AdminInterfaceImpl::send_many(OutboundMsg& msg,
+                                   const std::vector<SID>& ids)
+{
+  encode_for(msg, ids);
+
+  // The sessions lock is held across all sessions, for the same reason as in
+  // send_one; the encoded bytes are shared, not copied, by each session
+  // using the same wire format.
+  cpp11::lock_guard<cpp11::mutex> guard(m_sessions.lock);
+
+  for (std::vector<SID>::const_iterator it = ids.begin();
+       it != ids.end(); ++it)
+  {
+    SessionReg& sreg = m_sessions.reg[ it->unique_id() ];
+
+    if (sreg.used())
+    {
+      if ( sreg.ptr->is_open() ) sreg.ptr->enqueueToSend( msg );
+    }
+    else
+    {
+      _WARN_(m_logsvc, "session not found " << *it
+             << ", unable to send message");
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+void AdminInterfaceImpl::send_keyed(OutboundMsg& msg,
+                                    const std::string& key,
+                                    const std::vector<SID>& ids)
+{
+  encode_for(msg, ids);
+
+  cpp11::lock_guard<cpp11::mutex> guard(m_sessions.lock);
+
+  for (std::vector<SID>::const_iterator it = ids.begin();
+       it != ids.end(); ++it)
+  {
+    SessionReg& sreg = m_sessions.reg[ it->unique_id() ];
+
+    if (sreg.used() and sreg.ptr->is_open())
+      sreg.ptr->enqueueToSend( msg, key );
+  }
+}
+
+//----------------------------------------------------------------------
+void AdminInterfaceImpl::split_slow(std::vector<SID>& ids,
+                                    std::vector<SID>& slow) const
+{
+  cpp11::lock_guard<cpp11::mutex> guard(m_sessions.lock);
+
+  std::vector<SID>::iterator keep = ids.begin();
+  for (std::vector<SID>::iterator it = ids.begin(); it != ids.end(); ++it)
+  {
+    SessionReg& sreg = m_sessions.reg[ it->unique_id() ];
+
+    if (sreg.used() and sreg.ptr->is_slow())
+      slow.push_back( *it );
+    else
+      *keep++ = *it;
+  }
+  ids.erase(keep, ids.end());
+}
+
 //----------------------------------------------------------------------
 void AdminInterfaceImpl::send_all(const sam::txMessage& msg)
 {
+  // encode once for each wire format in use, and share the bytes with all
+  // sessions using that format
+  OutboundMsg out(m_appsvc, msg);
+
   cpp11::lock_guard<cpp11::mutex> guard(m_sessions.lock);
 
   for (size_t i = 0; i < SESSION_REG_SIZE; ++i)
@@ -347,7 +460,7 @@ void AdminInterfaceImpl::send_all(const sam::txMessage& msg)
     if ( m_sessions.reg[i].used() and
          m_sessions.reg[i].ptr->is_open())
     {
-      m_sessions.reg[i].ptr->enqueueToSend( msg );
+      m_sessions.reg[i].ptr->enqueueToSend( out );
     }
   }
 
@@ -372,6 +485,15 @@ bool AdminInterfaceImpl::session_exists(const SID& id) const
   return m_sessions.reg[ i ].used();
 }
 
+//----------------------------------------------------------------------
+sam::WireFormat AdminInterfaceImpl::session_format(const SID& id) const
+{
+  cpp11::lock_guard<cpp11::mutex> guard(m_sessions.lock);
+
+  const SessionReg& sreg = m_sessions.reg[ id.unique_id() ];
+  return sreg.used()? sreg.ptr->wire_format() : sam::eTextFormat;
+}
+
 //----------------------------------------------------------------------
 bool AdminInterfaceImpl::session_open(const SID& id) const
 {
@@ -1089,6 +1211,20 @@ void AdminInterfaceImpl::monitor_update(
   m_monitor.update_table(table_name, rowkey, fields);
 }
 
+//----------------------------------------------------------------------
+void AdminInterfaceImpl::monitor_update_batch(
+  const std::string& table_name,
+  const AdminInterface::Table& rows)
+{
+  m_monitor.update_table_batch(table_name, rows);
+}
+
+//----------------------------------------------------------------------
+DataTable* AdminInterfaceImpl::monitor_table(const std::string& table_name)
+{
+  return m_monitor.table(table_name);
+}
+
 //----------------------------------------------------------------------
 void AdminInterfaceImpl::monitor_update_meta(const std::string& table_name,
                                              const std::string& rowkey,
@@ -1105,12 +1241,37 @@ void AdminInterfaceImpl::add_columns(const std::string& table_name,
   m_monitor.add_columns(table_name, cols);
 }
 
+//----------------------------------------------------------------------
+void AdminInterfaceImpl::table_conflation(const std::string& table_name,
+                                          int interval_ms)
+{
+  m_monitor.conflate_table(table_name, interval_ms);
+}
+
+//----------------------------------------------------------------------
+bool AdminInterfaceImpl::table_update_counts(const std::string& tablename,
+                                             uint64_t& received,
+                                             uint64_t& published) const
+{
+  int conflate_ms;
+  return m_monitor.table_update_counts(tablename, conflate_ms,
+                                       received, published);
+}
+
 
 //----------------------------------------------------------------------
 
 void AdminInterfaceImpl::handle_logon_msg(const sam::txMessage& logonmsg,
                                           AdminSession& session)
 {
+  /* Only a peer which asks for the binary wire format is sent it, so legacy
+   * GUIs continue to receive text.  This is decided first, so that the
+   * snapshots and admins sent in reply are binary too. */
+  if ( logonmsg.root().check_field(id::QN_wireformat, sam::SAM0200) )
+  {
+    session.wire_format(sam::eBinaryFormat);
+  }
+
   // TODO: for now we will automatically subscribe to all tables, unless the
   // QN_noautosub field is present. This should be changed so that a table
   // subscription is only made by the subscribe message
@@ -1317,7 +1478,7 @@ AdminResponse AdminInterfaceImpl::admincmd_diags(AdminRequest& request)
 
     if (sections.empty() or (sections.count("sessions")==1))
     {
-      os << "SessionID, fd, PeerAddr, PeerServiceID, User, Logon, Start, LastOut, BytesOut, BytesIn, QueueOut\n";
+      os << "SessionID, fd, PeerAddr, PeerServiceID, User, Logon, Start, LastOut, BytesOut, BytesIn, QueueOut, MsgsOut, Writes, WritesPerMsg, Replaced\n";
 
       for (size_t i = 0; i < SESSION_REG_SIZE; ++i)
       {
@@ -1335,6 +1496,17 @@ AdminResponse AdminInterfaceImpl::admincmd_diags(AdminRequest& request)
         os << sptr->bytes_out() << ", ";
         os << sptr->bytes_in() << ", ";
         os << sptr->bytes_pend() << ", ";
+        os << sptr->msgs_out() << ", ";
+        os << sptr->writes_out() << ", ";
+        if (sptr->msgs_out())
+        {
+          char tmp[32];
+          snprintf(tmp, sizeof(tmp), "%.3f",
+                   double(sptr->writes_out()) / sptr->msgs_out());
+          os << tmp;
+        }
+        os << ", ";
+        os << sptr->msgs_replaced() << ", ";
         os << "\n";
       }
     }
@@ -1354,17 +1526,35 @@ AdminResponse AdminInterfaceImpl::admincmd_diags(AdminRequest& request)
        << serverthr.second << std::dec << ", 0x"
        << std::hex << serverthr.first << std::dec << "\n";
 
-    const std::vector< std::pair<pthread_t,int> > & rthreads
-      = m_reactor->thread_ids();
-    os << "reactor_io, "
-       << rthreads[0].second << ", 0x"
-       << std::hex << rthreads[0].first << std::dec << "\n";
-    for (size_t n = 1; n < rthreads.size(); n++)
+    for (size_t r = 0; r < m_reactors.items.size(); r++)
     {
-      if (n != 1) os << "\n";
-      os << "reactor_inbound_"<<n<<", "
-         << rthreads[n].second << ", 0x"
-         << std::hex << rthreads[n].first << std::dec;
+      // reactor threads are suffixed with the reactor index, if there is
+      // more than one
+      std::string sfx;
+      if (m_reactors.items.size() > 1) sfx = "_" + utils::to_str(r);
+
+      const std::vector< std::pair<pthread_t,int> > & rthreads
+        = m_reactors.items[r]->thread_ids();
+      os << "reactor_io" << sfx << ", "
+         << rthreads[0].second << ", 0x"
+         << std::hex << rthreads[0].first << std::dec << "\n";
+      for (size_t n = 1; n < rthreads.size(); n++)
+      {
+        os << "reactor" << sfx << "_inbound_"<<n<<", "
+           << rthreads[n].second << ", 0x"
+           << std::hex << rthreads[n].first << std::dec << "\n";
+      }
+    }
+
+    os << "\nreactor, clients, wakeups, io_events\n";
+    for (size_t r = 0; r < m_reactors.items.size(); r++)
+    {
+      if (r != 0) os << "\n";
+      Reactor::Load load = m_reactors.items[r]->load();
+      os << r << ", "
+         << load.clients << ", "
+         << load.wakeups << ", "
+         << load.io_events;
     }
   }
 
@@ -1393,6 +1583,15 @@ AdminResponse AdminInterfaceImpl::admincmd_diags(AdminRequest& request)
         os << *i;
       }
       os << "], size=" << m_monitor.table_size(*t);
+
+      int conflate_ms;
+      uint64_t received, published;
+      if (m_monitor.table_update_counts(*t, conflate_ms, received, published))
+      {
+        os << ", conflate_ms=" << conflate_ms
+           << ", updates_in=" << received
+           << ", updates_out=" << published;
+      }
       os << "\n";
     }
   }
@@ -1558,9 +1757,37 @@ void AdminInterfaceImpl::deregister_ext_session(AdminSession* sought)
 
 void AdminInterfaceImpl::init_session_io(AdminSession* session)
 {
-  Client* client = new Client(m_reactor, session->fd(), m_appsvc.log(), session);
+  Reactor* reactor = select_reactor();
+  Client* client = new Client(reactor, session->fd(), m_appsvc.log(), session);
   session->io_init(client);
-  m_reactor->add_client( client );
+  reactor->add_client( client );
+}
+
+//----------------------------------------------------------------------
+
+/* Choose the reactor with fewest clients.  Ties are broken round-robin, so
+ * that sessions are also spread when all reactors are idle. */
+Reactor* AdminInterfaceImpl::select_reactor()
+{
+  cpp11::lock_guard<cpp11::mutex> guard(m_reactors.lock);
+
+  const size_t n = m_reactors.items.size();
+  size_t best = m_reactors.next % n;
+  size_t bestload = m_reactors.items[best]->load().clients;
+
+  for (size_t i = 1; i < n; ++i)
+  {
+    size_t r = (m_reactors.next + i) % n;
+    size_t clients = m_reactors.items[r]->load().clients;
+    if (clients < bestload)
+    {
+      best     = r;
+      bestload = clients;
+    }
+  }
+
+  m_reactors.next = best + 1;
+  return m_reactors.items[best];
 }
 
 //----------------------------------------------------------------------
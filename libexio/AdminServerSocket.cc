@@ -18,6 +18,7 @@
     along with exio.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "exio/AdminServerSocket.h"
+#include "exio/Clock.h"
 #include "exio/AdminInterfaceImpl.h"
 #include "exio/Logger.h"
 #include "exio/AppSvc.h"
@@ -228,7 +229,7 @@ void AdminServerSocket::accept_TEP()
 
   int conn_count = 0;
 
-  time_t last_house_keep = ::time(NULL);
+  time_t last_house_keep = Clock::now();
   time_t conncount_on_last_house = conn_count;
 
   // TODO: need a way to singal this loop to stop.
@@ -314,13 +315,13 @@ void AdminServerSocket::accept_TEP()
     // ensures that housekeeping will always get called, even during period of
     // high frequency socket accepts.
 
-    if ( ( (::time(NULL) - last_house_keep) >= ACCEPT_TIMEOUT_SECS) or
+    if ( ( (Clock::now() - last_house_keep) >= ACCEPT_TIMEOUT_SECS) or
          (conn_count - conncount_on_last_house > 10)
       )
     {
       //_INFO_(m_aii->appsvc().log(), "housekeeping");
       try {  m_aii->housekeeping();  } catch (...) {}
-      last_house_keep = ::time(NULL);
+      last_house_keep = Clock::now();
       conncount_on_last_house = conn_count;
     }
 
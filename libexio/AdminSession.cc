@@ -18,12 +18,15 @@
     along with exio.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "exio/AdminSession.h"
+#include "exio/Clock.h"
 #include "exio/AdminInterface.h"
 #include "exio/Logger.h"
 #include "exio/sam.h"
 #include "exio/MsgIDs.h"
 #include "exio/utils.h"
 #include "exio/SamBuffer.h"
+#include "exio/SharedBuffer.h"
+#include "exio/OutboundMsg.h"
 #include "exio/Reactor.h"
 
 // extern "C"
@@ -32,6 +35,7 @@
 // }
 
 #include "mutex.h"
+#include "atomic.h"
 
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -64,6 +68,9 @@ struct QueuedItem
 
     exio::SamBuffer * sb() { return &m_sb; }
 
+    /* Hand the encoded message to a SharedBuffer, without copying */
+    void transfer(SharedBuffer& dest) { m_sb.transfer(dest); }
+
   private:
     exio:: DynamicSamBuffer m_sb;
 };
@@ -192,6 +199,20 @@ std::string sock_descr(int fd)
     return "unknown";
 }
 
+//======================================================================
+struct AdminSession::Impl
+{
+    cpp11::atomic<int> format;  // a sam::WireFormat
+
+    /* Dictionary names sent to the peer, ie, those with ids below this.
+     * Sending names and advancing the count is done under the mutex, so
+     * names are always queued before any message which needs them. */
+    cpp11::mutex names_mutex;
+    size_t       names_sent;
+
+    Impl() : format(sam::eTextFormat), names_sent(0) {}
+};
+
 //----------------------------------------------------------------------
 AdminSession::AdminSession(AppSvc& appsvc,
                            int fd,
@@ -206,10 +227,11 @@ AdminSession::AdminSession(AppSvc& appsvc,
     m_listener( l ),  // need store listener before IO started
     m_autoclose(false),
     m_hb_intvl(30),
-    m_hb_last(time(NULL)),
+    m_hb_last(Clock::now()),
     m_start( m_hb_last ),
     m_samp(m_appsvc),
-    m_io_handle(NULL)
+    m_io_handle(NULL),
+    m_impl(new Impl)
 {
 }
 
@@ -242,6 +264,18 @@ AdminSession::~AdminSession()
     m_io_handle->release(); // disables callbacks, etc.
     m_io_handle = NULL;
   }
+
+  delete m_impl;
+}
+//----------------------------------------------------------------------
+void AdminSession::wire_format(sam::WireFormat f)
+{
+  m_impl->format.store(f);
+}
+//----------------------------------------------------------------------
+sam::WireFormat AdminSession::wire_format() const
+{
+  return (sam::WireFormat) m_impl->format.load();
 }
 //----------------------------------------------------------------------
 
@@ -249,29 +283,57 @@ bool AdminSession::enqueueToSend(const sam::txMessage& msg)
 {
   if (!m_session_valid) return true; // ignore request if session not valid
 
-  // TODO: reject message if session is closed.
-  // TODO: what happens if msg too large to encode?
+  SharedBuffer buf;
+  if (encode(m_appsvc, msg, buf, wire_format())) return true; // failure
 
+  return enqueueToSend(buf);
+}
+//----------------------------------------------------------------------
+bool AdminSession::enqueueToSend(OutboundMsg& msg)
+{
+  SharedBuffer buf;
+  if (msg.encoded(wire_format(), buf)) return true; // failure
 
-  // {
-  //   sam::MessageFormatter msgfmt;
-  //   std::ostringstream os;
-  //   msgfmt.format(msg, os);
+  return enqueue(buf, NULL);
+}
+//----------------------------------------------------------------------
+bool AdminSession::enqueueToSend(OutboundMsg& msg, const std::string& key)
+{
+  SharedBuffer buf;
+  if (msg.encoded(wire_format(), buf)) return true; // failure
 
-  //   _INFO_(m_appsvc.log(), "Sending: " << os.str() );
-  // }
+  return enqueue(buf, &key);
+}
+//----------------------------------------------------------------------
+bool AdminSession::enqueueToSend(const SharedBuffer& buf)
+{
+  return enqueue(buf, NULL);
+}
+//----------------------------------------------------------------------
+bool AdminSession::enqueueToSend(const SharedBuffer& buf,
+                                 const std::string& key)
+{
+  return enqueue(buf, &key);
+}
+//----------------------------------------------------------------------
+bool AdminSession::enqueue(const SharedBuffer& buf, const std::string* key)
+{
+  if (!m_session_valid) return true; // ignore request if session not valid
 
-  QueuedItem qi;
-  sam::SAMProtocol protocol(m_appsvc);
+  // TODO: reject message if session is closed.
 
   try
   {
-    qi.size = protocol.encodeMsg(msg, qi.sb());
-
     if (m_io_handle)
     {
+      // a binary message can use dictionary names not yet sent to the peer
+      size_t const names = sam::SAMProtocol::names_required(buf.data(),
+                                                            buf.size());
+      if (names and send_names(names)) return true;  // failure
+
       int result;
-      result = m_io_handle->queue(qi.buf(), qi.size, false);
+      result = key? m_io_handle->queue(buf, *key)
+                  : m_io_handle->queue(buf, false);
 
       if (result == -1)
       {
@@ -286,6 +348,70 @@ bool AdminSession::enqueueToSend(const sam::txMessage& msg)
       return true;  // failure
     }
 
+    return false;  // success
+  }
+  catch (std::exception& err)
+  {
+    _ERROR_(m_appsvc.log(), "Failed to enqueue message due to exception: "
+            << err.what());
+  }
+
+  return true; // failure
+}
+//----------------------------------------------------------------------
+bool AdminSession::send_names(size_t required)
+{
+  cpp11::lock_guard<cpp11::mutex> guard( m_impl->names_mutex );
+
+  if (required <= m_impl->names_sent) return false;
+
+  // The names are queued unkeyed, so unlike a keyed message which needs
+  // them, they cannot be replaced before being written.
+  QueuedItem qi;
+  sam::SAMProtocol protocol(m_appsvc);
+  qi.size = protocol.encode_names(qi.sb(), m_impl->names_sent,
+                                  required);
+
+  SharedBuffer names;
+  qi.transfer(names);
+  if (m_io_handle->queue(names, false) == -1)
+  {
+    _ERROR_(m_appsvc.log(), "Dropping session " << m_id
+            << " due to enqueue failure");
+    return true;  // failure
+  }
+
+  m_impl->names_sent = required;
+  return false;
+}
+//----------------------------------------------------------------------
+bool AdminSession::encode(AppSvc& appsvc,
+                          const sam::txMessage& msg,
+                          SharedBuffer& dest,
+                          sam::WireFormat format)
+{
+  // TODO: what happens if msg too large to encode?
+
+
+  // {
+  //   sam::MessageFormatter msgfmt;
+  //   std::ostringstream os;
+  //   msgfmt.format(msg, os);
+
+  //   _INFO_(m_appsvc.log(), "Sending: " << os.str() );
+  // }
+
+  QueuedItem qi;
+  sam::SAMProtocol protocol(appsvc);
+
+  try
+  {
+    if (format == sam::eBinaryFormat)
+      qi.size = protocol.encodeBinary(msg, qi.sb());
+    else
+      qi.size = protocol.encodeMsg(msg, qi.sb());
+    qi.transfer(dest);
+
     /*
       size_t sz = protocol.calc_encoded_size(msg);
       _INFO_(m_appsvc.log(), "estimated " << sz << ", actual " << qi.size);
@@ -297,14 +423,14 @@ bool AdminSession::enqueueToSend(const sam::txMessage& msg)
   {
     // If we arrive here, the message could not be encoded.
     size_t sz = protocol.calc_encoded_size(msg);
-    _ERROR_(m_appsvc.log(), "Failed to send "
+    _ERROR_(appsvc.log(), "Failed to send "
             << msg.type() <<  " message due to encode exception: "
             << err.what()
             << " (expected size was " << sz << ")");
 
     // // TODO experimental
     // size_t n = protocol.calcEncodeSize(msg);
-    // _INFO_(m_appsvc.log(), "Estimate size required: " << n);
+    // _INFO_(appsvc.log(), "Estimate size required: " << n);
 
     // size_t tmpsz = (size_t) (n * 1.10);
     // char * tmp = new char[ tmpsz ];
@@ -313,30 +439,70 @@ bool AdminSession::enqueueToSend(const sam::txMessage& msg)
     // try
     // {
     //   size_t len = protocol.encodeMsg(msg, tmp, tmpsz);
-    //   _INFO_(m_appsvc.log(), "Encoding works, used a length of " << len
+    //   _INFO_(appsvc.log(), "Encoding works, used a length of " << len
     //          << ": " << tmp)
     // }
     // catch (...)
     // {
-    //   _ERROR_(m_appsvc.log(), "Encoding still did not work");
+    //   _ERROR_(appsvc.log(), "Encoding still did not work");
     // }
     // delete [] tmp;
   }
   catch (std::exception& err)
   {
-    _ERROR_(m_appsvc.log(), "Failed to encode/enqueue "
+    _ERROR_(appsvc.log(), "Failed to encode "
             << msg.type() <<  " message due to exception: "
             << err.what());
   }
   catch (...)
   {
-    _ERROR_(m_appsvc.log(), "Failed to encode/enqueue "
+    _ERROR_(appsvc.log(), "Failed to encode "
             << msg.type() <<  " message due to unknown exception");
   }
 
   return true; // failure
 }
 
+//----------------------------------------------------------------------
+OutboundMsg::OutboundMsg(AppSvc& appsvc, const sam::txMessage& msg)
+  : m_appsvc(appsvc),
+    m_msg(&msg)
+{
+  m_failed[0] = m_failed[1] = false;
+}
+
+//----------------------------------------------------------------------
+OutboundMsg::OutboundMsg(AppSvc& appsvc, const SharedBuffer& buf,
+                         sam::WireFormat format)
+  : m_appsvc(appsvc),
+    m_msg(NULL)
+{
+  m_buf[format] = buf;
+  m_failed[0] = m_failed[1] = false;
+}
+
+//----------------------------------------------------------------------
+bool OutboundMsg::encoded(sam::WireFormat format, SharedBuffer& dest)
+{
+  if (m_buf[format].empty() and not m_failed[format])
+  {
+    if (m_msg)
+    {
+      m_failed[format] = AdminSession::encode(m_appsvc, *m_msg,
+                                              m_buf[format], format);
+    }
+    else
+    {
+      _ERROR_(m_appsvc.log(), "Message not encoded for wire format "
+              << format);
+      m_failed[format] = true;
+    }
+  }
+
+  dest = m_buf[format];
+  return m_failed[format];
+}
+
 //----------------------------------------------------------------------
 
 void AdminSession::close()
@@ -438,7 +604,7 @@ void AdminSession::housekeeping()
       (m_io_handle==NULL) or
       (not m_io_handle->io_open())) return;
 
-  time_t now = time(NULL);
+  time_t now = Clock::now();
 
   // Note: we now send heartbeats periodically, irrespective of outbound
   // activity on the session.  We are doing this because our heartbeats also
@@ -480,6 +646,21 @@ uint64_t AdminSession::bytes_pend() const
   return (m_io_handle)? m_io_handle->pending_out():0;
 }
 //----------------------------------------------------------------------
+uint64_t AdminSession::msgs_out() const
+{
+  return (m_io_handle)? m_io_handle->msgs_out():0;
+}
+//----------------------------------------------------------------------
+uint64_t AdminSession::writes_out() const
+{
+  return (m_io_handle)? m_io_handle->writes_out():0;
+}
+//----------------------------------------------------------------------
+uint64_t AdminSession::msgs_replaced() const
+{
+  return (m_io_handle)? m_io_handle->msgs_replaced():0;
+}
+//----------------------------------------------------------------------
 int AdminSession::fd() const
 {
   // we always know the fd, and it is an invariant of the session.  I.e.,
@@ -489,17 +670,16 @@ int AdminSession::fd() const
 //----------------------------------------------------------------------
 size_t AdminSession::process_input(Client*, const char* src, int size)  // callback, from IO
 {
-  sam::txMessage msg;
   size_t consumed = 0;
-
-  /* TODO: need to carefully review this method */
+  bool decoded = false;
 
   try
   {
-    // TODO: this could either work, or, fail, or partly fail.  For the partly
-    // fail, maybe we should make sure we can decode the initial successfully decoded message?
-
-    consumed = m_samp.decodeMsg(msg, src, size);
+    // Decode into the reused view, which allocates nothing.  Nothing is
+    // consumed until a whole message has arrived; a whole message is only
+    // delivered if 'decoded', since a names message, for one, is not.  A
+    // protocol error closes the connection, below.
+    consumed = m_samp.decodeView(m_view, src, size, decoded);
   }
   catch (const std::exception& e)
   {
@@ -523,10 +703,17 @@ size_t AdminSession::process_input(Client*, const char* src, int size)  // callb
   }
 
   /* raw data has been decoded, so now pass to the client */
-  if (consumed)
+  if (decoded)
   {
+    // The message nodes come from an arena local to this call, rather than
+    // one owned by the session, since the session can be deleted by another
+    // thread once the message has been delivered.  Handlers which keep any
+    // part of msg take a copy, which is on the heap.
+    sam::txArena arena;
+    sam::txMessage msg("", &arena);
     try
     {
+      m_view.copy_to(msg);
       this->io_onmsg( msg );
     }
     catch(const std::exception& err)
@@ -542,5 +729,10 @@ size_t AdminSession::process_input(Client*, const char* src, int size)  // callb
   return consumed;
 }
 //----------------------------------------------------------------------
+size_t AdminSession::input_needed(Client*)  // callback, from IO
+{
+  return m_samp.pending_length();
+}
+//----------------------------------------------------------------------
 
 } // namespace qm
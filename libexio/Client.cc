@@ -1,4 +1,10 @@
+/* Feature test, to safely use POLLRDHUP */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "exio/Client.h"
+#include "exio/Clock.h"
 #include "exio/utils.h"
 #include "exio/Logger.h"
 #include "exio/AppSvc.h"
@@ -14,9 +20,24 @@
 #include <poll.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <pthread.h>
 #include <sys/syscall.h>
 
+/* If POLLRDHUP is not defined, then lets define it so that its later usage
+ * does nothing. */
+#ifndef POLLRDHUP
+#define POLLRDHUP 0x00
+#endif
+
+/* Maximum number of queued messages gathered into one sendmsg() */
+#ifdef IOV_MAX
+#define EXIO_CLIENT_IOV_MAX IOV_MAX
+#else
+#define EXIO_CLIENT_IOV_MAX 1024
+#endif
+
 namespace exio {
 
 /*
@@ -60,21 +81,42 @@ struct RawMsg
     char*  ptr;
     size_t size;
 
+    // alternative to mem, when the data is shared with other clients
+    SharedBuffer shared;
+
+    // conflation key, or empty
+    std::string key;
+
+    // being written by the reactor thread, so cannot be removed
+    bool busy;
+
     RawMsg()
       : mem(0),
         ptr(0),
-        size(0)
+        size(0),
+        busy(false)
     {
     }
 
     RawMsg(const char* src, size_t srclen)
       : mem( new char[srclen]),
         ptr(mem),
-        size(srclen)
+        size(srclen),
+        busy(false)
     {
       memcpy(mem, src, srclen);
     }
 
+    /* Refer to the bytes of a shared buffer, without copying */
+    explicit RawMsg(const SharedBuffer& src)
+      : mem(0),
+        ptr(const_cast<char*>(src.data())),
+        size(src.size()),
+        shared(src),
+        busy(false)
+    {
+    }
+
     ~RawMsg()
     {
       /* note: no automatic release of the memory */
@@ -89,6 +131,7 @@ struct RawMsg
     {
       delete [] mem;
       mem=0;
+      shared = SharedBuffer();
     }
 
     void eat(size_t s)
@@ -125,11 +168,15 @@ ReactorClient::ReactorClient(Reactor* r, int fd)
     m_io_closed(false),
     m_bytes_out(0),
     m_bytes_in(0),
-    m_last_write(time(NULL)),
+    m_msgs_out(0),
+    m_writes_out(0),
+    m_last_write(Clock::now()),
     m_last_read(m_last_write),
     m_attn_flags(0),
     m_tdestroy(0),
-    m_runstate('N')
+    m_runstate('N'),
+    m_poll_events(0),
+    m_dirty(false)
 {}
 
 
@@ -206,16 +253,11 @@ int ReactorClient::destroy_cycle(time_t t)
 }
 //----------------------------------------------------------------------
 
-  Client::DataFifo::DataFifo()
-    : itemcount(0),
-      pending(0)
-  {
-  }
-
   Client::OutboundQueue::OutboundQueue()
     : itemcount(0),
       acceptmore(true),
-      pending(0)
+      pending(0),
+      replaced(0)
   {
   }
 
@@ -229,9 +271,14 @@ Client::Client(Reactor* reactor,
   : ReactorClient(reactor, fd),
     m_logsvc(log),
     m_log_io_events(true),
+    m_ring(EXIO_CLIENT_RING_SIZE),
+    m_in_seen(0),
+    m_in_blocked(false),
+    m_in_state(eInOpen),
     m_cb(cb),
     m_out_pend_max(100*1024*1024), // TODO: take from config
-    m_buf(4096)
+    m_buf(4096),
+    m_in_need(0)
 {
 
   // Danger: creation of internal thread should be last action of constructor,
@@ -268,7 +315,6 @@ Client::~Client()   /* REACTOR THREAD */
 
   /* clear up any memory */
   shutdown_outq();
-  m_datafifo.items.clear();
 
   //xlog_incr(1);
   //xlog_cntr_label(1, "~Client");
@@ -285,142 +331,12 @@ void Client::shutdown_outq()
     i->freemem();
   }
   m_out_q.items.clear();
+  m_out_q.keyed.clear();
 
   m_out_q.itemcount= 0;
   m_out_q.pending = 0;
 }
 
-//----------------------------------------------------------------------
-// int Client::process_inbound_bytes(ReactorReadBuffer&buf)
-// {
-//   bool should_exit = false;
-//   do
-//   {
-//     {
-//       /* Note the requirement for unique_lock here.  This is the type expected
-//          by the condition variable wait() method, because the condition
-//          variable will need to release and acquire the lock as wait() is
-//          entered and exited.
-//        */
-//       cpp11::unique_lock<cpp11::mutex> lock( m_datafifo.mutex );
-
-//       /* Loop/condition predicate here is a separate boolean flag.  Initially
-//        * the predicate was simply a call to -- m_q.items.empty() -- however,
-//        * strangely, that did not always work. There was some race-condition,
-//        * which was fairly well repeatable. It seems that somehow, when using
-//        * empty(), it was possible to add an item to the queue and for empty()
-//        * to still be true, and this even when the call to push(), and the call
-//        * to empty(), were pretected with mutexes.  Replaced the empty() with
-//        * size()!=0 fixed the problem.  Because I didn't understand why empty()
-//        * failed and size() worked, here I've gone for additional robustness,
-//        * but using an boolean approach.
-//        *
-//        * NOTE: comment came from a problem found in AdminIO.cc code.
-//        */
-//       while (m_datafifo.itemcount == 0)
-//       {
-//         m_datafifo.cond.wait( lock );
-//       }
-
-
-
-// /*
-
-// hmmm .... might have STL::list problem here again
-
-// #0  0x00007f4ba4e2b6c2 in std::_List_const_iterator<exio::Client::DataChunk>::operator++ (this=0x7f4ba356d9b0) at /usr/include/c++/4.7/bits/stl_list.h:236
-// #1  0x00007f4ba4e2b38d in std::__distance<std::_List_const_iterator<exio::Client::DataChunk> > (__first=..., __last=...) at /usr/include/c++/4.7/bits/stl_iterator_base_funcs.h:82
-// #2  0x00007f4ba4e2aecc in std::distance<std::_List_const_iterator<exio::Client::DataChunk> > (__first=..., __last=...) at /usr/include/c++/4.7/bits/stl_iterator_base_funcs.h:118
-// #3  0x00007f4ba4e2a999 in std::list<exio::Client::DataChunk, std::allocator<exio::Client::DataChunk> >::size (this=0x171c418) at /usr/include/c++/4.7/bits/stl_list.h:855
-
-
-// TODO: hmmm .... maybe instead, change the logic ... use a swap to extract all
-// of the data quickly, and then use an iterator..  Should be better that
-// modifying the list all the time.
-// */
-//       // copy all pending data into our inbound-buffer
-
-//       while (m_datafifo.itemcount)
-//       {
-//         DataChunk& front = m_datafifo.items.front();
-
-//         if (front.size == 0) // got sentinel object
-//         {
-//           // don't process any more pending inbound chunks after receiving the
-//           // sentinel object (however, for data already in the inbound-buffer,
-//           // we need to pass that back to the client).
-//           should_exit = true;
-//           break;
-//         }
-//         else
-//         {
-//           while (buf.space_remain() < front.size)
-//           {
-//             // TODO: need to handle throw on growth error
-//             _DEBUG_(m_logsvc, "client: growing buffer, currently at " << buf.capacity());
-//             buf.grow(); // throws on failure
-//           }
-
-//           // The cancopy amount is just front.size(). We can sure of this due
-//           // to the preceeding growth. Ie, we don't need to compare it to the
-//           // space remaining in the buffer.
-//           size_t cancopy = front.size;
-//           if (cancopy)
-//           {
-//             // good, readbuffer can accept more data
-//             memcpy(buf.wp(), &(front.buf[front.start]), cancopy);
-//             buf.incr_bytesavail( cancopy );
-
-//             front.size  -= cancopy;
-//             front.start += cancopy;
-//           }
-//         }
-
-//         m_datafifo.itemcount--;
-//         m_datafifo.items.pop_front();  // no need to check if front has been used up
-//       }
-
-//     } //   -*-*-*-*- end of IO lock -*-*-*-*
-
-
-//     // We have released the lock, which will allow the IO thread to
-//     // proceed. Now pass our bytes to the derived method.
-//     while ( buf.bytesavail() )
-//     {
-//       // TODO: what happens if an exception is thrown?
-//       size_t consumed = 0;
-
-//       {
-//         cpp11::lock_guard<cpp11::mutex> guard( m_cb_mtx );
-//         if (m_cb)
-//         {
-//           try
-//           {
-//             consumed = m_cb->process_input(this, buf.rp(), buf.bytesavail());
-//           }
-//           catch (...)
-//           {
-
-//             // TODO: what should we do here?
-//             std::string leading(buf.rp(), 20);
-//             _WARN_(m_logsvc, "*** EXCEPTION: [" << leading << "]");
-
-//           }
-//         }
-//       }
-
-//       if (consumed>0)
-//         buf.consume( consumed );
-//       else
-//         break;
-//     }
-
-//     buf.shift_pending_to_array_start();
-
-//   } while (should_exit == false);
-
-//   return 1;  // return >0 to imply thread exit
-// }
 //----------------------------------------------------------------------
 ReactorClient::IOState Client::handle_input()  /* REACTOR THREAD */
 {
@@ -428,14 +344,13 @@ ReactorClient::IOState Client::handle_input()  /* REACTOR THREAD */
 
   if ( !this->io_open() ) return ReactorClient::IO_default;
 
-  // TODO: here, we should check how much memory is pending? Either add that
-  // in, or, move to using a synchronized read/write buffer.
-
-  DataChunk chunk;
+  // Read straight into the inbound ring.  If the ring is full, POLLIN will
+  // have been dropped by events(), until the worker has consumed some bytes.
+  size_t const space = m_ring.space();
+  if (space == 0) return ReactorClient::IO_default;
 
-  ssize_t const n = read(fd(), chunk.buf, EXIO_CLIENT_CHUNK_SIZE);
-
-  int const _err = errno;
+  int _err = 0;
+  ssize_t const n = m_ring.read_from(fd(), _err);
 
   // void * rowptr = xlog_write1("read(), n=", __FILE__, __LINE__);
   //xlog_append_sint(rowptr, n);
@@ -446,15 +361,9 @@ ReactorClient::IOState Client::handle_input()  /* REACTOR THREAD */
   if (m_log_io_events)
   {
     std::ostringstream os;
-    os << "read(fd"<< fd()<< ") " << n
+    os << "readv(fd"<< fd()<< ", " << space << ") " << n
        << ", errno " << _err
        << " (" << utils::strerror(_err) << ")";
-
-    if (n > 0)
-    {
-      std::string raw(chunk.buf, n);
-      os << ", bytes '" << raw << "'";
-    }
     _DEBUG_(m_logsvc, os.str());
   }
 
@@ -467,29 +376,23 @@ ReactorClient::IOState Client::handle_input()  /* REACTOR THREAD */
   }
   else if (n < 0)
   {
+    if (_err == EAGAIN or _err == EWOULDBLOCK or _err == EINTR)
+      return ReactorClient::IO_default;
+
     _INFO_(m_logsvc, "socket read failed: " << utils::strerror(_err) );
 
     // request a controlled shutdown
     return ReactorClient::IO_close;
   }
-  else if (n > 0 )
-  {
-    m_bytes_in += n;
-    m_last_read = time(NULL);
 
-    // if we have reached here, then we have successfully read new bytes from
-    // the socket, and placed them into the read buffer
-    chunk.size = n;
-    {
-      cpp11::lock_guard<cpp11::mutex> guard( m_datafifo.mutex );
-      m_datafifo.items.push_back( chunk );
-      m_datafifo.itemcount++;
-      m_datafifo.cond.notify_all();
-    }
-  }
+  // if we have reached here, then we have successfully read new bytes from
+  // the socket, and placed them into the ring; the reactor will find that we
+  // have work to do.
+  m_bytes_in += n;
+  m_last_read = Clock::now();
 
   // return whether another read might be needed
-  return (n>0 and n == EXIO_CLIENT_CHUNK_SIZE)?
+  return ((size_t)n == space)?
     ReactorClient::IO_read_again : ReactorClient::IO_default;
 }
 //----------------------------------------------------------------------
@@ -499,7 +402,19 @@ int Client::events()  /* REACTOR THREAD */
 
   if ( io_open() )
   {
-    events = POLLIN;
+    // Flag that we are blocked before testing for space; the worker clears
+    // the flag after consuming, and if it was set wakes the reactor.  So a
+    // consume that races with this test cannot be missed.
+    m_in_blocked = true;
+    if (m_ring.space() > 0)
+    {
+      m_in_blocked = false;
+
+      // Only look for a peer hangup when we can also read; otherwise the
+      // hangup would close the socket while unread data remains.
+      events = POLLIN bitor POLLRDHUP;
+    }
+
     {
       cpp11::lock_guard<cpp11::mutex> guard( m_out_q.mutex );
 
@@ -515,6 +430,24 @@ int Client::events()  /* REACTOR THREAD */
 
 //----------------------------------------------------------------------
 int Client::queue(const char* buf, size_t size, bool closesocket)
+{
+  return enqueue(buf, size, NULL, NULL, closesocket);
+}
+//----------------------------------------------------------------------
+int Client::queue(const SharedBuffer& buf, bool closesocket)
+{
+  return enqueue(buf.data(), buf.size(), &buf, NULL, closesocket);
+}
+//----------------------------------------------------------------------
+int Client::queue(const SharedBuffer& buf, const std::string& key)
+{
+  return enqueue(buf.data(), buf.size(), &buf, &key, false);
+}
+//----------------------------------------------------------------------
+int Client::enqueue(const char* buf, size_t size,
+                    const SharedBuffer* shared,
+                    const std::string* key,
+                    bool closesocket)
 {
   //xlog_write1("queue", __FILE__, __LINE__);
   bool invalidate_reactor = false;
@@ -530,7 +463,21 @@ int Client::queue(const char* buf, size_t size, bool closesocket)
 
     if (buf and size)
     {
-      if (size > (m_out_pend_max - m_out_q.pending))
+      // find any earlier message for the same key that is not yet written;
+      // its space is reclaimed when it is replaced
+      std::list<RawMsg>::iterator old = m_out_q.items.end();
+      size_t reclaim = 0;
+      if (key)
+      {
+        OutboundQueue::KeyIndex::iterator k = m_out_q.keyed.find(*key);
+        if (k != m_out_q.keyed.end() and not k->second->busy)
+        {
+          old     = k->second;
+          reclaim = old->size;
+        }
+      }
+
+      if (size > (m_out_pend_max - m_out_q.pending + reclaim))
       {
         /* The outbound half of the socket has become both flow controlled,
          * and has backed up queued data into the exio framework to such an
@@ -559,10 +506,32 @@ int Client::queue(const char* buf, size_t size, bool closesocket)
       else
       {
         // TODO: could throw due to out of memory
-        m_out_q.items.push_back( RawMsg(buf, size) );
+        if (shared)
+          m_out_q.items.push_back( RawMsg(*shared) );
+        else
+          m_out_q.items.push_back( RawMsg(buf, size) );
         m_out_q.itemcount++;
         m_out_q.pending += size;
         invalidate_reactor = true;
+
+        if (key)
+        {
+          // the new message goes to the back, rather than taking the place
+          // of the old, so that it stays behind any unkeyed message, such as
+          // a row delete, queued since the old one
+          if (old != m_out_q.items.end())
+          {
+            old->freemem();
+            m_out_q.items.erase( old );
+            m_out_q.itemcount--;
+            m_out_q.pending -= reclaim;
+            m_out_q.replaced++;
+          }
+
+          std::list<RawMsg>::iterator added = --m_out_q.items.end();
+          added->key = *key;
+          m_out_q.keyed[ *key ] = added;
+        }
       }
     }
 
@@ -579,7 +548,7 @@ int Client::queue(const char* buf, size_t size, bool closesocket)
 
   }
 
-  if (invalidate_reactor) reactor()->invalidate();
+  if (invalidate_reactor) reactor()->invalidate(this);
 
   return 0; // success
 }
@@ -590,22 +559,27 @@ size_t Client::pending_out() const
   return m_out_q.pending;
 }
 //----------------------------------------------------------------------
+uint64_t Client::msgs_replaced() const
+{
+  cpp11::lock_guard<cpp11::mutex> guard( m_out_q.mutex );
+  return m_out_q.replaced;
+}
+//----------------------------------------------------------------------
 ReactorClient::IOState Client::handle_output() /* REACTOR THREAD */
 {
   /* we can now write bytes to the socket, without blocking  */
+  iovec iov[EXIO_CLIENT_IOV_MAX];
+
   while (true)
   {
-    RawMsg * next = NULL;
+    int    iovcnt = 0;
+    size_t wlen   = 0;
 
-    // get the next data item to write
+    // gather the queued data items to write
     {
       cpp11::lock_guard<cpp11::mutex> guard( m_out_q.mutex );
 
-      if (m_out_q.itemcount or !m_out_q.items.empty() or m_out_q.items.size())
-      {
-        next = &(m_out_q.items.front());
-      }
-      else
+      if (m_out_q.items.empty())
       {
         m_out_q.itemcount = 0;
         return ReactorClient::IO_default;
@@ -613,9 +587,9 @@ ReactorClient::IOState Client::handle_output() /* REACTOR THREAD */
 
       // handle close-io sentinel object - exio-client has requested an active
       // socket close.
-      if (*next == RawMsg())
+      if (m_out_q.items.front() == RawMsg())
       {
-        next->freemem();
+        m_out_q.items.front().freemem();
         m_out_q.items.erase( m_out_q.items.begin() );
         m_out_q.itemcount--;
 
@@ -634,64 +608,112 @@ ReactorClient::IOState Client::handle_output() /* REACTOR THREAD */
          // request controlled close of socket
         return ReactorClient::IO_close;
       }
+
+      // Items stay on the queue while they are written, and are only
+      // removed by this thread, so their memory remains valid after the lock
+      // is released.  Stop at any sentinel; it is handled once the data
+      // before it is written.
+      for (std::list<RawMsg>::iterator it = m_out_q.items.begin();
+           it != m_out_q.items.end() and iovcnt < EXIO_CLIENT_IOV_MAX; ++it)
+      {
+        if (*it == RawMsg()) break;
+        it->busy = true;
+        iov[iovcnt].iov_base = it->ptr;
+        iov[iovcnt].iov_len  = it->size;
+        wlen += it->size;
+        iovcnt++;
+      }
     }
 
-    /* Note: now using send() instead of write(), so that we can prevent
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = iovcnt;
+
+    /* Note: using sendmsg() instead of write(), so that we can prevent
      * SIGPIPE from being raised */
     const int flags = MSG_DONTWAIT bitor MSG_NOSIGNAL;
 
-    size_t const wlen = next->size;
-    ssize_t n = ::send(fd(), next->ptr, wlen , flags);
+    ssize_t n = ::sendmsg(fd(), &msg, flags);
     int const _err = errno;
+    m_writes_out++;
 
     try {
       if (m_log_io_events)
       {
         std::ostringstream os;
-        os << "send(fd"<<fd()<<","<<wlen<<")=" << n
+        os << "sendmsg(fd"<<fd()<<","<<iovcnt<<","<<wlen<<")=" << n
            << ", errno " << _err
            << " (" << utils::strerror(_err) << ")";
         _DEBUG_(m_logsvc, os.str());
       }
     } catch (...){}
 
-    if (n < 0)
+    if (n < 0 and _err != EAGAIN and _err != EWOULDBLOCK)
     {
-      if (_err == EAGAIN or _err == EWOULDBLOCK)
-      {
-        return ReactorClient::IO_default;
-      }
-      else
-      {
-        _WARN_(m_logsvc,
-               "socket write failed, fd " << fd() << ": "
-               << utils::strerror(_err) );
+      _WARN_(m_logsvc,
+             "socket write failed, fd " << fd() << ": "
+             << utils::strerror(_err) );
 
-        // request controlled shutdown
-        return ReactorClient::IO_close;
-      }
+      // request controlled shutdown
+      return ReactorClient::IO_close;
     }
-    else
+
     {
       cpp11::lock_guard<cpp11::mutex> guard( m_out_q.mutex );
 
-      next->eat(n);
-      m_bytes_out += n;
-      m_last_write = time(NULL);
+      size_t const written = (n > 0)? n : 0;
+
+      m_bytes_out += written;
+      if (written) m_last_write = Clock::now();
 
-      m_out_q.pending = (m_out_q.pending>(size_t)n)? (m_out_q.pending-n) : 0;
+      m_out_q.pending = (m_out_q.pending>written)? (m_out_q.pending-written):0;
 
-      // if all bytes written, pop from the queue
-      if (next->size == 0)
+      // pop all fully written items; a partially written item is left at the
+      // front of the queue, adjusted to start at its first unwritten byte,
+      // and stays busy because it can no longer be replaced
+      size_t remain  = written;
+      int    gathered = iovcnt;  // gathered items still on the queue
+      bool   partial  = false;
+      while (!m_out_q.items.empty())
       {
-        next->freemem();
+        RawMsg& front = m_out_q.items.front();
+        if (front == RawMsg()) break;
+        if (remain < front.size)
+        {
+          front.eat(remain);
+          partial = (remain != 0);
+          break;
+        }
+
+        remain -= front.size;
+        if (not front.key.empty())
+        {
+          OutboundQueue::KeyIndex::iterator k = m_out_q.keyed.find(front.key);
+          if (k != m_out_q.keyed.end() and k->second == m_out_q.items.begin())
+            m_out_q.keyed.erase( k );
+        }
+        front.freemem();
         m_out_q.items.erase( m_out_q.items.begin() );
         m_out_q.itemcount--;
+        m_msgs_out++;
+        gathered--;
       }
+
+      // gathered items not written at all can be replaced again
+      std::list<RawMsg>::iterator it = m_out_q.items.begin();
+      if (partial) { ++it; --gathered; }
+      for (; gathered > 0 and it != m_out_q.items.end(); --gathered, ++it)
+        it->busy = false;
     }
 
-    // Stay in the while loop, to send all queued data. If we were to return
-    // too early, then too much time is spend in the reactor entering into the poll.
+    if (n < 0) return ReactorClient::IO_default;
+
+    // A short write means the socket buffer is full, so wait for the next
+    // POLLOUT.  Otherwise stay in the while loop, to send all queued data. If
+    // we were to return too early, then too much time is spend in the
+    // reactor entering into the poll.
+    if ((size_t)n < wlen) return ReactorClient::IO_default;
   }
 }
 //----------------------------------------------------------------------
@@ -709,14 +731,10 @@ void Client::handle_close()   /* REACTOR THREAD */
     ::close(fd());
 
 
-    // Need to get the attention of a worker thread. Lets try by pushing
-    // data onto the fifo; then the reactor should see that we have work to
-    // do.
-    {
-      cpp11::lock_guard<cpp11::mutex> guard( m_datafifo.mutex );
-      m_datafifo.items.push_back( DataChunk() );
-      m_datafifo.itemcount++;
-    }
+    // Need to get the attention of a worker thread, so that it can deliver
+    // process_close() after any remaining inbound bytes; the reactor will
+    // then see that we have work to do.
+    m_in_state = eInClosed;
   }
 }
 //----------------------------------------------------------------------
@@ -744,7 +762,7 @@ void Client::release() /* ARBITRARY-CLIENT THREAD or WORKER THREAD */
     // request a close, just in case user-application forgot to request a shutdown
     m_attn_flags |= (eWantDelete);
 
-    m_tdestroy  = ::time(NULL);
+    m_tdestroy  = Clock::now();
 
     //xlog_write1("Client::release --> calling request_attn()", __FILE__, __LINE__);
     if (reactor()) reactor()->request_attn();
@@ -756,111 +774,155 @@ void Client::release() /* ARBITRARY-CLIENT THREAD or WORKER THREAD */
 //----------------------------------------------------------------------
 bool Client::has_work()
 {
+  return (m_ring.write_count() != m_in_seen) or (m_in_state == eInClosed);
+}
+//----------------------------------------------------------------------
+size_t Client::deliver_input(const char* p, size_t len) /* WORKER THREAD */
+{
+  size_t total = 0;
+
+  while (total < len)
   {
-    cpp11::lock_guard<cpp11::mutex> guard( m_datafifo.mutex );
-    if (m_datafifo.itemcount || m_datafifo.items.size())
-      return true;
+    size_t consumed = 0;
+
+    cpp11::lock_guard<cpp11::recursive_mutex> guard( m_cb_mtx );
+    if (m_cb)
+    {
+      try
+      {
+        consumed = m_cb->process_input(this, p+total, len-total);
+      }
+      catch (const std::exception& err)
+      {
+        _WARN_(m_logsvc,"exception during process_input: " << err.what());
+      }
+      catch (...)
+      {
+        _WARN_(m_logsvc,"exception during process_input");
+      }
+    }
+
+    if (consumed>0)
+    {
+      total += consumed;
+    }
     else
-      return false;
+    {
+      // ask how much input is needed to complete the partial message, so
+      // that it is not redelivered as each piece arrives
+      m_in_need = 0;
+      if (m_cb)
+      {
+        try
+        {
+          m_in_need = m_cb->input_needed(this);
+        }
+        catch (...) {}
+      }
+      break;
+    }
   }
+
+  if (total == len) m_in_need = 0;
+
+  return total;
+}
+//----------------------------------------------------------------------
+void Client::consume_input(size_t n) /* WORKER THREAD */
+{
+  m_ring.consume(n);
+
+  // if the reactor has stopped reading because the ring was full, it needs
+  // waking to resume
+  if (m_in_blocked.exchange(false)) reactor()->invalidate(this);
 }
 //----------------------------------------------------------------------
 void Client::do_work()
 {
+  // Note the close state before looking at the ring, so that all bytes read
+  // before the close are delivered before process_close()
+  bool const closed = (m_in_state == eInClosed);
+  m_in_seen = m_ring.write_count();
+
   {
     cpp11::lock_guard<cpp11::recursive_mutex> guard( m_cb_mtx );
     if (m_cb == NULL)
     {
       // we are no longer sending data to the client, so, ignore any work request
-      cpp11::lock_guard<cpp11::mutex> lock( m_datafifo.mutex );
-      m_datafifo.items.clear();
-      m_datafifo.itemcount=0;
-      m_datafifo.pending=0;
+      consume_input( m_ring.readable() );
+      if (closed) m_in_state = eInCloseDone;
       return;
     }
   }
 
   ReactorReadBuffer&buf = m_buf;
-  bool invoke_process_close = false;
 
+  while (true)
   {
-    cpp11::lock_guard<cpp11::mutex> lock( m_datafifo.mutex );
-
-    // copy all pending data into our inbound-buffer
-    while (m_datafifo.itemcount and !invoke_process_close)
+    if (buf.bytesavail())
     {
-      DataChunk& front = m_datafifo.items.front();
+      // A message is being assembled in the linear buffer, so move across
+      // the ring bytes.  If its length is known, only the rest of that
+      // message is moved, and the buffer is sized to fit it exactly.
+      size_t n = m_ring.readable();
+      if (n == 0) break;
 
-      if (front.size == 0) // got sentinel object
+      if (m_in_need > buf.bytesavail())
       {
-        // don't process any more pending inbound chunks after receiving the
-        // sentinel object (however, for data that has already been copied
-        // into the inbound-buffer, we need to pass that back to the client).
-        invoke_process_close = true;
+        n = std::min(n, m_in_need - buf.bytesavail());
+        buf.reserve(m_in_need);
       }
-      else
-      {
-        while (buf.space_remain() < front.size)
-        {
-          // TODO: need to handle throw on growth error
-          _DEBUG_(m_logsvc, "client: growing buffer, currently at " << buf.capacity());
-          buf.grow(); // throws on failure - TODO: need to handle this
-        }
-
-        // The cancopy amount is just front.size(). We can sure of this due
-        // to the preceeding growth. Ie, we don't need to compare it to the
-        // space remaining in the buffer.
-        size_t cancopy = front.size;
-        if (cancopy)
-        {
-          // good, readbuffer can accept more data
-          memcpy(buf.wp(), &(front.buf[front.start]), cancopy);
-          buf.incr_bytesavail( cancopy );
 
-          front.size  -= cancopy;
-          front.start += cancopy;
-        }
+      while (buf.space_remain() < n)
+      {
+        // TODO: need to handle throw on growth error
+        _DEBUG_(m_logsvc, "client: growing buffer, currently at " << buf.capacity());
+        buf.grow(); // throws on failure - TODO: need to handle this
       }
+      m_ring.copy_out(buf.wp(), n);
+      buf.incr_bytesavail(n);
+      consume_input(n);
 
-      m_datafifo.itemcount--;
-      m_datafifo.items.pop_front();  // no need to check if front has been used up
-    }
-
-  } // end of lock
-
+      if (buf.bytesavail() < m_in_need) continue;  // message still partial
 
-  // We have released the lock, which will allow the IO thread to
-  // proceed. Now pass our bytes to the derived method.
-  while ( buf.bytesavail() )
-  {
-    size_t consumed = 0;
-
-    cpp11::lock_guard<cpp11::recursive_mutex> guard( m_cb_mtx );
-    if (m_cb)
+      buf.consume( deliver_input(buf.rp(), buf.bytesavail()) );
+      buf.shift_pending_to_array_start();
+    }
+    else
     {
-      try
+      // Usual case: decode in place from the ring.
+      size_t len = 0;
+      const char* p = m_ring.peek(len);
+      if (len == 0) break;
+
+      // Skip delivery while a partial message is known to be incomplete
+      size_t used = 0;
+      if (m_ring.readable() >= m_in_need)
       {
-        consumed = m_cb->process_input(this, buf.rp(), buf.bytesavail());
+        used = deliver_input(p, len);
+        if (used) consume_input(used);
+
+        if (used == len) continue;  // any wrapped bytes are next
       }
-      catch (const std::exception& err)
+
+      // A partial message remains.  If it runs to the end of the ring array
+      // then it cannot be completed in place (this is also the case when
+      // the ring is full), so move it to the linear buffer.
+      if (m_ring.peek_at_end(p, len))
       {
-        _WARN_(m_logsvc,"exception during process_input: " << err.what());
+        size_t const remain = len - used;
+        buf.reserve(std::max(m_in_need, remain));
+        memcpy(buf.wp(), p + used, remain);
+        buf.incr_bytesavail(remain);
+        consume_input(remain);
+        continue;
       }
-      catch (...)
-      {
-        _WARN_(m_logsvc,"exception during process_input");
-      }
-    }
 
-    if (consumed>0)
-      buf.consume( consumed );
-    else
-      break;
+      break;  // wait for the rest of the message
+    }
   }
 
-  buf.shift_pending_to_array_start();
-
-  if (invoke_process_close)
+  if (closed)
   {
     {
       cpp11::lock_guard<cpp11::recursive_mutex> guard( m_cb_mtx );
@@ -883,14 +945,9 @@ void Client::do_work()
       m_cb = NULL;  // prevent any futher inbound flow
     }
 
-    // clear the inbound data queue, just in case some data found it way in
-    // there.
-    {
-      cpp11::lock_guard<cpp11::mutex> lock( m_datafifo.mutex );
-      m_datafifo.items.clear();
-      m_datafifo.itemcount=0;
-      m_datafifo.pending=0;
-    }
+    // discard any inbound data that was not consumed
+    consume_input( m_ring.readable() );
+    m_in_state = eInCloseDone;
   }
 }
 //----------------------------------------------------------------------
@@ -0,0 +1,88 @@
+#include "exio/Clock.h"
+#include "exio/utils.h"
+
+#include "mutex.h"
+
+#include <string.h>
+
+namespace exio {
+
+namespace {
+
+/* The latest second formatted, and its text */
+struct TimestampCache
+{
+    cpp11::mutex mutex;
+    time_t       secs;
+    SharedBuffer text;
+
+    TimestampCache() : secs(-1) {}
+};
+
+TimestampCache& cache()
+{
+  static TimestampCache c;  // constructed on first use
+  return c;
+}
+
+}
+
+//----------------------------------------------------------------------
+time_t Clock::now()
+{
+#ifdef CLOCK_REALTIME_COARSE
+  timespec ts;
+  if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0) return ts.tv_sec;
+#endif
+  return ::time(NULL);
+}
+
+//----------------------------------------------------------------------
+SharedBuffer Clock::row_timestamp(time_t t)
+{
+  TimestampCache& c = cache();
+  {
+    cpp11::lock_guard<cpp11::mutex> guard( c.mutex );
+    if (t == c.secs) return c.text;
+  }
+
+  std::string s = utils::row_timestamp(t);
+  SharedBuffer text(s.data(), s.size());
+
+  // only a later second replaces the cache, so formatting an old time,
+  // such as a row's, does not evict the current one
+  cpp11::lock_guard<cpp11::mutex> guard( c.mutex );
+  if (t > c.secs)
+  {
+    c.secs = t;
+    c.text = text;
+  }
+  return text;
+}
+
+//----------------------------------------------------------------------
+void Clock::row_timestamp(time_t t, std::string& dest)
+{
+  // Each thread also keeps the text of the latest second it has seen, so
+  // that threads updating different tables do not contend on the cache lock
+  static __thread time_t tl_secs = -1;
+  static __thread char   tl_text[32];
+  static __thread size_t tl_len = 0;
+
+  if (t == tl_secs)
+  {
+    dest.assign(tl_text, tl_len);
+    return;
+  }
+
+  SharedBuffer text = row_timestamp(t);
+  if (t > tl_secs and text.size() <= sizeof(tl_text))
+  {
+    memcpy(tl_text, text.data(), text.size());
+    tl_len  = text.size();
+    tl_secs = t;
+  }
+  dest.assign(text.data(), text.size());
+}
+
+} // namespace exio
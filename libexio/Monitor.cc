@@ -24,12 +24,17 @@
 
 
 #include <iostream>
+#include <algorithm>
+
+#include <unistd.h>
 
 namespace exio {
 
 /* Constructor */
 Monitor::Monitor(AdminInterfaceImpl * ai)
-  : m_ai( ai )
+  : m_ai( ai ),
+    m_conflation_thread( NULL ),
+    m_is_stopping( false )
 {
   /* CAUTION: don't try to use the m_ai parameter in here, because that object
    * itself it likely to still be under initialisation. */
@@ -41,6 +46,90 @@ Monitor::Monitor(AdminInterfaceImpl * ai)
 Monitor::~Monitor()
 {
 //  _INFO_(m_ai->appsvc().log(), "Monitor::~Monitor");
+  stop();
+}
+
+//----------------------------------------------------------------------
+void Monitor::stop()
+{
+  cpp11::thread * thr = NULL;
+  {
+    cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
+    m_is_stopping = true;
+    std::swap(thr, m_conflation_thread);
+  }
+
+  if (thr)
+  {
+    thr->join();
+    delete thr;
+  }
+}
+
+//----------------------------------------------------------------------
+void Monitor::conflate_table(const std::string& tablename, int interval_ms)
+{
+  DataTable * table = this->table( tablename );
+  {
+    cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
+
+    if (interval_ms > 0 and m_conflation_thread == NULL
+        and not m_is_stopping)
+      m_conflation_thread = new cpp11::thread(&Monitor::conflation_TEP, this);
+  }
+
+  table->set_conflation( interval_ms );
+}
+
+//----------------------------------------------------------------------
+bool Monitor::table_update_counts(const std::string& tablename,
+                                  int& interval_ms,
+                                  uint64_t& received,
+                                  uint64_t& published) const
+{
+  DataTable * table = find_table( tablename );
+  if (table == NULL) return false;
+
+  DataTable::UpdateCounts counts = table->update_counts();
+  interval_ms = table->conflation();
+  received    = counts.received;
+  published   = counts.published;
+  return true;
+}
+
+//----------------------------------------------------------------------
+void Monitor::conflation_TEP()
+{
+  // Upper limit on the sleep, so that new intervals and a stop request are
+  // noticed promptly
+  const int max_wait_ms = 50;
+
+  while (not m_is_stopping)
+  {
+    // Tables are never removed, so the pointers remain valid after the
+    // tables-locks are released, and flushing does not hold them.
+    std::vector< DataTable* > tables;
+    all_tables( tables );
+
+    int wait_ms = max_wait_ms;
+    for (std::vector< DataTable* >::iterator it = tables.begin();
+         it != tables.end(); ++it)
+    {
+      try
+      {
+        int due = (*it)->flush_conflated();
+        if (due > 0 and due < wait_ms) wait_ms = due;
+      }
+      catch (const std::exception& e)
+      {
+        _WARN_(m_ai->appsvc().log(),
+               "conflation flush of table " << (*it)->table_name()
+               << " failed: " << e.what());
+      }
+    }
+
+    usleep(wait_ms * 1000);
+  }
 }
 
 
@@ -48,12 +137,13 @@ Monitor::~Monitor()
 
 void Monitor::unsubscribe_all(const SID& __id)
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
+  std::vector< DataTable* > tables;
+  all_tables( tables );
 
-  for (TableCollection::const_iterator it = m_tables.begin();
-       it != m_tables.end(); ++it)
+  for (std::vector< DataTable* >::const_iterator it = tables.begin();
+       it != tables.end(); ++it)
   {
-    DataTable* table = it->second;
+    DataTable* table = *it;
 
     table->del_subscriber( __id );
   }
@@ -63,12 +153,15 @@ void Monitor::unsubscribe_all(const SID& __id)
 
 void Monitor::subscribe_all(const SID& __id)
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
+  // Tables created after this point add the session themselves, since it is
+  // already in the session list
+  std::vector< DataTable* > tables;
+  all_tables( tables );
 
-  for (TableCollection::const_iterator it = m_tables.begin();
-       it != m_tables.end(); ++it)
+  for (std::vector< DataTable* >::const_iterator it = tables.begin();
+       it != tables.end(); ++it)
   {
-    DataTable* table = it->second;
+    DataTable* table = *it;
 
     try
     {
@@ -86,27 +179,29 @@ void Monitor::subscribe_all(const SID& __id)
 /* Obtain a list of monitoring tables */
 std::list< std::string > Monitor::tables() const
 {
-  std::list< std::string > tables;
-
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
+  std::vector< std::string > names;
 
-  for (TableCollection::const_iterator it = m_tables.begin();
-       it != m_tables.end(); ++it)
+  for (size_t i = 0; i < STRIPES; ++i)
   {
-    tables.push_back( it->first );
+    cpp11::lock_guard<cpp11::mutex> guard( m_stripes[i].mutex );
+
+    for (TableCollection::const_iterator it = m_stripes[i].tables.begin();
+         it != m_stripes[i].tables.end(); ++it)
+    {
+      names.push_back( it->first );
+    }
   }
 
-  return tables;
+  // in name order, as from a single collection
+  std::sort(names.begin(), names.end());
+  return std::list< std::string >(names.begin(), names.end());
 }
 
 //----------------------------------------------------------------------
 
 bool Monitor::table_exists(const std::string& table_name) const
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-
-  return m_tables.find( table_name) != m_tables.end();
-
+  return find_table( table_name ) != NULL;
 }
 
 //----------------------------------------------------------------------
@@ -114,64 +209,80 @@ bool Monitor::table_exists(const std::string& table_name) const
 void Monitor::table_subscribers(const std::string& table_name,
                                 std::list< SID >& __list) const
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
+  DataTable* table = find_table( table_name );
 
-  TableCollection::const_iterator it = m_tables.find ( table_name );
-
-  if (it != m_tables.end() )
-  {
-    DataTable* table = it->second;
-    table->table_subscribers( __list );
-  }
+  if (table) table->table_subscribers( __list );
 }
 
 //----------------------------------------------------------------------
 void Monitor::add_columns(const std::string& table_name,
                           const std::list<std::string>& cols)
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-
-  TableCollection::iterator iter = m_tables.find(table_name);
+  table( table_name )->add_columns(cols);
+}
 
+//----------------------------------------------------------------------
+void Monitor::update_table(const std::string & table_name,
+                           const std::string & row_key,
+                           const std::map<std::string, std::string>& fields)
+{
+  std::list< TableEventPtr > events;
   DataTable * table = NULL;
 
-  // search for an already existing table
-  if ( iter == m_tables.end() )
-  {
-    /* table not found, so create */
-    table = create_table_NOLOCK( table_name );
-  }
-  else
   {
-    table = iter->second;
+    Stripe& st = stripe( table_name );
+    cpp11::lock_guard<cpp11::mutex> guard( st.mutex );
+    TableCollection::iterator iter = st.tables.find(table_name);
+
+    // search for an already existing table
+    if ( iter == st.tables.end() )
+    {
+      /* table not found, so create */
+      table = create_table_NOLOCK( st, table_name );
+
+      // If the table did not exist, then we must apply the table update
+      // within the table-lock context, so that the table-creation and
+      // table-update events occur together.
+
+      table->update_row( row_key, fields, events );
+
+      return;
+    }
+    else
+    {
+      // table already existed... get a reference to the table, and perform
+      // the update outside of the tables-lock
+      table = iter->second;
+    }
   }
 
-  table->add_columns(cols);
+  // apply row updates, this is for the case where the table already existed.
+  table->update_row( row_key, fields, events );
 }
 
 //----------------------------------------------------------------------
-void Monitor::update_table(const std::string & table_name,
-                           const std::string & row_key,
-                           std::map<std::string, std::string> fields)
+void Monitor::update_table_batch(const std::string & table_name,
+                                 const AdminInterface::Table& rows)
 {
   std::list< TableEventPtr > events;
   DataTable * table = NULL;
 
   {
-    cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-    TableCollection::iterator iter = m_tables.find(table_name);
+    Stripe& st = stripe( table_name );
+    cpp11::lock_guard<cpp11::mutex> guard( st.mutex );
+    TableCollection::iterator iter = st.tables.find(table_name);
 
     // search for an already existing table
-    if ( iter == m_tables.end() )
+    if ( iter == st.tables.end() )
     {
       /* table not found, so create */
-      table = create_table_NOLOCK( table_name );
+      table = create_table_NOLOCK( st, table_name );
 
       // If the table did not exist, then we must apply the table update
       // within the table-lock context, so that the table-creation and
       // table-update events occur together.
 
-      table->update_row( row_key, fields, events );
+      table->update_rows( rows, events );
 
       return;
     }
@@ -184,7 +295,7 @@ void Monitor::update_table(const std::string & table_name,
   }
 
   // apply row updates, this is for the case where the table already existed.
-  table->update_row( row_key, fields, events );
+  table->update_rows( rows, events );
 }
 
 //----------------------------------------------------------------------
@@ -198,14 +309,15 @@ void Monitor::update_meta(const std::string & table_name,
   DataTable * table = NULL;
 
   {
-    cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-    TableCollection::iterator iter = m_tables.find(table_name);
+    Stripe& st = stripe( table_name );
+    cpp11::lock_guard<cpp11::mutex> guard( st.mutex );
+    TableCollection::iterator iter = st.tables.find(table_name);
 
     // search for an already existing table
-    if ( iter == m_tables.end() )
+    if ( iter == st.tables.end() )
     {
       /* table not found, so create */
-      table = create_table_NOLOCK( table_name );
+      table = create_table_NOLOCK( st, table_name );
 
       // If the table did not exist, then we must apply the table update
       // within the table-lock context, so that the table-creation and
@@ -228,15 +340,61 @@ void Monitor::update_meta(const std::string & table_name,
   table->update_meta( row_key, column, meta, events);
 }
 //----------------------------------------------------------------------
-void Monitor::clear_all_tables()
+DataTable* Monitor::table(const std::string& table_name)
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
+  Stripe& st = stripe( table_name );
+  cpp11::lock_guard<cpp11::mutex> guard( st.mutex );
 
+  TableCollection::iterator iter = st.tables.find(table_name);
+  return (iter != st.tables.end())? iter->second
+    : create_table_NOLOCK( st, table_name );
+}
 
-  for (TableCollection::const_iterator it = m_tables.begin();
-       it != m_tables.end(); ++it)
+//----------------------------------------------------------------------
+Monitor::Stripe& Monitor::stripe(const std::string& table_name) const
+{
+  // FNV-1a hash of the name
+  uint32_t h = 2166136261u;
+  for (std::string::const_iterator i = table_name.begin();
+       i != table_name.end(); ++i)
+    h = (h ^ (unsigned char) *i) * 16777619u;
+
+  return m_stripes[ h % STRIPES ];
+}
+
+//----------------------------------------------------------------------
+DataTable* Monitor::find_table(const std::string& table_name) const
+{
+  Stripe& st = stripe( table_name );
+  cpp11::lock_guard<cpp11::mutex> guard( st.mutex );
+
+  TableCollection::const_iterator iter = st.tables.find(table_name);
+  return (iter != st.tables.end())? iter->second : NULL;
+}
+
+//----------------------------------------------------------------------
+void Monitor::all_tables(std::vector< DataTable* >& dest) const
+{
+  for (size_t i = 0; i < STRIPES; ++i)
   {
-    DataTable* tableptr = it->second;
+    cpp11::lock_guard<cpp11::mutex> guard( m_stripes[i].mutex );
+
+    for (TableCollection::const_iterator it = m_stripes[i].tables.begin();
+         it != m_stripes[i].tables.end(); ++it)
+      dest.push_back( it->second );
+  }
+}
+
+//----------------------------------------------------------------------
+void Monitor::clear_all_tables()
+{
+  std::vector< DataTable* > tables;
+  all_tables( tables );
+
+  for (std::vector< DataTable* >::const_iterator it = tables.begin();
+       it != tables.end(); ++it)
+  {
+    DataTable* tableptr = *it;
     tableptr->clear_table();
   }
 }
@@ -247,37 +405,18 @@ void Monitor::table_column_attr(const std::string& table_name,
                                 const std::string& column,
                                 const sam::txContainer& attribute)
 {
-  DataTable * table = NULL;
-
-  {
-    cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-    TableCollection::iterator iter = m_tables.find(table_name);
-
-    // search for an already existing table
-    if ( iter == m_tables.end() )
-    {
-      /* table not found, so create */
-      table = create_table_NOLOCK( table_name );
-      table->add_column_attr(column, attribute);
-      return;
-    }
-    else
-    {
-      table = iter->second;
-      table->add_column_attr(column, attribute);
-      return;
-    }
-  }
+  table( table_name )->add_column_attr(column, attribute);
 
 }
 
 //----------------------------------------------------------------------
 /*
- * Obtain the DataTable for table_name.  Either an existing table is returned,
- * or a new one is constructed.  This method will not take the lock, so ensure
- * the lock is held before calling this method.
+ * Construct a new DataTable for table_name.  This method will not take the
+ * lock, so ensure the lock of the table's stripe is held before calling this
+ * method.
  */
-DataTable* Monitor::create_table_NOLOCK(const std::string& table_name)
+DataTable* Monitor::create_table_NOLOCK(Stripe& st,
+                                        const std::string& table_name)
 {
   DataTable * table = new DataTable( table_name, m_ai );
 
@@ -294,7 +433,7 @@ DataTable* Monitor::create_table_NOLOCK(const std::string& table_name)
   }
 
   // register our table -- this is why we need to hold the tables lock
-  m_tables[ table_name ] = table;
+  st.tables[ table_name ] = table;
 
   return table;
 }
@@ -302,80 +441,57 @@ DataTable* Monitor::create_table_NOLOCK(const std::string& table_name)
 bool Monitor::has_row(const std::string& tablename,
                       const std::string& rowkey) const
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-
-  TableCollection::const_iterator iter = m_tables.find(tablename);
+  DataTable* table = find_table(tablename);
 
-  if (iter == m_tables.end())
-    return false;
-  else
-    return iter->second->has_row(rowkey);
+  return table and table->has_row(rowkey);
 }
 //----------------------------------------------------------------------
 bool Monitor::has_table(const std::string& tablename) const
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-
-  return m_tables.find(tablename) != m_tables.end();
+  return find_table(tablename) != NULL;
 }
 //----------------------------------------------------------------------
+/*
+ * Note: the methods below do not hold a stripe lock while using the table
+ * they find.  Tables are never removed, so the table remains valid, and the
+ * table has its own lock.
+ */
 void Monitor::copy_table(const std::string& tablename,
                          AdminInterface::Table& dest) const
 {
-  // TODO: decision/engineering principle needed here.  Should we always keep
-  // the m_mutex lock for the entire duration of the function, or, can we give
-  // it up once we have performed the search for the table?  Need to go
-  // through what the issues are.
-
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-  TableCollection::const_iterator iter = m_tables.find(tablename);
+  DataTable* table = find_table(tablename);
 
-  if (iter != m_tables.end())
-  {
-    iter->second->copy_table(dest);
-  }
+  if (table) table->copy_table(dest);
 }
 //----------------------------------------------------------------------
 void Monitor::copy_table2(const std::string& tablename,
                           std::vector<std::string> & cols,
                           std::vector< std::vector <std::string> >& rows) const
 {
-  // TODO: decision/engineering principle needed here.  Should we always keep
-  // the m_mutex lock for the entire duration of the function, or, can we give
-  // it up once we have performed the search for the table?  Need to go
-  // through what the issues are.
-
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-  TableCollection::const_iterator iter = m_tables.find(tablename);
+  DataTable* table = find_table(tablename);
 
-  if (iter != m_tables.end())
-  {
-    iter->second->copy_table(cols, rows);
-  }
+  if (table) table->copy_table(cols, rows);
 }
 //----------------------------------------------------------------------
 void Monitor::copy_row(const std::string& tablename,
                        const std::string& rowkey,
                        AdminInterface::Row& dest) const
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-  TableCollection::const_iterator iter = m_tables.find(tablename);
+  DataTable* table = find_table(tablename);
 
-  if (iter != m_tables.end())
-  {
-    iter->second->copy_row(rowkey, dest);
-  }
+  if (table) table->copy_row(rowkey, dest);
 }
 
 //----------------------------------------------------------------------
 void Monitor::broadcast_snapshot()
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
+  std::vector< DataTable* > tables;
+  all_tables( tables );
 
-  for (TableCollection::iterator it = m_tables.begin();
-       it != m_tables.end(); ++it)
+  for (std::vector< DataTable* >::const_iterator it = tables.begin();
+       it != tables.end(); ++it)
   {
-    DataTable* table = it->second;
+    DataTable* table = *it;
     table->snapshot();
   }
 }
@@ -383,45 +499,32 @@ void Monitor::broadcast_snapshot()
 //----------------------------------------------------------------------
 void Monitor::broadcast_snapshot(const std::string& tablename)
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-  TableCollection::const_iterator iter = m_tables.find(tablename);
+  DataTable* table = find_table(tablename);
 
-  if (iter != m_tables.end()) iter->second->snapshot();
+  if (table) table->snapshot();
 }
 
 //----------------------------------------------------------------------
 void Monitor::clear_table(const std::string& tablename)
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-  TableCollection::iterator iter = m_tables.find(tablename);
+  DataTable* table = find_table(tablename);
 
-  if ( iter != m_tables.end() )
-  {
-    iter->second->clear_table();
-  }
+  if (table) table->clear_table();
 }
 //----------------------------------------------------------------------
 void Monitor::delete_row(const std::string& tablename,
                          const std::string & rowkey)
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-  TableCollection::iterator iter = m_tables.find(tablename);
+  DataTable* table = find_table(tablename);
 
-  if ( iter != m_tables.end() )
-  {
-    iter->second->delete_row(rowkey);
-  }
+  if (table) table->delete_row(rowkey);
 }
 //----------------------------------------------------------------------
 size_t Monitor::table_size(const std::string& tablename)
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-  TableCollection::const_iterator iter = m_tables.find(tablename);
+  DataTable* table = find_table(tablename);
 
-  if (iter != m_tables.end())
-    return iter->second->size();
-  else
-    return 0;
+  return table? table->size() : 0;
 }
 //----------------------------------------------------------------------
 bool Monitor::copy_field(const std::string& tablename,
@@ -429,33 +532,17 @@ bool Monitor::copy_field(const std::string& tablename,
                          const std::string& field,
                          std::string& dest) const
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
+  DataTable* table = find_table(tablename);
 
-  TableCollection::const_iterator iter = m_tables.find(tablename);
-
-  if (iter != m_tables.end())
-    return iter->second->copy_field(rowkey, field, dest);
-  else
-    return false;
+  return table and table->copy_field(rowkey, field, dest);
 }
 //----------------------------------------------------------------------
 void Monitor::copy_rowkeys(const std::string& tablename,
                            std::list< std::string >& dest) const
 {
-  /* Note: we hold the m_mutex for the full duration of the function, ie, we
-   * continue to hold it after the complete of the m_tables map lookup.  We
-   * need to do this so that the entry, which is pointer to resource, remains
-   * valid for our use.  So holding the lock prevents another thread from
-   * deleting our resource.
-   *
-   */
-  cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-  TableCollection::const_iterator iter = m_tables.find(tablename);
-
-  if (iter != m_tables.end())
-  {
-    iter->second->copy_rowkeys(dest);
-  }
+  DataTable* table = find_table(tablename);
+
+  if (table) table->copy_rowkeys(dest);
 }
 
 } // namespace exio
@@ -24,6 +24,7 @@
 #endif
 
 #include "exio/Reactor.h"
+#include "exio/Clock.h"
 #include "exio/Logger.h"
 #include "exio/AdminInterface.h"
 #include "exio/AdminInterfaceImpl.h"
@@ -35,6 +36,8 @@
 #include <map>
 
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <errno.h>
 #include <errno.h>
@@ -52,6 +55,10 @@
 #define POLLRDHUP 0x00
 #endif
 
+#ifndef EPOLLRDHUP
+#define EPOLLRDHUP 0x00
+#endif
+
 namespace exio {
 
 
@@ -108,96 +115,364 @@ struct ReactorMsg
 };
 
 //----------------------------------------------------------------------
+/*
+ * Notification queue into the reactor thread.  Producers push onto a
+ * lock-free list (one CAS per message) and the single consumer, the reactor
+ * thread, takes the whole list in one exchange.  The reactor is woken via an
+ * eventfd; wakeups are coalesced by the m_signalled flag, so however many
+ * producers push or call wakeup(), there is at most one write() to the
+ * eventfd per reactor sleep.
+ */
 class ReactorNotifQ
 {
+    struct Node
+    {
+        ReactorMsg msg;
+        Node*      next;
+        explicit Node(const ReactorMsg& m) : msg(m), next(NULL) {}
+    };
+
   public:
-    ReactorNotifQ(int pipein, int pipeout)
-      : m_pipein(pipein),
-        m_pipeout(pipeout)
+    ReactorNotifQ()
+      : m_head(NULL),
+        m_signalled(false),
+        m_fd(-1)
     {
+      m_fd = ::eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+      if (m_fd == -1)
+      {
+        throw std::runtime_error("cannot create eventfd: "
+                                 + utils::strerror(errno));
+      }
     }
 
-    void push_msg(const ReactorMsg& m)
+    ~ReactorNotifQ()
     {
-      cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
+      std::deque<ReactorMsg> unused;
+      pull(unused);
+      ::close(m_fd);
+    }
+
+    /* Descriptor which becomes readable when the reactor is signalled */
+    int fd() const { return m_fd; }
 
-      // if there are queued items, then we don't need to push another
-      // eNoEvent item.
-      if ( (m.type == ReactorMsg::eNoEvent)
-           and
-           ((m_pending.empty() == false) or m_pending.size())
-        )
+    /* Wake the reactor, without queuing a message */
+    void wakeup()
+    {
+      // test before exchange, to avoid a locked write while already signalled
+      if (m_signalled.load() == false and m_signalled.exchange(true) == false)
       {
-        return;
+        uint64_t one = 1;
+        // TODO: should handle error?
+        ssize_t n = ::write(m_fd, &one, sizeof(one));
+        (void) n;
       }
+    }
 
-      char c = 'x';
-      m_pending.push_back(m);
+    void push_msg(const ReactorMsg& m)
+    {
+      Node* n = new Node(m);
+      Node* head = m_head.load();
+      do
+      {
+        n->next = head;
+      } while (m_head.compare_exchange_strong(head, n) == false);
 
-      // write to pipe -- TODO: should handle error?
-      write(m_pipeout, &c, 1);
+      wakeup();
     }
 
+    /* Only called by the reactor thread */
     void pull(std::deque<ReactorMsg>& dest)
     {
       dest.clear();
-      cpp11::lock_guard<cpp11::mutex> guard( m_mutex );
-      m_pending.swap( dest );
 
-      // drain pipe
-      char buf[1024];
-      while (read(m_pipein, buf, sizeof(buf))>0) { }
+      uint64_t value;
+      ssize_t n = ::read(m_fd, &value, sizeof(value));
+      (void) n;
+
+      // Clear the signal before taking the list: a producer which pushes
+      // after the take is then guaranteed to see the flag cleared and so
+      // write to the eventfd again.
+      m_signalled = false;
+      Node* head = m_head.exchange(NULL);
+
+      // list is in LIFO order; reverse it to restore push order
+      Node* fifo = NULL;
+      while (head)
+      {
+        Node* next = head->next;
+        head->next = fifo;
+        fifo = head;
+        head = next;
+      }
+
+      while (fifo)
+      {
+        Node* next = fifo->next;
+        dest.push_back(fifo->msg);
+        delete fifo;
+        fifo = next;
+      }
+    }
+
+  private:
+    ReactorNotifQ(const ReactorNotifQ&);
+    ReactorNotifQ& operator=(const ReactorNotifQ&);
+
+    cpp11::atomic<Node*> m_head;
+    cpp11::atomic<bool>  m_signalled;
+    int                  m_fd;
+};
+
+//----------------------------------------------------------------------
+/*
+ * Interface to the OS I/O event notification.  Implementations are only used
+ * from the reactor thread.
+ */
+class ReactorPoller
+{
+  public:
+    typedef std::vector< std::pair<ReactorClient*, int> > Ready;
+
+    virtual ~ReactorPoller() {}
+
+    virtual const char* name() const = 0;
+
+    /* Client has been added to the reactor */
+    virtual void add(ReactorClient*) = 0;
+
+    /* Client's events() might have changed */
+    virtual void update(ReactorClient*) = 0;
+
+    /* Wait for I/O.  Clients with events are appended to 'ready', along with
+     * their poll-style revents.  Returns true if the notification queue was
+     * signalled. */
+    virtual bool wait(const std::vector<ReactorClient*>& clients,
+                      int timeout,
+                      Ready& ready) = 0;
+};
+
+//----------------------------------------------------------------------
+/*
+ * poll() based implementation.  The pollfd array is rebuilt on each call.
+ */
+class PollPoller : public ReactorPoller
+{
+  public:
+    explicit PollPoller(int notiffd) : m_notiffd(notiffd) {}
+
+    const char* name() const { return "poll"; }
+
+    void add(ReactorClient*)    {}
+    void update(ReactorClient*) {}
+
+    bool wait(const std::vector<ReactorClient*>& clients,
+              int timeout,
+              Ready& ready)
+    {
+      // POLLRDHUP is not included; clients request it along with POLLIN,
+      // because a hangup must not be acted on while unread data remains
+      const int stdevents = POLLERR|POLLHUP|POLLNVAL;
+
+      m_fdset.clear();
+      m_fdclients.clear();
+
+      // add our notification descriptor
+      pollfd pfd;
+      memset(&pfd, 0, sizeof(pfd));
+      pfd.fd = m_notiffd;
+      pfd.events = POLLIN bitor POLLHUP;
+      m_fdset.push_back( pfd );
+      m_fdclients.push_back( NULL );
+
+      // build the array of pollfd, and companion array of clients
+      for (std::vector<ReactorClient*>::const_iterator iter = clients.begin();
+           iter != clients.end(); ++iter)
+      {
+        ReactorClient* client = *iter;
+        if (client->io_open())
+        {
+          /* if we have called close() on the fd, we should not use it again
+           * in the poll */
+          memset(&pfd, 0, sizeof(pfd));
+          pfd.fd = client->fd();
+          pfd.events = client->events() |  stdevents;
+          m_fdset.push_back( pfd );
+          m_fdclients.push_back( client );
+        }
+      }
+
+      int nready = ::poll(&m_fdset[0], m_fdset.size(), timeout);
+      if (nready <= 0) return false;  // TODO: handle error
+
+      for (size_t i = 1; i < m_fdset.size(); ++i)
+      {
+        if (m_fdset[i].revents)
+          ready.push_back( std::make_pair(m_fdclients[i],
+                                          (int) m_fdset[i].revents) );
+      }
+
+      return m_fdset[0].revents != 0;
     }
 
   private:
-    std::deque<ReactorMsg> m_pending;
-    cpp11::mutex           m_mutex;
-    int                    m_pipein;
-    int                    m_pipeout;
+    int                         m_notiffd;
+    std::vector< pollfd >       m_fdset;
+    std::vector<ReactorClient*> m_fdclients;
+};
+
+//----------------------------------------------------------------------
+/*
+ * epoll() based implementation.  Each client is registered once, when added
+ * to the reactor, with the client pointer stored as the epoll user-data.
+ * Thereafter the registration is only modified when the client's events()
+ * changes, i.e., when POLLOUT interest is raised or dropped.  A client is
+ * implicitly removed from the interest set when its socket is closed.
+ */
+class EpollPoller : public ReactorPoller
+{
+  public:
+    enum { MAX_EVENTS = 256 };
+
+    EpollPoller(int notiffd, LogService* log)
+      : m_epfd(-1),
+        m_log(log)
+    {
+      m_epfd = ::epoll_create1(EPOLL_CLOEXEC);
+      if (m_epfd == -1)
+      {
+        int err = errno;
+        _WARN_(m_log, "epoll_create1 failed: " << utils::strerror(err));
+        throw std::runtime_error("cannot create epoll instance");
+      }
+
+      // add our notification descriptor, identified by a null pointer
+      epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events   = EPOLLIN;
+      ev.data.ptr = NULL;
+      if (::epoll_ctl(m_epfd, EPOLL_CTL_ADD, notiffd, &ev) != 0)
+      {
+        int err = errno;
+        ::close(m_epfd);
+        _WARN_(m_log, "epoll_ctl failed: " << utils::strerror(err));
+        throw std::runtime_error("cannot add eventfd to epoll instance");
+      }
+    }
+
+    ~EpollPoller()
+    {
+      ::close(m_epfd);
+    }
+
+    const char* name() const { return "epoll"; }
+
+    void add(ReactorClient* client)
+    {
+      if (client->io_open() == false) return;
+
+      client->m_poll_events = client->events() & (POLLIN|POLLOUT|POLLRDHUP);
+      ctl(EPOLL_CTL_ADD, client);
+    }
+
+    void update(ReactorClient* client)
+    {
+      if (client->io_open() == false) return;
+
+      int events = client->events() & (POLLIN|POLLOUT|POLLRDHUP);
+      if (events != client->m_poll_events)
+      {
+        client->m_poll_events = events;
+        ctl(EPOLL_CTL_MOD, client);
+      }
+    }
+
+    bool wait(const std::vector<ReactorClient*>&,
+              int timeout,
+              Ready& ready)
+    {
+      int nready = ::epoll_wait(m_epfd, m_events, MAX_EVENTS, timeout);
+      if (nready <= 0) return false;  // TODO: handle error
+
+      bool notified = false;
+      for (int i = 0; i < nready; ++i)
+      {
+        ReactorClient* client = (ReactorClient*) m_events[i].data.ptr;
+        if (client == NULL)
+          notified = true;
+        else
+          ready.push_back( std::make_pair(client,
+                                          to_poll(m_events[i].events)) );
+      }
+      return notified;
+    }
+
+  private:
+
+    void ctl(int op, ReactorClient* client)
+    {
+      epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = 0;
+      if (client->m_poll_events bitand POLLIN)    ev.events |= EPOLLIN;
+      if (client->m_poll_events bitand POLLOUT)   ev.events |= EPOLLOUT;
+      if (client->m_poll_events bitand POLLRDHUP) ev.events |= EPOLLRDHUP;
+      ev.data.ptr = client;
+
+      if (::epoll_ctl(m_epfd, op, client->fd(), &ev) != 0)
+      {
+        int err = errno;
+        _WARN_(m_log, "epoll_ctl(fd=" << client->fd() << ") failed: "
+               << utils::strerror(err));
+      }
+    }
+
+    static int to_poll(uint32_t e)
+    {
+      int revents = 0;
+      if (e bitand EPOLLIN)    revents |= POLLIN;
+      if (e bitand EPOLLPRI)   revents |= POLLPRI;
+      if (e bitand EPOLLOUT)   revents |= POLLOUT;
+      if (e bitand EPOLLRDHUP) revents |= POLLRDHUP;
+      if (e bitand EPOLLERR)   revents |= POLLERR;
+      if (e bitand EPOLLHUP)   revents |= POLLHUP;
+      return revents;
+    }
+
+    int         m_epfd;
+    LogService* m_log;
+    epoll_event m_events[MAX_EVENTS];
 };
 
 //----------------------------------------------------------------------
 
 /* Constructor */
-Reactor::Reactor(LogService* log, int nworkers)
+Reactor::Reactor(LogService* log, int nworkers, Config::Poller poller)
   : m_log(log),
     m_is_stopping(false),
     m_last_cleanup(0),
     m_notifq(NULL),
+    m_poller(NULL),
     m_io(NULL),
     m_thr_ids(1+nworkers)
 {
 
-  m_pipefd[0]=-1;  // reader
-  m_pipefd[1]=-1;  // writer
-
-  //  In Linux versions before 2.6.11, the capacity of a pipe was the same as
-  //  the system page size (e.g., 4096 bytes on i386).  Since Linux 2.6.11,
-  //  the pipe capacity is 65536 bytes.
+  m_notifq = new ReactorNotifQ();
 
-  // create our pipes
-  if (pipe(m_pipefd) != 0)
+  if (poller == Config::eEpoll)
   {
-    int err = errno;
-    _WARN_(m_log,
-           "pipe failed: "
-           << utils::strerror(err) );
-    m_pipefd[0]=-1;
-    m_pipefd[1]=-1;
-
-    throw std::runtime_error("cannot create pipe");
+    try
+    {
+      m_poller = new EpollPoller(m_notifq->fd(), m_log);
+    }
+    catch (const std::exception& e)
+    {
+      _WARN_(m_log, "reactor: " << e.what() << ", falling back to poll");
+    }
   }
+  if (m_poller == NULL) m_poller = new PollPoller(m_notifq->fd());
 
-  // set internal pipe to non-blocking
-  bool fcntlerr = false;
-  int fl;
-  fl = ::fcntl(m_pipefd[0], F_GETFL); if (fl < 0) fcntlerr = true;
-  if (::fcntl(m_pipefd[0], F_SETFL, fl | O_NONBLOCK) < 0)  fcntlerr = true;
-  fl = ::fcntl(m_pipefd[1], F_GETFL);  if (fl < 0) fcntlerr = true;
-  if (::fcntl(m_pipefd[1], F_SETFL, fl | O_NONBLOCK) < 0) fcntlerr = true;
-  if (fcntlerr) throw std::runtime_error("cannot set pipe to O_NONBLOCK");
-
-  m_notifq = new ReactorNotifQ(m_pipefd[0], m_pipefd[1]);
+  _INFO_(m_log, "reactor: using " << m_poller->name());
 
   /* create internal threads last as last step of object construction */
 
@@ -225,6 +500,7 @@ Reactor::~Reactor()
   // deleted member data, a hard to identify error will occur!.
   m_io -> join();
   delete m_io;
+  delete m_poller;
   delete m_notifq;
 
   // I have decided to shut down workers after the reactor. This is because
@@ -247,9 +523,6 @@ Reactor::~Reactor()
     *it = NULL;
   }
 
-  close(m_pipefd[0]);
-  close(m_pipefd[1]);
-
   /* final attempt to close sockets */
   for (std::vector<ReactorClient*>::iterator iter = m_clients.begin();
        iter != m_clients.end(); ++iter)
@@ -291,175 +564,64 @@ void Reactor::reactor_io_TEP()
 //----------------------------------------------------------------------
 void Reactor::reactor_main_loop()
 {
-  const int stdevents = POLLRDHUP|POLLERR|POLLHUP|POLLNVAL;
-
-  std::vector< pollfd > fdset;
-  std::map<int, ReactorClient*> fdmap;
+  ReactorPoller::Ready ready;
+  std::vector<ReactorClient*> dirty;
 
   while (m_is_stopping == false)
   {
-    fdset.clear();
-    fdmap.clear();
-
-    // add our internal pipe
-    pollfd pfd;
-    pfd.fd = m_pipefd[0];
-    pfd.events = POLLIN bitor POLLHUP;
-    fdset.push_back( pfd );
-
-    // TODO: I should only need to build the fdset and fdmap when a client is
-    // added or removed.  The only thing I need to do each time is just call
-    // events() to get the state of each client.
-    {
-//      cpp11::lock_guard<cpp11::mutex> guard(m_clients.lock);
-
-      // build the array of pollfd, and companion array of client-id's
-      for (std::vector<ReactorClient*>::iterator iter = m_clients.begin();
-           iter != m_clients.end(); ++iter)
-      {
-        ReactorClient* client = *iter;
-        if (client->io_open())
-        {
-          /* if we have called close() on the fd, we should not use it again
-           * in the poll */
-          pollfd pfd;
-          memset(&pfd, 0, sizeof(pfd));
-          pfd.fd = client->fd();
-          pfd.events = client->events() |  stdevents;
-          fdset.push_back( pfd );
-          fdmap[ pfd.fd ] = client;
-        }
-      }
-    }
-
-    // TODO: move this logging to a separate function
-    // {
-    //   std::ostringstream osin;
-    //   for (std::vector<pollfd>::const_iterator i = fdset.begin();
-    //        i != fdset.end(); ++i)
-    //   {
-    //     if (i->events)
-    //     {
-    //       osin << "[";
-    //       osin << "fd=" << i->fd << ", events=" << i->events << "(";
-    //       eventstr(osin, i->events);
-    //       osin << "),";
-    //       osin << "]";
-    //     }
-    //   }
-    //   _DEBUG_(m_log, "reactor: into poll, events: " << osin.str() );
-    // }
-
     // Are there client objects that are going through their closure
     // death-cycle .. if so, need a timeout. Choose a 1 second interval.
     int timeout = (!m_destroying.empty() || m_destroying.size())? 1000:-1;
 
-    int nready = ::poll(&fdset[0], fdset.size(), timeout);
-
-    // TODO: move this logging to a separate function
-    // {
-    //   std::ostringstream osout;
-    //   osout << "nready=" << nready << ", ";
-    //   for (std::vector<pollfd>::const_iterator i = fdset.begin();
-    //        i != fdset.end(); ++i)
-    //   {
-    //     if (i->revents)
-    //     {
-    //       osout << "[";
-    //       osout << "fd=" << i->fd << ", revents=" << i->revents << "(";
-    //       eventstr(osout, i->revents);
-    //       osout << "),";
-    //       osout << "]";
-    //     }
-    //   }
-    //   _DEBUG_(m_log, "reactor: from poll, revents: " << osout.str() );
-    // }
+    ready.clear();
+    bool notified = m_poller->wait(m_clients, timeout, ready);
 
+    // single writer, so no locked read-modify-write is needed
+    m_load_wakeups.store(m_load_wakeups.load(cpp11::memory_order_relaxed) + 1,
+                         cpp11::memory_order_relaxed);
+    m_load_io_events.store(
+      m_load_io_events.load(cpp11::memory_order_relaxed) + ready.size(),
+      cpp11::memory_order_relaxed);
 
-    if (nready < 0)
+    for (ReactorPoller::Ready::iterator iter = ready.begin();
+         iter != ready.end(); ++iter)
     {
-      // TODO: handle error
+      handle_io_events(iter->first, iter->second);
     }
-    else if (nready == 0)
-    {
-      // No FD ready.
-    }
-    else
+
+    if (notified)
     {
-      for (std::vector<pollfd>::iterator iter = fdset.begin();
-           iter != fdset.end(); ++iter)
+      std::deque<ReactorMsg> nl;
+      m_notifq->pull( nl );
+      for (std::deque<ReactorMsg>::iterator n = nl.begin(); n != nl.end();++n)
       {
-        if (iter->fd  == m_pipefd[0]) continue; // skip ctrl-msg events ... do later
-
-        ReactorClient*   ptr       = fdmap[ iter->fd ];
-        int              revents   = iter->revents;
-        int              iost      = ReactorClient::IO_default;
-
-
-        // TODO: bug in here.  iost can be overrwritten by a POLLOUT event,
-        // after the POLLIN event has been called.
-
-        if (revents bitand POLLIN)
-        {
-          if (ptr->io_open()) iost or_eq ptr->handle_input();
-        }
-
-        if (revents bitand POLLPRI) { /* don't handle POLLPRI */ }
-
-        if (revents bitand POLLOUT)
-        {
-          if (ptr->io_open()) iost or_eq ptr->handle_output();
-        }
-
-        if ( (((revents bitand POLLRDHUP) or
-               (revents bitand POLLERR)   or
-               (revents bitand POLLHUP)   or
-               (revents bitand POLLNVAL))
-              and
-              ((iost bitand ReactorClient::IO_read_again) == 0))
-//              iost != ReactorClient::IO_read_again)
-             or (iost bitand ReactorClient::IO_close) )
-        {
-          ptr->handle_close();
-        }
+        handle_reactor_msg(*n);
       }
-
-      if (fdset[0].revents)
-      {
-        std::deque<ReactorMsg> nl;
-        m_notifq->pull( nl );
-        for (std::deque<ReactorMsg>::iterator n = nl.begin(); n != nl.end();++n)
-        {
-          handle_reactor_msg(*n);
-        }
-      }
-
     }
 
-    /* search for clients with work to do */
-    // TODO: this can be made more efficient, based on the earlier IO
-    for (std::vector<ReactorClient*>::iterator it = m_clients.begin();
-         it != m_clients.end(); ++it)
+    /* Only clients which had I/O, or which were invalidated, can have new
+     * poll events or new work. */
     {
-      ReactorClient* client = *it;
-
-      char oldstate;
-      char newstate;
-
-      client->update_run_state_for_reactor(oldstate, newstate);
-
-      if (oldstate=='N' and newstate=='Q')
-      {
-        cpp11::lock_guard<cpp11::mutex> guard( m_runq.mutex );
-        m_runq.items.push_back(client);
-        m_runq.itemcount++;
+      cpp11::lock_guard<cpp11::mutex> guard( m_dirty.mutex );
+      dirty.swap( m_dirty.items );
+    }
+    for (std::vector<ReactorClient*>::iterator it = dirty.begin();
+         it != dirty.end(); ++it)
+    {
+      // clear before examining, so that a later invalidate lists it again
+      (*it)->m_dirty = false;
+      examine(*it);
+    }
+    dirty.clear();
 
-        m_runq.cond.notify_one();
-      }
+    for (ReactorPoller::Ready::iterator iter = ready.begin();
+         iter != ready.end(); ++iter)
+    {
+      examine(iter->first);
     }
 
     /* Destruction cycle */
-    time_t now = ::time(NULL);
+    time_t now = Clock::now();
     std::set<ReactorClient*> deletenow;
     if (!m_destroying.empty() and
         (   ((now > m_last_cleanup) and ((now-m_last_cleanup)>2))
@@ -483,6 +645,9 @@ void Reactor::reactor_main_loop()
             deletenow.insert(client);
           }
         }
+
+        // destroy_cycle() might have closed the client, giving it work
+        if (deletenow.count(client) == 0) examine(client);
       }
     }
 
@@ -497,6 +662,20 @@ void Reactor::reactor_main_loop()
       }
       m_clients.swap( temp );
 
+      {
+        // the client could have been invalidated after its final examine
+        cpp11::lock_guard<cpp11::mutex> guard( m_dirty.mutex );
+        std::vector<ReactorClient*> keep;
+        for (std::vector<ReactorClient*>::iterator it = m_dirty.items.begin();
+             it != m_dirty.items.end(); ++it)
+        {
+          if (deletenow.find(*it) == deletenow.end()) keep.push_back(*it);
+        }
+        m_dirty.items.swap( keep );
+      }
+
+      m_load_clients.fetch_sub(deletenow.size(), cpp11::memory_order_relaxed);
+
       /* perform actual deletion */
       for (std::set<ReactorClient*>::iterator it = deletenow.begin();
            it != deletenow.end(); ++it)
@@ -514,11 +693,71 @@ void Reactor::reactor_main_loop()
 
 //----------------------------------------------------------------------
 
-void Reactor::invalidate()
+void Reactor::handle_io_events(ReactorClient* ptr, int revents)
+{
+  int iost = ReactorClient::IO_default;
+
+  // TODO: bug in here.  iost can be overrwritten by a POLLOUT event,
+  // after the POLLIN event has been called.
+
+  if (revents bitand POLLIN)
+  {
+    if (ptr->io_open()) iost or_eq ptr->handle_input();
+  }
+
+  if (revents bitand POLLPRI) { /* don't handle POLLPRI */ }
+
+  if (revents bitand POLLOUT)
+  {
+    if (ptr->io_open()) iost or_eq ptr->handle_output();
+  }
+
+  if ( (((revents bitand POLLRDHUP) or
+         (revents bitand POLLERR)   or
+         (revents bitand POLLHUP)   or
+         (revents bitand POLLNVAL))
+        and
+        ((iost bitand ReactorClient::IO_read_again) == 0))
+       or (iost bitand ReactorClient::IO_close) )
+  {
+    ptr->handle_close();
+  }
+}
+
+//----------------------------------------------------------------------
+
+void Reactor::invalidate(ReactorClient* client)
 {
-  // Danger here: this method is exposed to the user-application; they might
-  // end up pushing lots of data onto the pipe.
-  m_notifq->push_msg(ReactorMsg(ReactorMsg::eNoEvent));
+  // Called for every message queued on a client, so must be cheap.  The
+  // client is listed only once until the reactor next examines it.
+  if (client->m_dirty.exchange(true) == false)
+  {
+    cpp11::lock_guard<cpp11::mutex> guard( m_dirty.mutex );
+    m_dirty.items.push_back( client );
+  }
+  m_notifq->wakeup();
+}
+
+//----------------------------------------------------------------------
+
+/* Update the poll events of a client, and queue it for a worker if it now
+ * has work to do. */
+void Reactor::examine(ReactorClient* client)
+{
+  char oldstate;
+  char newstate;
+
+  m_poller->update(client);
+  client->update_run_state_for_reactor(oldstate, newstate);
+
+  if (oldstate=='N' and newstate=='Q')
+  {
+    cpp11::lock_guard<cpp11::mutex> guard( m_runq.mutex );
+    m_runq.items.push_back(client);
+    m_runq.itemcount++;
+
+    m_runq.cond.notify_one();
+  }
 }
 
 //----------------------------------------------------------------------
@@ -551,6 +790,10 @@ void Reactor::invalidate()
 
 void Reactor::add_client(ReactorClient* client)
 {
+  // counted here, rather than on the reactor thread, so that successive
+  // calls to load() see the client immediately
+  m_load_clients.fetch_add(1, cpp11::memory_order_relaxed);
+
   ReactorMsg msg(ReactorMsg::eAdd, client);
   m_notifq->push_msg(msg);
 }
@@ -590,6 +833,8 @@ void Reactor::handle_reactor_msg(const ReactorMsg& msg)
     case ReactorMsg::eAdd :
     {
       m_clients.push_back( msg.ptr );
+      m_poller->add( msg.ptr );
+      examine( msg.ptr );
       break;
     }
     case ReactorMsg::eTerminate :
@@ -604,7 +849,7 @@ void Reactor::handle_reactor_msg(const ReactorMsg& msg)
     }
     default:
     {
-      _ERROR_(m_log, "uknown message type on reactor pipe");
+      _ERROR_(m_log, "uknown message type on reactor notification queue");
       break;
     }
   }
@@ -743,4 +988,16 @@ const std::vector< std::pair<pthread_t,int> >& Reactor::thread_ids() const
 
 //----------------------------------------------------------------------
 
+Reactor::Load Reactor::load() const
+{
+  // the counters are only indicators, so need no ordering with other memory
+  Load l;
+  l.clients   = m_load_clients.load(cpp11::memory_order_relaxed);
+  l.wakeups   = m_load_wakeups.load(cpp11::memory_order_relaxed);
+  l.io_events = m_load_io_events.load(cpp11::memory_order_relaxed);
+  return l;
+}
+
+//----------------------------------------------------------------------
+
 } // namespace exio
@@ -33,11 +33,21 @@ size_t ReactorReadBuffer::grow()
     throw std::runtime_error(os.str().c_str());
   }
 
+  reserve(new_cap);
+
+  return extra;
+}
+
+//----------------------------------------------------------------------
+void ReactorReadBuffer::reserve(size_t n)
+{
+  if ((signed long long) n <= m_buf_cap) return;
+
   char* new_buf = NULL;
 
   try
   {
-    new_buf = new char[new_cap];
+    new_buf = new char[n];
   }
   catch (const std::bad_alloc& e)
   {
@@ -47,18 +57,18 @@ size_t ReactorReadBuffer::grow()
   if (new_buf == NULL)
   {
     std::ostringstream os;
-    os << "Failed to allocate " << new_cap << " bytes for socket buffer growth";
+    os << "Failed to allocate " << n << " bytes for socket buffer growth";
     throw std::runtime_error(os.str().c_str());
   }
 
-  memset(new_buf, 0, new_cap);
-  memcpy(new_buf, m_buf, m_buf_cap);
+  // only the pending bytes are of interest, so there is no need to copy or
+  // clear the rest of the array
+  if (m_bytesavail) memcpy(new_buf, m_buf + m_rp, m_bytesavail);
 
   delete [] m_buf;
   m_buf     = new_buf;
-  m_buf_cap = new_cap;
-
-  return extra;
+  m_buf_cap = n;
+  m_rp      = 0;
 }
 
 } // namespace exio
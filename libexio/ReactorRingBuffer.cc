@@ -0,0 +1,59 @@
+#include "exio/ReactorRingBuffer.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <sys/uio.h>
+
+namespace exio {
+
+//----------------------------------------------------------------------
+ReactorRingBuffer::ReactorRingBuffer(size_t cap)
+  : m_cap(1),
+    m_buf(NULL),
+    m_w(0),
+    m_r(0)
+{
+  while (m_cap < cap) m_cap <<= 1;
+  m_buf = new char[m_cap];
+}
+
+//----------------------------------------------------------------------
+ssize_t ReactorRingBuffer::read_from(int fd, int& err)
+{
+  size_t const w    = m_w.load();
+  size_t const off  = w & (m_cap-1);
+  size_t const free = m_cap - (w - m_r.load());
+
+  // free space is at most two segments: up to the array end, then from the
+  // array start
+  iovec iov[2];
+  int   iovcnt = 1;
+  iov[0].iov_base = m_buf + off;
+  iov[0].iov_len  = std::min(free, m_cap - off);
+  if (iov[0].iov_len < free)
+  {
+    iov[1].iov_base = m_buf;
+    iov[1].iov_len  = free - iov[0].iov_len;
+    iovcnt = 2;
+  }
+
+  ssize_t n = ::readv(fd, iov, iovcnt);
+  err = errno;
+
+  if (n > 0) m_w.store(w + n);  // publish to consumer
+
+  return n;
+}
+
+//----------------------------------------------------------------------
+void ReactorRingBuffer::copy_out(char* dest, size_t n) const
+{
+  size_t const off   = m_r.load() & (m_cap-1);
+  size_t const first = std::min(n, m_cap - off);
+
+  memcpy(dest, m_buf + off, first);
+  if (first < n) memcpy(dest + first, m_buf, n - first);
+}
+
+} // namespace exio
@@ -4,6 +4,11 @@
 #include <iostream>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
 
 #define RESERVE_FOR_SAM_HEADER 100
 
@@ -119,41 +124,87 @@ namespace exio {
 //----------------------------------------------------------------------
 /* Constructor */
 DynamicSamBuffer::DynamicSamBuffer(size_t reserve)
-  : m_msg_start(RESERVE_FOR_SAM_HEADER),
+  : m_buf(NULL),
+    m_size(0),
+    m_msg_start(RESERVE_FOR_SAM_HEADER),
     m_wptr(RESERVE_FOR_SAM_HEADER)
 {
   if (reserve < RESERVE_FOR_SAM_HEADER) reserve += RESERVE_FOR_SAM_HEADER;
-  m_buf.resize(reserve, '\0');
+  check_space(reserve - RESERVE_FOR_SAM_HEADER);
+}
+//----------------------------------------------------------------------
+DynamicSamBuffer::DynamicSamBuffer(const DynamicSamBuffer& src)
+  : m_buf(NULL),
+    m_size(0),
+    m_msg_start(src.m_msg_start),
+    m_wptr(src.m_msg_start)
+{
+  check_space(src.m_wptr - src.m_msg_start);
+  if (src.m_buf) memcpy(m_buf, src.m_buf, src.m_wptr);
+  m_wptr = src.m_wptr;
+}
+//----------------------------------------------------------------------
+DynamicSamBuffer& DynamicSamBuffer::operator=(const DynamicSamBuffer& src)
+{
+  if (this != &src)
+  {
+    DynamicSamBuffer tmp(src);
+    std::swap(m_buf, tmp.m_buf);
+    std::swap(m_size, tmp.m_size);
+    std::swap(m_msg_start, tmp.m_msg_start);
+    std::swap(m_wptr, tmp.m_wptr);
+  }
+  return *this;
 }
 //----------------------------------------------------------------------
 /* Destructor */
 DynamicSamBuffer::~DynamicSamBuffer()
 {
+  free(m_buf);
 }
 //----------------------------------------------------------------------
 void DynamicSamBuffer::check_space(size_t n)
 {
   // ensure current buffer has enough size
-  const size_t remain = m_buf.size() - m_wptr;
+  const size_t remain = m_size - m_wptr;
 
-  if (n > remain)
+  if (m_buf == NULL or n > remain)
   {
-    size_t newsize = std::max(m_buf.size() + n - remain, 2*m_buf.size()) ;
+    size_t newsize = std::max(m_wptr + n, 2*m_size) ;
 
-    if (newsize < m_buf.size())
+    if (newsize < m_size)
     {
       // oveflow?
       throw std::runtime_error("failed to resize encoding buffer");
     }
 
-    //std::cout << "resizing from " <<  m_buf.size() << " to " << newsize << "\n";
+    //std::cout << "resizing from " <<  m_size << " to " << newsize << "\n";
 
     // If the resize fails, std::bad_alloc is thrown and will be caught in
     // higher levels
-    m_buf.resize( newsize, '\0' );
+    char* p = (char*) realloc(m_buf, newsize);
+    if (p == NULL) throw std::bad_alloc();
+    m_buf  = p;
+    m_size = newsize;
   }
 }
 //----------------------------------------------------------------------
+void DynamicSamBuffer::transfer(SharedBuffer& dest)
+{
+  if (m_buf == NULL) check_space(0);
+
+  // give back unused space at the end; shrinking does not move the block
+  char* block = (char*) realloc(m_buf, m_wptr);
+  if (block == NULL) block = m_buf;
+
+  dest = SharedBuffer::adopt(block, block + m_msg_start, m_wptr - m_msg_start);
+
+  m_buf       = NULL;
+  m_size      = 0;
+  m_msg_start = RESERVE_FOR_SAM_HEADER;
+  m_wptr      = RESERVE_FOR_SAM_HEADER;
+}
+//----------------------------------------------------------------------
 void DynamicSamBuffer::append(const char* src, size_t srclen)
 {
   check_space(srclen);
@@ -168,6 +219,11 @@ void DynamicSamBuffer::append(char src)
   check_space(1);
   m_buf[ m_wptr++ ] = src;
 }
+//----------------------------------------------------------------------
+void DynamicSamBuffer::truncate(size_t msglen)
+{
+  if (msglen < msg_size()) m_wptr = m_msg_start + msglen;
+}
 
 //----------------------------------------------------------------------
 size_t DynamicSamBuffer::msg_size() const
@@ -196,6 +252,11 @@ size_t count_digits(unsigned int i)
 }
 //----------------------------------------------------------------------
 void DynamicSamBuffer::encode_header()
+{
+  encode_header(sam::SAM0101);
+}
+//----------------------------------------------------------------------
+void DynamicSamBuffer::encode_header(const char* version)
 {
   // calculate the current know message length, which is only a partial count
   // because we don't yet know how many bytes are needed to represent the
@@ -225,7 +286,7 @@ void DynamicSamBuffer::encode_header()
   char * const p_orig = p;
 
   *p = sam::MSG_START; p++;
-  memcpy(p, sam::SAM0101, 7); p += 7;
+  memcpy(p, version, 7); p += 7;
   *p = sam::META_DELIM; p++;
 
   char lenbuf[RESERVE_FOR_SAM_HEADER];
@@ -242,18 +303,19 @@ void DynamicSamBuffer::encode_header()
   if ( acutal_strlen != msglen_strlen)
   {
     // TODO: add error logs
-    throw std::runtime_error("SAM0101 encoding failed; msglen_string not of expected length");
+    throw std::runtime_error("SAM encoding failed; msglen_string not of expected length");
   }
   p += acutal_strlen;
 
   if ( (p - p_orig) != headlen)
   {
     // TODO: add error logs
-    throw std::runtime_error("SAM0101 encoding failed; generated headlen is not of expected size");
+    throw std::runtime_error("SAM encoding failed; generated headlen is not of expected size");
   }
 
   // change to SAM0100 for msgs of max length 99999
-  if (msglen_full <= sam::MAX_MSG_LEN and acutal_strlen <= 5)
+  if (memcmp(version, sam::SAM0101, 7) == 0 and
+      msglen_full <= sam::MAX_MSG_LEN and acutal_strlen <= 5)
   {
     memcpy(p_orig+1, sam::SAM0100, 7);;
   }
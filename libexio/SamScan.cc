@@ -0,0 +1,263 @@
+#include "exio/SamScan.h"
+#include "exio/sam.h"
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define EXIO_SAMSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace sam {
+
+namespace {
+
+//----------------------------------------------------------------------
+/* Scalar kernels, also used for the tail of the vector kernels */
+
+// filled in before any kernel is selected
+bool is_special[256];
+
+const char* find_special_scalar(const char* p, const char* end)
+{
+  while (p < end and not is_special[(unsigned char) *p]) ++p;
+  return p;
+}
+
+const char* find_either_scalar(const char* p, const char* end, char a, char b)
+{
+  while (p < end and *p != a and *p != b) ++p;
+  return p;
+}
+
+#ifdef EXIO_SAMSCAN_X86
+
+//----------------------------------------------------------------------
+/* SSE2 kernels; compare 16 bytes against each special character.
+ *
+ * Most SAM strings are shorter than a vector, so a final partial block is
+ * also scanned with a vector load, provided the 16 bytes read do not cross
+ * into the next page, which might not be mapped.  Matches beyond the end are
+ * masked off. */
+
+inline bool tail_load_safe(const char* p)
+{
+  return ((size_t) p & 4095) <= 4096 - 16;
+}
+
+inline const char* tail_result(const char* p, const char* end, unsigned mask)
+{
+  mask &= (1u << (end - p)) - 1;
+  return (mask)? p + __builtin_ctz(mask) : end;
+}
+
+__attribute__((target("sse2")))
+const char* find_special_sse2(const char* p, const char* end)
+{
+  const __m128i c0 = _mm_set1_epi8(MSG_START);
+  const __m128i c1 = _mm_set1_epi8(MSG_END);
+  const __m128i c2 = _mm_set1_epi8(MSG_DELIM);
+  const __m128i c3 = _mm_set1_epi8(SEQ_START);
+  const __m128i c4 = _mm_set1_epi8(SEQ_END);
+  const __m128i c5 = _mm_set1_epi8(FIELD_DELIM);
+  const __m128i c6 = _mm_set1_epi8(VALUE_DELIM);
+  const __m128i c7 = _mm_set1_epi8(META_DELIM);
+  const __m128i c8 = _mm_set1_epi8(ESCAPE);
+
+  while (p < end)
+  {
+    bool const partial = (end - p < 16);
+    if (partial and not tail_load_safe(p)) break;
+
+    __m128i v = _mm_loadu_si128((const __m128i*) p);
+    __m128i m = _mm_or_si128(
+      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, c0), _mm_cmpeq_epi8(v, c1)),
+                   _mm_or_si128(_mm_cmpeq_epi8(v, c2), _mm_cmpeq_epi8(v, c3))),
+      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, c4), _mm_cmpeq_epi8(v, c5)),
+                   _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, c6),
+                                             _mm_cmpeq_epi8(v, c7)),
+                                _mm_cmpeq_epi8(v, c8))));
+
+    unsigned mask = _mm_movemask_epi8(m);
+    if (partial) return tail_result(p, end, mask);
+    if (mask) return p + __builtin_ctz(mask);
+    p += 16;
+  }
+
+  return find_special_scalar(p, end);
+}
+
+__attribute__((target("sse2")))
+const char* find_either_sse2(const char* p, const char* end, char a, char b)
+{
+  const __m128i ca = _mm_set1_epi8(a);
+  const __m128i cb = _mm_set1_epi8(b);
+
+  while (p < end)
+  {
+    bool const partial = (end - p < 16);
+    if (partial and not tail_load_safe(p)) break;
+
+    __m128i v = _mm_loadu_si128((const __m128i*) p);
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, ca), _mm_cmpeq_epi8(v, cb));
+
+    unsigned mask = _mm_movemask_epi8(m);
+    if (partial) return tail_result(p, end, mask);
+    if (mask) return p + __builtin_ctz(mask);
+    p += 16;
+  }
+
+  return find_either_scalar(p, end, a, b);
+}
+
+//----------------------------------------------------------------------
+/* AVX2 kernels; as SSE2, but 32 bytes at a time */
+
+__attribute__((target("avx2")))
+const char* find_special_avx2(const char* p, const char* end)
+{
+  const __m256i c0 = _mm256_set1_epi8(MSG_START);
+  const __m256i c1 = _mm256_set1_epi8(MSG_END);
+  const __m256i c2 = _mm256_set1_epi8(MSG_DELIM);
+  const __m256i c3 = _mm256_set1_epi8(SEQ_START);
+  const __m256i c4 = _mm256_set1_epi8(SEQ_END);
+  const __m256i c5 = _mm256_set1_epi8(FIELD_DELIM);
+  const __m256i c6 = _mm256_set1_epi8(VALUE_DELIM);
+  const __m256i c7 = _mm256_set1_epi8(META_DELIM);
+  const __m256i c8 = _mm256_set1_epi8(ESCAPE);
+
+  while (end - p >= 32)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i*) p);
+    __m256i m = _mm256_or_si256(
+      _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, c0), _mm256_cmpeq_epi8(v, c1)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, c2), _mm256_cmpeq_epi8(v, c3))),
+      _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, c4), _mm256_cmpeq_epi8(v, c5)),
+        _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, c6),
+                                        _mm256_cmpeq_epi8(v, c7)),
+                        _mm256_cmpeq_epi8(v, c8))));
+
+    unsigned mask = _mm256_movemask_epi8(m);
+    if (mask) return p + __builtin_ctz(mask);
+    p += 32;
+  }
+
+  return find_special_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* find_either_avx2(const char* p, const char* end, char a, char b)
+{
+  const __m256i ca = _mm256_set1_epi8(a);
+  const __m256i cb = _mm256_set1_epi8(b);
+
+  while (end - p >= 32)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i*) p);
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, ca),
+                                _mm256_cmpeq_epi8(v, cb));
+
+    unsigned mask = _mm256_movemask_epi8(m);
+    if (mask) return p + __builtin_ctz(mask);
+    p += 32;
+  }
+
+  return find_either_sse2(p, end, a, b);
+}
+
+#endif
+
+//----------------------------------------------------------------------
+/* Kernel selection */
+
+struct Kernels
+{
+    const char* name;
+    const char* (*special)(const char*, const char*);
+    const char* (*either)(const char*, const char*, char, char);
+};
+
+const Kernels all_kernels[] =
+{
+#ifdef EXIO_SAMSCAN_X86
+  { "avx2",   find_special_avx2,   find_either_avx2 },
+  { "sse2",   find_special_sse2,   find_either_sse2 },
+#endif
+  { "scalar", find_special_scalar, find_either_scalar }
+};
+
+const size_t nkernels = sizeof(all_kernels) / sizeof(all_kernels[0]);
+
+bool kernel_supported(const Kernels& k)
+{
+#ifdef EXIO_SAMSCAN_X86
+  __builtin_cpu_init();
+  if (strcmp(k.name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+  if (strcmp(k.name, "sse2") == 0) return __builtin_cpu_supports("sse2");
+#endif
+  return true;
+}
+
+/* Selected on first use, rather than during static initialisation, so that
+ * the SAM codec can be used from other static initialisers.  Concurrent first
+ * uses make the same choice, so the race is benign. */
+const Kernels* kernels = NULL;
+
+const Kernels* select_kernels()
+{
+  for (const char* s = SPECIAL_CHARS; *s; ++s)
+    is_special[ (unsigned char) *s ] = true;
+
+  // kernels are listed fastest first
+  for (size_t i = 0; i < nkernels; ++i)
+    if (kernel_supported(all_kernels[i]))
+      return kernels = &all_kernels[i];
+
+  return kernels = &all_kernels[nkernels-1];
+}
+
+inline const Kernels* get_kernels()
+{
+  return (kernels)? kernels : select_kernels();
+}
+
+} // namespace
+
+//----------------------------------------------------------------------
+const char* find_special(const char* p, const char* end)
+{
+  return get_kernels()->special(p, end);
+}
+
+//----------------------------------------------------------------------
+const char* find_either(const char* p, const char* end, char a, char b)
+{
+  return get_kernels()->either(p, end, a, b);
+}
+
+//----------------------------------------------------------------------
+const char* scan_kernel()
+{
+  return get_kernels()->name;
+}
+
+//----------------------------------------------------------------------
+bool set_scan_kernel(const char* name)
+{
+  get_kernels();
+
+  for (size_t i = 0; i < nkernels; ++i)
+  {
+    if (strcmp(all_kernels[i].name, name) == 0
+        and kernel_supported(all_kernels[i]))
+    {
+      kernels = &all_kernels[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace sam
@@ -0,0 +1,58 @@
+#include "exio/SharedBuffer.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <new>
+
+namespace exio {
+
+//----------------------------------------------------------------------
+SharedBuffer::SharedBuffer(const char* src, size_t len)
+  : m_rep(new Rep)
+{
+  char* block = (char*) malloc(len? len : 1);
+  if (block == NULL)
+  {
+    delete m_rep;
+    throw std::bad_alloc();
+  }
+  memcpy(block, src, len);
+
+  m_rep->refs  = 1;
+  m_rep->mem   = block;
+  m_rep->size  = len;
+  m_rep->block = block;
+}
+
+//----------------------------------------------------------------------
+SharedBuffer SharedBuffer::adopt(char* block, const char* src, size_t len)
+{
+  SharedBuffer sb;
+  try
+  {
+    sb.m_rep = new Rep;
+  }
+  catch (...)
+  {
+    free(block);
+    throw;
+  }
+  sb.m_rep->refs  = 1;
+  sb.m_rep->mem   = src;
+  sb.m_rep->size  = len;
+  sb.m_rep->block = block;
+  return sb;
+}
+
+//----------------------------------------------------------------------
+void SharedBuffer::release()
+{
+  if (m_rep and m_rep->refs.fetch_sub(1) == 1)
+  {
+    free(m_rep->block);
+    delete m_rep;
+  }
+  m_rep = NULL;
+}
+
+} // namespace exio
@@ -21,41 +21,74 @@
 
 #include "exio/MsgIDs.h"
 #include "exio/AdminInterfaceImpl.h"
+#include "exio/OutboundMsg.h"
 #include "exio/Logger.h"
 #include "exio/AdminSession.h"
+#include "exio/SamBuffer.h"
+#include "exio/SharedBuffer.h"
+#include "exio/TableSerialiser.h"
 #include "exio/AppSvc.h"
+#include "exio/Clock.h"
 #include "exio/Logger.h"
 #include "exio/utils.h"
 
 #include <sstream>
 #include <set>
 #include <sys/time.h>
+#include <time.h>
 #include <string.h>
 #include <stdio.h>
 
 namespace exio
 {
 
+const size_t DataTable::npos;
 
-class SnapshotSerialiser
+/*
+ * Encodes a table snapshot, as a series of tableupdate messages, in a single
+ * pass.  Row fields are streamed straight into the body of the current
+ * batch, and a batch is cut at a row boundary once a row takes it past the
+ * SAM message limit.  Each head carries the batch count, so heads are added
+ * only when all rows have been encoded.
+ */
+class SnapshotEncoder
 {
   public:
-    SnapshotSerialiser();
-    void set_table_name(const std::string& table_name);
+    SnapshotEncoder(AppSvc&, const std::string& table_name, sam::WireFormat);
 
-    void add_row(DataRow&, const DataTable::MetaForCol* meta = NULL);
+    /* Start a new row, returning the buffer its fields are encoded to */
+    SamBuffer* begin_row();
 
-    const sam::txMessage& message() const { return m_msg;}
-          sam::txMessage& message()       { return m_msg;}
-
-  private:
-    sam::txMessage m_msg;
+    /* Complete the current row, moving it to a new batch if it does not
+     * fit in the current one */
+    void end_row();
 
-    static sam::txMessage empty_msg();
-};
+    sam::SAMProtocol& protocol() { return m_protocol; }
 
+    /* Add heads, and produce the encoded messages in batch order */
+    void finish(std::vector< SharedBuffer >& msgs);
 
+  private:
 
+    struct Batch
+    {
+        DynamicSamBuffer body;  // the row_N=[...], items
+        size_t rows;
+        Batch() : rows(0) {}
+    };
+
+    size_t encode_msg(SamBuffer*, const char* body, size_t bodylen,
+                      const std::string& rows,
+                      const std::string& snapi,
+                      const std::string& snapn);
+
+    sam::SAMProtocol   m_protocol;
+    std::string        m_table_name;
+    std::list< Batch > m_batches;
+    size_t m_overhead;   // message bytes other than the rows
+    size_t m_row_start;  // body offset of the current row
+    size_t m_row_fields; // body offset of the current row's fields
+};
 
 class TableDescrSerialiser
 {
@@ -76,73 +109,313 @@ class TableDescrSerialiser
 };
 
 //======================================================================
-SnapshotSerialiser::SnapshotSerialiser()
-  : m_msg( SnapshotSerialiser::empty_msg() )
+SnapshotEncoder::SnapshotEncoder(AppSvc& appsvc,
+                                 const std::string& table_name,
+                                 sam::WireFormat format)
+  : m_protocol(appsvc, format),
+    m_table_name(table_name),
+    m_overhead(0),
+    m_row_start(0),
+    m_row_fields(0)
 {
+  // The framing and head are the same for every batch, other than the
+  // digits of the counts, so measure them once, allowing ten digits each.
+  const std::string wide = "4294967295";
+  DynamicSamBuffer probe;
+  m_overhead = encode_msg(&probe, NULL, 0, wide, wide, wide);
+
+  if (m_overhead >= sam::MAX_MSG_LEN)
+    throw std::runtime_error("failed to encode snapshot");
 }
 
-void SnapshotSerialiser::set_table_name(const std::string& table_name)
+SamBuffer* SnapshotEncoder::begin_row()
 {
-  m_msg.root().put_field( id::QN_tablename, table_name );
+  if (m_batches.empty()) m_batches.push_back( Batch() );
+
+  Batch& batch = m_batches.back();
+  m_row_start = batch.body.msg_size();
+  m_protocol.encode_open(&batch.body,
+                         id::row_prefix + utils::to_str((int)batch.rows));
+  m_row_fields = batch.body.msg_size();
+
+  return &batch.body;
 }
 
-void SnapshotSerialiser::add_row(DataRow& datarow,
-                                 const DataTable::MetaForCol* meta)
+void SnapshotEncoder::end_row()
 {
-  // get container into which all the rows are stored
-  sam::txContainer & body = m_msg.root().put_child(id::body);
+  const size_t limit = sam::MAX_MSG_LEN - m_overhead;
 
-  // counting entries gives #rows
-  size_t nrows = body.count_child();
+  Batch& batch = m_batches.back();
+  m_protocol.encode_close(&batch.body);
+
+  if (batch.body.msg_size() <= limit)
+  {
+    batch.rows++;
+    return;
+  }
 
-  // generate the name of our new row
-  std::ostringstream rowname;
-  rowname << id::row_prefix << nrows;
+  // A row too large for a message of its own cannot be sent
+  if (batch.rows == 0) throw std::runtime_error("failed to encode snapshot");
 
-  // create container for new row
-  sam::txContainer & row = body.put_child( rowname.str() );
+  // Cut the batch before this row.  The row is not encoded again; its
+  // encoded fields are moved to the new batch, under the first row name.
+  m_batches.push_back( Batch() );
+  Batch& next = m_batches.back();
 
-  // Now populate the row-container with the fields in the actual DataRow
-  for (DataRow::iterator j = datarow.begin(); j != datarow.end(); ++j)
+  m_protocol.encode_open(&next.body, id::row_prefix + "0");
+  next.body.append(batch.body.msg_start() + m_row_fields,
+                   batch.body.msg_size() - m_row_fields);
+  next.rows = 1;
+  batch.body.truncate(m_row_start);
+
+  if (next.body.msg_size() > limit)
+    throw std::runtime_error("failed to encode snapshot");
+}
+
+void SnapshotEncoder::finish(std::vector< SharedBuffer >& msgs)
+{
+  const std::string snapn = utils::to_str((int)m_batches.size());
+
+  int snapi = 0;
+  for (std::list< Batch >::const_iterator i = m_batches.begin();
+       i != m_batches.end(); ++i)
   {
-    row.put_field(j.name(), j.value() );
+    // reserve the exact space needed, plus room for the header
+    DynamicSamBuffer msg(512 + m_overhead + i->body.msg_size());
+
+    encode_msg(&msg, i->body.msg_start(), i->body.msg_size(),
+               utils::to_str((int)i->rows), utils::to_str(snapi++), snapn);
+
+    msgs.push_back( SharedBuffer() );
+    msg.transfer( msgs.back() );
   }
+}
+
+size_t SnapshotEncoder::encode_msg(SamBuffer* sb,
+                                   const char* body, size_t bodylen,
+                                   const std::string& rows,
+                                   const std::string& snapi,
+                                   const std::string& snapn)
+{
+  m_protocol.encode_begin(sb, id::tableupdate);
+
+  m_protocol.encode_open(sb, id::head);
+  m_protocol.encode_field(sb, id::tablename, m_table_name);
+  m_protocol.encode_field(sb, id::msgtype, id::tableupdate);
+  m_protocol.encode_field(sb, id::snapi, snapi);
+  m_protocol.encode_field(sb, id::snapn, snapn);
+  m_protocol.encode_close(sb);
+
+  m_protocol.encode_open(sb, id::body);
+  m_protocol.encode_field(sb, id::rows, rows);
+  if (bodylen) sb->append(body, bodylen);
+  m_protocol.encode_close(sb);
+
+  return m_protocol.encode_end(sb);
+}
+
+//======================================================================
+DataTable::BlockColumn::BlockColumn()
+{
+  memset(present, 0, sizeof(present));
+  memset(types, eText, sizeof(types));
+  memset(numbers, 0, sizeof(numbers));
+}
 
-  // Next, add any per cell meta data (PCMD)
-  if (meta)
+//----------------------------------------------------------------------
+DataTable::Block::Block(const Block& rhs)
+  : refs(1),
+    cols(rhs.cols)
+{
+  for (size_t i = 0; i < BLOCK_ROWS; ++i) slots[i] = rhs.slots[i];
+}
+
+//----------------------------------------------------------------------
+void DataTable::MetaData::release(Data* d)
+{
+  if (d and d->refs.fetch_sub(1) == 1) delete d;
+}
+
+//----------------------------------------------------------------------
+void DataTable::MetaData::share(const MetaData& src)
+{
+  if (&src == this) return;
+
+  if (src.m_data) src.m_data->refs.fetch_add(1);
+  release(m_data);
+  m_data = src.m_data;
+}
+
+//----------------------------------------------------------------------
+const DataTable::PCMD& DataTable::MetaData::map() const
+{
+  static const PCMD empty;
+  return m_data? m_data->pcmd : empty;
+}
+
+//----------------------------------------------------------------------
+/* As for Content::writable, a map found unshared stays so, since the caller
+ * holds the table-lock */
+DataTable::PCMD& DataTable::MetaData::map_for_write()
+{
+  if (m_data == NULL)
+    m_data = new Data;
+  else if (m_data->refs.load() > 1)
   {
-    for( DataTable::MetaForCol::const_iterator m = meta->begin();
-         m != meta->end(); ++m)
-    {
-      row.put_child(m->second);
-    }
+    Data* copy = new Data;
+    copy->pcmd = m_data->pcmd;
+    release(m_data);
+    m_data = copy;
   }
+  return m_data->pcmd;
+}
 
-  // update the row count
-  body.put_field(id::rows, utils::to_str(nrows+1));
+//----------------------------------------------------------------------
+void DataTable::Content::release(Block* b)
+{
+  if (b->refs.fetch_sub(1) == 1) delete b;
+}
 
+//----------------------------------------------------------------------
+void DataTable::Content::share(const Content& src)
+{
+  if (&src == this) return;
+
+  clear();
+  m_blocks = src.m_blocks;
+  for (std::vector< Block* >::iterator i = m_blocks.begin();
+       i != m_blocks.end(); ++i) (*i)->refs.fetch_add(1);
+  m_used  = src.m_used;
+  m_ncols = src.m_ncols;
 }
 
-sam::txMessage SnapshotSerialiser::empty_msg()
+//----------------------------------------------------------------------
+void DataTable::Content::clear()
 {
-  sam::txMessage msg(id::tableupdate) ;
+  for (std::vector< Block* >::iterator i = m_blocks.begin();
+       i != m_blocks.end(); ++i) release(*i);
+  m_blocks.clear();
+  m_used = 0;
+}
 
-  msg.root().put_field(id::QN_tablename, "");
-  msg.root().put_field(id::QN_body_rows, "0");
-  msg.root().put_field(id::QN_msgtype, id::tableupdate);
+//----------------------------------------------------------------------
+size_t DataTable::Content::add_slot()
+{
+  if (m_used == m_blocks.size() * BLOCK_ROWS) m_blocks.push_back( new Block );
+  return m_used++;
+}
 
-  return msg;
+//----------------------------------------------------------------------
+/* Get a block to change.  A block shared with an image is first copied; an
+ * image can only be taken under the table-lock, which the caller holds, so
+ * a block found unshared stays so. */
+DataTable::Block* DataTable::Content::writable(size_t block)
+{
+  Block* b = m_blocks[block];
+  if (b->refs.load() > 1)
+  {
+    Block* copy = new Block(*b);
+    release(b);
+    m_blocks[block] = b = copy;
+  }
+  return b;
 }
 
+//----------------------------------------------------------------------
+DataTable::BlockColumn& DataTable::Content::cells_for_write(size_t col,
+                                                           size_t slot)
+{
+  Block* b = writable(slot / BLOCK_ROWS);
+  if (col >= b->cols.size()) b->cols.resize( std::max(m_ncols, col + 1) );
+  return b->cols[col];
+}
 
+//----------------------------------------------------------------------
+const std::string& DataTable::Content::text(size_t col, size_t slot,
+                                            std::string& buf) const
+{
+  const BlockColumn& cells = *this->cells(col, slot);
+  size_t const i = slot % BLOCK_ROWS;
+  if (cells.types[i] == eText) return cells.values[i];
+
+  char text[32];
+  size_t len = format_number((CellType) cells.types[i], cells.numbers[i], text);
+  buf.assign(text, len);
+  return buf;
+}
+
+//----------------------------------------------------------------------
+/* Format a typed cell into 'dest', which has room for 32 characters.
+ * Returns the length, without a terminator. */
+size_t DataTable::format_number(CellType type, Number n, char* dest)
+{
+  switch (type)
+  {
+    case eInt64  : return utils::format_int64(n.i, dest);
+    case eDouble : return utils::format_double(n.d, dest);
+    default      : break;
+  }
+
+  if (n.i)
+  {
+    memcpy(dest, "true", 4);
+    return 4;
+  }
+  memcpy(dest, "false", 5);
+  return 5;
+}
 
 //----------------------------------------------------------------------
+void DataTable::Content::set_text(size_t col, size_t slot,
+                                  const std::string& value)
+{
+  BlockColumn& cells = cells_for_write(col, slot);
+  size_t const i = slot % BLOCK_ROWS;
+  cells.values[i]  = value;
+  cells.present[i] = true;
+  cells.types[i]   = eText;
+}
+
+//----------------------------------------------------------------------
+void DataTable::Content::set_number(size_t col, size_t slot,
+                                    CellType type, Number value)
+{
+  BlockColumn& cells = cells_for_write(col, slot);
+  size_t const i = slot % BLOCK_ROWS;
+  cells.types[i]   = type;
+  cells.numbers[i] = value;
+  cells.present[i] = true;
+  if (not cells.values[i].empty()) cells.values[i].clear();
+}
+
+//----------------------------------------------------------------------
+void DataTable::Content::clear_slot(size_t slot)
+{
+  Block* b = writable(slot / BLOCK_ROWS);
+  size_t const i = slot % BLOCK_ROWS;
+  for (std::vector< BlockColumn >::iterator c = b->cols.begin();
+       c != b->cols.end(); ++c)
+  {
+    std::string().swap( c->values[i] );
+    c->present[i] = false;
+    c->types[i]   = eText;
+  }
+  b->slots[i] = RowSlot();
+}
+
+//======================================================================
 DataTable::DataTable(const std::string& table_name,
                      AdminInterfaceImpl * ai)
   : m_table_name( table_name ),
     m_ai( ai ),
     m_appsvc( &(ai->appsvc()) ),
-    m_batchsize(500)
+    m_head_slot(npos),
+    m_tail_slot(npos),
+    m_row_count(0),
+    m_next_row_id(1),
+    m_batchsize(500),
+    m_conflate_ms(0),
+    m_conflate_due(0)
 {
 }
 //----------------------------------------------------------------------
@@ -152,65 +425,75 @@ void DataTable::add_subscriber(const SID& session)
   os << "Session " << session << " subscribing to table " << m_table_name;
   _INFO_(m_appsvc->log(), os.str() );
 
-  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+  TableDescrSerialiser tabledescr( m_table_name );
+  Image image;
 
+  {
+    cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
 
-  // Note: it is important to add the subcriber to the list of subscribers
-  // while he holding the table-lock.  This is so that we can be sure that
-  // when a new subscriber is added to this table, they will first receive a
-  // table-snapshot followed by all table-updates.  We have to ensure that
-  // sequence cannot happen in the reverse order, or that, some updates can go
-  // missing.  If we did the opposite approach, of first (and temporarily)
-  // holding the subscribers-lock before geting the table-lock, there is a
-  // good chance that a new subscriber would receive a table update before the
-  // snapshot!
 
-  {
-    cpp11::lock_guard<cpp11::mutex> subscribersguard( m_subscriberslock );
-    m_subscribers.push_back( session );
-  }
+    // Note: it is important to add the subcriber, as pending, while holding
+    // the table-lock, and in the same hold as the image of the table is
+    // taken.  This is so that we can be sure that when a new subscriber is
+    // added to this table, they will first receive a table-snapshot followed
+    // by all table-updates.  We have to ensure that sequence cannot happen in
+    // the reverse order, or that, some updates can go missing.  Updates
+    // published after the image is taken are held for the pending
+    // subscriber, and sent after its snapshot.  If we did the opposite
+    // approach, of first (and temporarily) holding the subscribers-lock
+    // before geting the table-lock, there is a good chance that a new
+    // subscriber would receive a table update before the snapshot!
 
-  // NOTE: don't need to have this kind of logging yet.  We don't yet have
-  // ability to subscribe/subscribe from individual tables
+    {
+      cpp11::lock_guard<cpp11::mutex> subscribersguard( m_subscriberslock );
+      m_pending.push_back( Pending(session, m_ai->session_format(session)) );
+    }
 
-//  _INFO_(m_appsvc->log(), "Adding " << session << " to table ( " <<
-//         m_table_name << " )");
+    // NOTE: don't need to have this kind of logging yet.  We don't yet have
+    // ability to subscribe/subscribe from individual tables
 
+    //  _INFO_(m_appsvc->log(), "Adding " << session << " to table ( " <<
+    //         m_table_name << " )");
 
-  /* serialise table description */
 
-  // TODO: move to a separate method, and then remove the class?
+    /* serialise table description */
 
-  // first, build a list of all known columns - this includes columns for
-  // which we presently have data, and columns for which we only have meta
-  // information (eg style, command, etc).
+    // TODO: move to a separate method, and then remove the class?
 
-  std::set<std::string> cols;
-  for (std::vector< std::string >::iterator it=m_columns.begin();
-       it != m_columns.end(); ++it) cols.insert(*it);
-  for (std::map<std::string, std::list<sam::txContainer> >::iterator
-         it=m_column_attrs.begin(); it != m_column_attrs.end(); ++it)
-    cols.insert(it->first);
+    // first, build a list of all known columns - this includes columns for
+    // which we presently have data, and columns for which we only have meta
+    // information (eg style, command, etc).
 
+    std::set<std::string> cols;
+    for (std::vector< std::string >::iterator it=m_columns.begin();
+         it != m_columns.end(); ++it) cols.insert(*it);
+    for (std::map<std::string, std::list<sam::txContainer> >::iterator
+           it=m_column_attrs.begin(); it != m_column_attrs.end(); ++it)
+      cols.insert(it->first);
 
-  TableDescrSerialiser tabledescr( m_table_name );
-  for (std::set< std::string >::iterator it=cols.begin();
-       it != cols.end(); ++it)
-  {
-    // try and obtain some attributes for our column
-    std::list<sam::txContainer>* attrs = NULL;
-    std::map<std::string, std::list<sam::txContainer> >::iterator attriter
-      = m_column_attrs.find( *it );
-    if (attriter != m_column_attrs.end()) attrs = &(attriter->second);
 
-    // add column with any attributes is may have
-    tabledescr.add_column( *it, attrs );
+    for (std::set< std::string >::iterator it=cols.begin();
+         it != cols.end(); ++it)
+    {
+      // try and obtain some attributes for our column
+      std::list<sam::txContainer>* attrs = NULL;
+      std::map<std::string, std::list<sam::txContainer> >::iterator attriter
+        = m_column_attrs.find( *it );
+      if (attriter != m_column_attrs.end()) attrs = &(attriter->second);
+
+      // add column with any attributes is may have
+      tabledescr.add_column( *it, attrs );
 
+    }
+
+    _nolock_take_image( image );
+    image.pcmd.share( m_pcmd );
   }
+
   m_ai->send_one(tabledescr.message(), session);
 
-  // serialise table content
-  _nolock_send_snapshopt( session );
+  // serialise table content, without the table-lock
+  send_snapshot( image, std::vector< SID >(1, session) );
 }
 
 //----------------------------------------------------------------------
@@ -221,9 +504,22 @@ void DataTable::del_subscriber(const SID& session)
   std::vector< SID >::iterator iter =
     find(m_subscribers.begin(), m_subscribers.end(), session);
 
-  if (iter != m_subscribers.end())
+  bool found = (iter != m_subscribers.end());
+  if (found) m_subscribers.erase( iter );
+
+  // a session still waiting for its snapshot does not become a subscriber
+  for (std::list< Pending >::iterator it = m_pending.begin();
+       it != m_pending.end(); ++it)
+  {
+    if (it->session == session and not it->cancelled)
+    {
+      it->cancelled = true;
+      found = true;
+    }
+  }
+
+  if (found)
   {
-    m_subscribers.erase( iter );
     std::ostringstream os;
     os << "Session " << session << " unsubscribed from table " << m_table_name;
     _INFO_(m_appsvc->log(), os.str() );
@@ -242,6 +538,10 @@ void DataTable::_nolock_publish_update(std::list<TableEventPtr>& events)
    * table-even-publisher, which will serialise and publish the event to
    * subscribers.*/
 
+  // Messages built here are encoded and discarded before returning, so their
+  // nodes are allocated from an arena reused by each publish.
+  m_msg_arena.reset();
+
   std::list<sam::txMessage> msgs;
 
   // Take a copy of the subscribers list.  This is done so that any recent
@@ -254,44 +554,164 @@ void DataTable::_nolock_publish_update(std::list<TableEventPtr>& events)
   std::vector< SID > subs;
   copy_subscribers(subs);
 
-  if (not subs.empty())
+  // Slow consumers are sent each updated row in full, in its own message,
+  // keyed by table and row.  A keyed message replaces any older one for the
+  // same row still queued for the session, so a consumer which has fallen
+  // behind is sent only the latest state of each row.
+  std::vector< SID > slow;
+  if (not subs.empty()) m_ai->split_slow(subs, slow);
+
+  if (not slow.empty())
   {
+    std::list< sam::txMessage > slow_msgs;
+    std::list< std::string >    slow_keys;  // empty if not keyed
+
     for (std::list<TableEventPtr>::iterator iter = events.begin();
          iter != events.end(); ++iter)
     {
       TableEvent* ev = iter->ev;
+      size_t const before = slow_msgs.size();
 
       if (ev->type == TableEvent::eRowMultiUpdate)
       {
         RowMultiUpdate* rev = dynamic_cast<RowMultiUpdate*>(ev);
-        rev->serialise(msgs);
+        size_t const slot = _nolock_find_row( rev->row_key );
+        if (slot == npos) continue;
+
+        slow_msgs.push_back( sam::txMessage() );
+        slow_msgs.back().arena( &m_msg_arena );
+        UpdateSerialiser full;
+        full.init_msg(slow_msgs.back(), m_table_name, rev->row_key);
+        if (m_content.row(slot).updated)
+        {
+          std::string ts;
+          Clock::row_timestamp(m_content.row(slot).updated, ts);
+          full.add_update(id::row_last, ts);
+        }
+        std::string buf;
+        for (size_t c = 0; c < m_columns.size(); ++c)
+          if (m_content.present(c, slot))
+            full.add_update(m_columns[c], m_content.text(c, slot, buf));
+
+        slow_keys.push_back( m_table_name );
+        slow_keys.back().push_back( '\0' );
+        slow_keys.back() += rev->row_key;
+        continue;
+      }
+      else if (ev->type == TableEvent::eTableCleared)
+        dynamic_cast<TableCleared*>(ev)->serialise(slow_msgs);
+      else if (ev->type == TableEvent::eRowRemoved)
+        dynamic_cast<RowRemoved*>(ev)->serialise(slow_msgs);
+      else if (ev->type == TableEvent::ePCMD)
+        dynamic_cast<PCMDEvent*>(ev)->serialise(slow_msgs);
+
+      slow_keys.resize( slow_keys.size() + slow_msgs.size() - before );
+    }
+
+    std::list< std::string >::const_iterator kit = slow_keys.begin();
+    for (std::list<sam::txMessage>::iterator mit = slow_msgs.begin();
+         mit != slow_msgs.end(); ++mit, ++kit)
+    {
+      OutboundMsg out(*m_appsvc, *mit);
+
+      if (kit->empty())
+        m_ai->send_many(out, slow);
+      else
+        m_ai->send_keyed(out, *kit, slow);
+    }
+  }
+
+  if (not subs.empty() or not m_pending.empty())
+  {
+    // Consecutive row updates are combined into multi-row tableupdate
+    // messages, using the same rows/row_N layout as snapshots.  A batch is
+    // closed when it reaches the batch size, when its estimated encoded size
+    // nears the protocol limit, or when another kind of event intervenes.
+    UpdateSerialiser batch;
+    bool   batch_open = false;
+    size_t batch_size = 0;
+    const size_t batch_max_size = sam::MAX_MSG_LEN / 2;
+
+    for (std::list<TableEventPtr>::iterator iter = events.begin();
+         iter != events.end(); ++iter)
+    {
+      TableEvent* ev = iter->ev;
+
+      if (ev->type == TableEvent::eRowMultiUpdate)
+      {
+        RowMultiUpdate* rev = dynamic_cast<RowMultiUpdate*>(ev);
+        _nolock_format_numbers( rev );
+
+        // worst case estimate, allowing every value byte to be escaped
+        size_t rowsize = rev->row_key.size() + 16;
+        for (std::map<std::string, std::string>::const_iterator it =
+               rev->fields.begin(); it != rev->fields.end(); ++it)
+          rowsize += it->first.size() + 2*it->second.size() + 4;
+
+        if (batch_open
+            and batch.rows() < (size_t) m_batchsize
+            and batch_size + rowsize <= batch_max_size)
+        {
+          batch.add_row(rev->row_key);
+          batch_size += rowsize;
+        }
+        else if (rowsize <= batch_max_size)
+        {
+          msgs.push_back( sam::txMessage() );
+          msgs.back().arena( &m_msg_arena );
+          batch.init_msg(msgs.back(), m_table_name, rev->row_key);
+          batch_open = true;
+          batch_size = rowsize;
+        }
+        else
+        {
+          // too large to share a message; may be split over several
+          rev->serialise(msgs);
+          batch_open = false;
+          continue;
+        }
+
+        for (std::map<std::string, std::string>::const_iterator it =
+               rev->fields.begin(); it != rev->fields.end(); ++it)
+          batch.add_update(it->first, it->second);
       }
       else if (ev->type == TableEvent::eTableCleared)
       {
         TableCleared* rev = dynamic_cast<TableCleared*>(ev);
         rev->serialise(msgs);
+        batch_open = false;
       }
       else if (ev->type == TableEvent::eRowRemoved)
       {
         RowRemoved* rev = dynamic_cast<RowRemoved*>(ev);
         rev->serialise(msgs);
+        batch_open = false;
       }
       else if (ev->type == TableEvent::ePCMD)
       {
         PCMDEvent* rev = dynamic_cast<PCMDEvent*>(ev);
         rev->serialise(msgs);
+        batch_open = false;
       }
       // TODO: need to add a serialiser for NewColumn event
     } // for loop
 
-    // now send to each subscriber
+    // now send to each subscriber.  Each message is encoded just once, and
+    // the encoded bytes are shared by the outbound queues of all subscribers.
+    // (Once for each wire format in use by the subscribers.)  Sessions
+    // waiting for a snapshot are sent the messages after it, so are held
+    // the same encoded bytes.
     for (std::list<sam::txMessage>::iterator mit = msgs.begin();
          mit != msgs.end(); ++mit)
     {
-      for (std::vector<SID>::iterator s = subs.begin();
-           s != subs.end(); ++s)
+      OutboundMsg out(*m_appsvc, *mit);
+      if (not subs.empty()) m_ai->send_many(out, subs);
+
+      for (std::list< Pending >::iterator it = m_pending.begin();
+           it != m_pending.end(); ++it)
       {
-        m_ai->send_one(*mit, *s);
+        SharedBuffer buf;
+        if (not out.encoded(it->format, buf)) it->backlog.push_back( buf );
       }
     }
   }
@@ -309,23 +729,39 @@ void DataTable::update_row(const std::string & rowkey,
   cpp11::lock_guard<cpp11::mutex> guard( m_tablelock ); // lock table
 
   // Does the row_exist? If not, add...
-  if (not _nolock_has_row(rowkey))
-  {
-    _nolock_add_row( rowkey, events );
-  }
+  size_t slot = _nolock_find_row( rowkey );
+  if (slot == npos) slot = _nolock_add_row( rowkey, events );
 
-  for (std::map<std::string, std::string>::const_iterator fit = fields.begin();
-       fit != fields.end(); ++fit)
+  std::vector< size_t > cols;
+  _nolock_field_columns(fields, cols, events);
+
+  _nolock_update_fields( slot, fields, cols, events);
+
+  if ( not events.empty() ) _nolock_publish_update( events );
+}
+//----------------------------------------------------------------------
+void DataTable::update_rows(const AdminInterface::Table& rows,
+                            std::list<TableEventPtr>& events)
+{
+  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock ); // lock table
+
+  std::vector< size_t > cols;
+  for (AdminInterface::Table::const_iterator r = rows.begin();
+       r != rows.end(); ++r)
   {
-    // skip reserved rows - we do not allow these to be updated
-    if (fit->first == id::row_key
-        or fit->first == id::row_last) continue;
+    const std::string & rowkey = r->first;
+    const AdminInterface::Row & fields = r->second;
 
-    add_column_NOLOCK(fit->first, events);
-  }
+    // Does the row_exist? If not, add...
+    size_t slot = _nolock_find_row( rowkey );
+    if (slot == npos) slot = _nolock_add_row( rowkey, events );
 
-  m_rows[ m_row_index[ rowkey ] ].update_fields(fields, events);
+    _nolock_field_columns(fields, cols, events);
 
+    _nolock_update_fields( slot, fields, cols, events);
+  }
+
+  // all row updates are published together
   if ( not events.empty() ) _nolock_publish_update( events );
 }
 //----------------------------------------------------------------------
@@ -344,58 +780,131 @@ void DataTable::add_columns(const std::list<std::string>& cols)
   if ( not events.empty() ) _nolock_publish_update( events );
 }
 //----------------------------------------------------------------------
-void DataTable::add_column_NOLOCK(const std::string & column,
-                                  std::list<TableEventPtr>& events)
+size_t DataTable::add_column_NOLOCK(const std::string & column,
+                                    std::list<TableEventPtr>& events)
 {
   // Are we really adding a new column?
-  bool adding_column = (m_column_index.find(column) == m_column_index.end());
+  std::map<std::string, size_t>::const_iterator existing =
+    m_column_index.find(column);
+  if (existing != m_column_index.end()) return existing->second;
+
+  // TODO: need to add a serialiser for NewColumn
+  events.push_back( new NewColumn( m_table_name, column ));
+  size_t const col = m_columns.size();
+  m_column_index[ column ] = col;
+  m_columns.push_back( column );
+
+  // blocks gain cells for the column when first set in them
+  m_content.add_column();
+  m_dirty_cells.push_back( std::vector< bool >(m_content.slots(), false) );
+
+  // add column to every row - a default value is required, for which the
+  // empty string is used.
+  std::map<std::string, std::string> fields;
+  fields[ column ] = "";
+  std::vector< size_t > cols(1, col);
+
+  for (size_t i = m_head_slot; i != npos; i = m_content.row(i).next)
+  {
+    _nolock_update_fields( i, fields, cols, events );
+  }
+
+  return col;
+}
 
-  if (adding_column)
+//----------------------------------------------------------------------
+void DataTable::_nolock_field_columns(
+  const std::map<std::string, std::string>& fields,
+  std::vector< size_t >& cols,
+  std::list<TableEventPtr>& events)
+{
+  cols.clear();
+  for (std::map<std::string, std::string>::const_iterator fit = fields.begin();
+       fit != fields.end(); ++fit)
   {
-    // TODO: need to add a serialiser for NewColumn
-    events.push_back( new NewColumn( m_table_name, column ));
-    m_columns.push_back( column );
+    // skip reserved rows - we do not allow these to be updated
+    if (fit->first == id::row_key or fit->first == id::row_last)
+      cols.push_back( npos );
+    else
+      cols.push_back( add_column_NOLOCK(fit->first, events) );
+  }
+}
 
-    // rebuild column index
-    m_column_index.clear();
-    for (size_t c = 0; c < m_columns.size(); ++c)
-      m_column_index[ m_columns[c] ] = c;
+//----------------------------------------------------------------------
+size_t DataTable::column_index(const std::string& column)
+{
+  if (column == id::row_key or column == id::row_last)
+    throw std::runtime_error("cannot update reserved column " + column);
 
-    // add column to every row - a default value is required, for which the
-    // empty string is used.
-    std::map<std::string, std::string> fields;
-    fields[ column ] = "";
+  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
 
-    for (std::vector< DataRow >::iterator iter = m_rows.begin();
-         iter != m_rows.end(); ++iter)
-    {
-      iter->update_fields( fields, events );
-    }
+  std::list< TableEventPtr > events;
+  size_t const col = add_column_NOLOCK(column, events);
+  if ( not events.empty() ) _nolock_publish_update( events );
+
+  return col;
+}
+
+//----------------------------------------------------------------------
+template<typename T>
+void DataTable::update_cells(const std::string& rowkey,
+                             size_t& slot, size_t& row_id,
+                             const T* begin, const T* end,
+                             std::list<TableEventPtr>& events)
+{
+  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock ); // lock table
+
+  // The row is usually still in the slot it was last found in.  Otherwise
+  // it was deleted, or the table cleared, and so must be added again.
+  if (slot >= m_content.slots() or m_content.row(slot).id != row_id)
+  {
+    slot = _nolock_find_row( rowkey );
+    if (slot == npos) slot = _nolock_add_row( rowkey, events );
+    row_id = m_content.row(slot).id;
   }
+
+  RowMultiUpdate * eventptr = NULL;
+  bool rowupdated = false;
+
+  for (const T* c = begin; c != end; ++c)
+    rowupdated |= _nolock_set_cell(slot, *c, eventptr);
+
+  if (rowupdated) _nolock_row_updated(slot, eventptr, events);
+
+  if ( not events.empty() ) _nolock_publish_update( events );
 }
 
 //----------------------------------------------------------------------
-const std::string& DataTable::get_row_field(const std::string & rowkey,
-                                            const std::string & column) const
+std::string DataTable::get_row_field(const std::string & rowkey,
+                                     const std::string & column) const
 {
   cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
 
-  std::map< std::string, size_t >::const_iterator iter = m_row_index.find( rowkey );
-  if ( iter == m_row_index.end())
+  size_t const slot = _nolock_find_row( rowkey );
+  if ( slot == npos )
     throw std::out_of_range( "row not found" );
 
-  return m_rows[ iter->second ].get_field( column );
+  std::string value;
+  if ( not _nolock_copy_field( slot, column, value ) )
+    throw std::out_of_range("field not found");
+
+  return value;
 }
 
 //----------------------------------------------------------------------
 std::vector< std::string > DataTable::get_rowkeys() const
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+  Image image;
+  {
+    cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+    _nolock_take_image( image );
+  }
 
-  std::vector< std::string > __rowkeys( m_rows.size() );
+  std::vector< std::string > __rowkeys;
+  __rowkeys.reserve( image.rows );
 
-  for (size_t i = 0; i < m_rows.size(); ++i)
-    __rowkeys[i] = m_rows[i].rowkey();
+  for (size_t i = image.head; i != npos; i = image.content.row(i).next)
+    __rowkeys.push_back( image.content.row(i).rowkey );
 
   return __rowkeys;
 }
@@ -418,7 +927,7 @@ size_t DataTable::get_column_count() const
 size_t DataTable::get_row_count() const
 {
   cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
-  return m_rows.size();
+  return m_row_count;
 }
 
 //----------------------------------------------------------------------
@@ -431,6 +940,13 @@ void DataTable::table_subscribers(std::list< SID >& __list) const
   {
     __list.push_back( *iter );
   }
+
+  // and those about to be, once sent a snapshot
+  for (std::list< Pending >::const_iterator it = m_pending.begin();
+       it != m_pending.end(); ++it)
+  {
+    if (not it->cancelled) __list.push_back( it->session );
+  }
 }
 
 //----------------------------------------------------------------------
@@ -438,22 +954,47 @@ bool DataTable::_nolock_has_row(const std::string& rowkey) const
 {
   return m_row_index.find( rowkey ) != m_row_index.end();
 }
-
-
 //----------------------------------------------------------------------
-void DataTable::_nolock_add_row(const std::string& rowkey,
-                                std::list<TableEventPtr>& events)
+size_t DataTable::_nolock_find_row(const std::string& rowkey) const
 {
-  m_rows.push_back( DataRow( rowkey, m_table_name ) );
+  RowIndex::const_iterator it = m_row_index.find( rowkey );
+  return (it != m_row_index.end())? it->second : npos;
+}
 
-  // rebuild index
-  m_row_index.clear();
-  for (size_t i = 0; i < m_rows.size(); ++i)
+//----------------------------------------------------------------------
+size_t DataTable::_nolock_add_row(const std::string& rowkey,
+                                  std::list<TableEventPtr>& events)
+{
+  // take a slot from the free list, else a new one
+  size_t slot;
+  if (not m_free_slots.empty())
+  {
+    slot = m_free_slots.back();
+    m_free_slots.pop_back();
+  }
+  else
   {
-    m_row_index[ m_rows[i].rowkey() ] = i;
+    slot = m_content.add_slot();
+    m_dirty_slots.push_back( false );
+    for (std::vector< std::vector< bool > >::iterator c =
+           m_dirty_cells.begin(); c != m_dirty_cells.end(); ++c)
+      c->push_back( false );
   }
+  m_content.row_for_write(slot) = RowSlot( rowkey, m_next_row_id++ );
+
+  // link as the newest row
+  m_content.row_for_write(slot).prev = m_tail_slot;
+  if (m_tail_slot != npos)
+    m_content.row_for_write(m_tail_slot).next = slot;
+  else
+    m_head_slot = slot;
+  m_tail_slot = slot;
+
+  m_row_index[ rowkey ] = slot;
+  m_row_count++;
 
   events.push_back( new NewRow( m_table_name, rowkey ));
+  return slot;
 }
 
 //----------------------------------------------------------------------
@@ -463,9 +1004,17 @@ void DataTable::clear_table()
 
   std::list< TableEventPtr > events;
 
-  // clear all our rows
-  m_rows.clear();
+  // clear all our rows; images of the table keep the blocks they share
+  m_content.clear();
+  m_free_slots.clear();
+  m_dirty_slots.clear();
+  for (std::vector< std::vector< bool > >::iterator c = m_dirty_cells.begin();
+       c != m_dirty_cells.end(); ++c) c->clear();
+  m_dirty_rows.clear();
   m_row_index.clear();
+  m_head_slot = npos;
+  m_tail_slot = npos;
+  m_row_count = 0;
 
   // raise an event to indicate this table change
   events.push_back( new TableCleared(m_table_name) );
@@ -480,10 +1029,10 @@ bool DataTable::copy_field(const std::string& rowkey,
 {
   cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
 
-  std::map<std::string, size_t>::const_iterator it = m_row_index.find(rowkey);
-  if (it != m_row_index.end())
+  size_t const slot = _nolock_find_row(rowkey);
+  if (slot != npos)
   {
-    return m_rows[ it->second ].copy_field( field, dest);
+    return _nolock_copy_field( slot, field, dest);
   }
   else
   {
@@ -496,22 +1045,31 @@ void DataTable::delete_row(const std::string & rowkey)
 {
   cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
 
-  std::map<std::string, size_t>::iterator it = m_row_index.find(rowkey);
+  RowIndex::iterator it = m_row_index.find(rowkey);
   if (it != m_row_index.end())
   {
     std::list< TableEventPtr > events;
 
-    size_t const index = it->second;
+    size_t const slot = it->second;
+    size_t const prev = m_content.row(slot).prev;
+    size_t const next = m_content.row(slot).next;
+
+    // unlink from the insertion order
+    if (prev != npos) m_content.row_for_write(prev).next = next;
+    else              m_head_slot = next;
+    if (next != npos) m_content.row_for_write(next).prev = prev;
+    else              m_tail_slot = prev;
 
-    m_rows.erase( m_rows.begin() + index  ); // costly
+    // release the row content, and recycle the slot
+    m_content.clear_slot( slot );
+    for (std::vector< std::vector< bool > >::iterator c =
+           m_dirty_cells.begin(); c != m_dirty_cells.end(); ++c)
+      (*c)[slot] = false;
+    m_dirty_slots[slot] = false;  // any stale entry in m_dirty_rows is skipped
+    m_free_slots.push_back( slot );
 
-    // need to update the indicies
     m_row_index.erase( it );
-    for (std::map< std::string, size_t >::iterator j = m_row_index.begin();
-         j != m_row_index.end(); j++)
-    {
-      if (j->second > index) j->second -= 1;
-    }
+    m_row_count--;
 
     events.push_back( new RowRemoved(m_table_name, rowkey) );
     _nolock_publish_update(events);
@@ -551,35 +1109,44 @@ void DataTable::add_column_attr(const std::string& column,
 //----------------------------------------------------------------------
 void DataTable::copy_table(AdminInterface::Table& dest) const
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
-
-  for (std::vector< DataRow >::const_iterator it = m_rows.begin();
-       it != m_rows.end(); ++it)
+  Image image;
   {
+    cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+    _nolock_take_image( image );
+  }
 
-    it->copy_row(dest[it->rowkey()]);
+  for (size_t i = image.head; i != npos; i = image.content.row(i).next)
+  {
+    copy_row(image.content, image.columns, i,
+             dest[image.content.row(i).rowkey]);
   }
 }
 //----------------------------------------------------------------------
 void DataTable::copy_table(std::vector<std::string> & cols,
                            std::vector< std::vector <std::string> >& rows) const
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+  Image image;
+  {
+    cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+    _nolock_take_image( image );
+  }
 
-  cols = m_columns;
-  for (std::vector< DataRow >::const_iterator it = m_rows.begin();
-       it != m_rows.end(); ++it)
+  cols = image.columns;
+  rows.reserve( rows.size() + image.rows );
+  for (size_t i = image.head; i != npos; i = image.content.row(i).next)
   {
     rows.push_back( std::vector<std::string>());
 
     std::vector <std::string> & values = rows.back();
-    values.reserve( cols.size() );
+    values.resize( cols.size() );
 
-    for (std::vector<std::string>::iterator j = cols.begin();
-         j != cols.end(); ++j)
+    // read straight from the columns; absent cells are left empty
+    for (size_t c = 0; c < cols.size(); ++c)
     {
-      values.push_back( std::string() );
-      it->copy_field( *j, values.back() );
+      if (image.content.present(c, i))
+        values[c] = image.content.text(c, i, values[c]);
+      else if (cols[c] == id::row_key or cols[c] == id::row_last)
+        copy_reserved( image.content.row(i), cols[c], values[c] );
     }
   }
 }
@@ -589,10 +1156,10 @@ void DataTable::copy_row(const std::string& rowkey,
 {
   cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
 
-  std::map<std::string, size_t>::const_iterator it = m_row_index.find(rowkey);
-  if (it != m_row_index.end())
+  size_t const slot = _nolock_find_row(rowkey);
+  if (slot != npos)
   {
-    m_rows[ it->second ].copy_row( dest );
+    copy_row( m_content, m_columns, slot, dest );
   }
 }
 
@@ -611,7 +1178,7 @@ void DataTable::update_meta(const std::string & rowkey,
 
   // TODO: here, I should test that the new meta is different to the old meta,
   // before doing a publish
-  MetaForCol& metaForCol = m_pcmd[ rowkey ];
+  MetaForCol& metaForCol = m_pcmd.map_for_write()[ rowkey ];
   metaForCol[ fieldname ] = meta;
 
   // ensure the meta field name is correct
@@ -629,15 +1196,39 @@ void DataTable::update_meta(const std::string & rowkey,
 void DataTable::snapshot()
 {
   std::vector< SID > subs;
-  copy_subscribers( subs );
-
-  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock ); // lock table
+  Image image;
 
-  for (std::vector<SID>::iterator s = subs.begin();
-       s != subs.end(); ++s)
   {
-    _nolock_send_snapshopt(*s);
+    cpp11::lock_guard<cpp11::mutex> guard( m_tablelock ); // lock table
+
+    // Subscribers are held as pending while the snapshot is encoded, so
+    // that updates published meanwhile are sent after it, as for a new
+    // subscriber.
+    {
+      cpp11::lock_guard<cpp11::mutex> subscribersguard( m_subscriberslock );
+
+      std::vector< SID > others;
+      for (std::vector< SID >::const_iterator iter = m_subscribers.begin();
+           iter != m_subscribers.end(); ++iter)
+      {
+        if ( m_ai->session_exists( *iter ) )
+        {
+          subs.push_back( *iter );
+          m_pending.push_back( Pending(*iter, m_ai->session_format(*iter)) );
+        }
+        else
+          others.push_back( *iter );
+      }
+      m_subscribers.swap( others );
+    }
+
+    if (subs.empty()) return;
+
+    _nolock_take_image( image );
+    image.pcmd.share( m_pcmd );
   }
+
+  send_snapshot( image, subs );
 }
 //----------------------------------------------------------------------
 
@@ -672,99 +1263,123 @@ void DataTable::snapshot()
 // }
 
 //----------------------------------------------------------------------
-void DataTable::_nolock_send_snapshopt(const SID& session)
+void DataTable::send_snapshot(const Image& image,
+                              const std::vector< SID >& sessions)
 {
-  /* NOTE: this method assumes the table-lock is held before entry */
-
-  typedef std::vector< DataRow >::iterator Iter;
-
-  int batchsize = m_batchsize;
-  std::list< sam::txMessage > msgs;
-
-  Iter next = m_rows.begin();
-
-  sam::SAMProtocol protocol(*m_appsvc);
-
-  while (next != m_rows.end())
+  // The snapshot is the same for every session, so encode it once for each
+  // wire format in use, and share the encoded batches across all the
+  // outbound queues of that format.  No table-lock is held, so updates
+  // continue meanwhile, held back for these sessions.
+  std::vector< SID > by_format[2];
+  for (std::vector< SID >::const_iterator s = sessions.begin();
+       s != sessions.end(); ++s)
+    by_format[ m_ai->session_format(*s) ].push_back( *s );
+
+  std::string error;
+  for (int f = sam::eTextFormat; f <= sam::eBinaryFormat; ++f)
   {
-    Iter row = next;
+    if (by_format[f].empty()) continue;
 
-    // start a new batch
-    SnapshotSerialiser serial;
-    serial.set_table_name( m_table_name );
-    for (int i = 0; i < batchsize and row != m_rows.end(); ++i, ++row)
+    std::vector< SharedBuffer > msgs;
+    try
     {
-      const MetaForCol* meta = NULL;
-      PCMD::const_iterator rowpcmd = m_pcmd.find(row->rowkey());
-      if (rowpcmd != m_pcmd.end()) meta = &(rowpcmd->second);
-      serial.add_row(*row, meta);
+      build_snapshot(*m_appsvc, m_table_name, image, (sam::WireFormat) f,
+                     msgs);
+    }
+    catch (const std::exception& e)
+    {
+      // the sessions still subscribe, as before a failed snapshot
+      msgs.clear();
+      error = e.what();
     }
 
-    // check encoding size
-    const static int room_for_snap_fields = 50;
-    if (protocol.check_enc_size(serial.message(), room_for_snap_fields))
+    for (std::vector< SharedBuffer >::iterator i = msgs.begin();
+         i != msgs.end(); ++i)
     {
-      // queue this message
-      msgs.push_back( serial.message() );
-      next = row;
-      //_INFO_(m_appsvc->log(), "Success with batchsize " << batchsize);
+      OutboundMsg out(*m_appsvc, *i, (sam::WireFormat) f);
+      m_ai->send_many(out, by_format[f]);
     }
-    else
+  }
+
+  // now send each the updates held for it, and make it a subscriber.  The
+  // backlogs are taken under the locks but sent without them; a session
+  // still has its updates held meanwhile, so it only becomes a subscriber
+  // once a pass finds nothing more held for it.
+  std::vector< SID > draining( sessions );
+  while (not draining.empty())
+  {
+    std::vector< SID > more;
+    std::vector< std::vector< SharedBuffer > > backlogs;
+    std::vector< sam::WireFormat > formats;
     {
-      if (batchsize == 1)
-      {
-        // Hard error.  We have tried a batchsize of 1, but that failed.
-        // Lets add a warning, and abort this snaphot
+      cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+      cpp11::lock_guard<cpp11::mutex> subscribersguard( m_subscriberslock );
 
-        throw std::runtime_error("failed to encode snapshot");
+      for (std::vector< SID >::const_iterator s = draining.begin();
+           s != draining.end(); ++s)
+      {
+        std::list< Pending >::iterator it = m_pending.begin();
+        while (it != m_pending.end() and it->session != *s) ++it;
+        if (it == m_pending.end()) continue;
+
+        if (it->cancelled or it->backlog.empty())
+        {
+          if (not it->cancelled) m_subscribers.push_back( *s );
+          m_pending.erase( it );
+          continue;
+        }
+
+        more.push_back( *s );
+        formats.push_back( it->format );
+        backlogs.push_back( std::vector< SharedBuffer >() );
+        backlogs.back().swap( it->backlog );
       }
+    }
 
-      int const origbatchsize = batchsize;
-      batchsize = std::max(1, batchsize/2);
-      _INFO_(m_appsvc->log(), "Unable to encode table snapshot using"
-             << " batch-size " << origbatchsize << ". Reducing to "
-             << batchsize << ".");
+    for (size_t i = 0; i < more.size(); ++i)
+    {
+      std::vector< SID > ids(1, more[i]);
+      for (std::vector< SharedBuffer >::iterator b = backlogs[i].begin();
+           b != backlogs[i].end(); ++b)
+      {
+        OutboundMsg out(*m_appsvc, *b, formats[i]);
+        m_ai->send_many(out, ids);
+      }
     }
+    draining.swap( more );
   }
 
-  std::string snapn = utils::to_str(msgs.size());
+  if (not error.empty()) throw std::runtime_error(error);
+}
+//----------------------------------------------------------------------
+void DataTable::_nolock_take_image(Image& image) const
+{
+  /* NOTE: this method assumes the table-lock is held before entry */
 
-  int snapi = 0;
-  for (std::list< sam::txMessage >::iterator i = msgs.begin();
-       i != msgs.end(); ++i)
+  image.content.share( m_content );
+  image.head    = m_head_slot;
+  image.rows    = m_row_count;
+  image.columns = m_columns;
+}
+//----------------------------------------------------------------------
+void DataTable::build_snapshot(AppSvc& appsvc,
+                               const std::string& table_name,
+                               const Image& image,
+                               sam::WireFormat format,
+                               std::vector< SharedBuffer >& msgs)
+{
+  SnapshotEncoder encoder(appsvc, table_name, format);
+
+  // rows are visited in insertion order, by following the slot links
+  for (size_t row = image.head; row != npos;
+       row = image.content.row(row).next)
   {
-    i->root().put_field(id::QN_head_snapi, utils::to_str(snapi++));
-    i->root().put_field(id::QN_head_snapn, snapn);
+    SamBuffer* sb = encoder.begin_row();
+    encode_row(image, row, encoder.protocol(), sb);
+    encoder.end_row();
   }
 
-  // TODO: do I need to catch exceptions thrown from send_one
-  m_ai->send_one(msgs, session);
-
-  m_batchsize = batchsize;
-
-  // // serialise table content
-  // SnapshotSerialiser serial;
-  // serial.set_table_name( m_table_name );
-
-  // for( std::vector< DataRow >::iterator iter=m_rows.begin();
-  //      iter != m_rows.end(); ++iter)
-  // {
-  //   const MetaForCol* meta = NULL;
-
-  //   PCMD::const_iterator rowpcmd = m_pcmd.find(iter->rowkey());
-  //   if (rowpcmd != m_pcmd.end())
-  //   {
-  //     meta = &(rowpcmd->second);
-  //   }
-
-  //   serial.add_row(*iter, meta);
-  // }
-
-  // sam::SAMProtocol protocol;
-  // size_t enclen = protocol.calc_encoded_size( serial.message() );
-
-  // _INFO_(m_appsvc->log(), "enclen " << enclen);
-  // m_ai->send_one(serial.message(), session);
+  encoder.finish(msgs);
 }
 //----------------------------------------------------------------------
 
@@ -785,18 +1400,22 @@ void DataTable::copy_subscribers(std::vector< SID > &subs) const
 
 size_t DataTable::size() const
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock ); // lock table
+  Image image;
+  {
+    cpp11::lock_guard<cpp11::mutex> guard( m_tablelock ); // lock table
+    _nolock_take_image( image );
+  }
 
   size_t s = 0;
 
-  for (std::vector< DataRow >::const_iterator r = m_rows.begin();
-       r != m_rows.end(); ++r)
+  for (size_t slot = image.head; slot != npos;
+       slot = image.content.row(slot).next)
   {
-    DataRow::iterator i = r->begin();
-    DataRow::iterator e = r->end();
-    for (; i != e; ++i)
+    AdminInterface::Row row;
+    copy_row( image.content, image.columns, slot, row );
+    for (AdminInterface::Row::iterator i = row.begin(); i != row.end(); ++i)
     {
-      s += i.name().size() + i.value().size();
+      s += i->first.size() + i->second.size();
     }
 
   }
@@ -807,40 +1426,128 @@ size_t DataTable::size() const
 //----------------------------------------------------------------------
 void DataTable::copy_rowkeys(std::list< std::string >& dest) const
 {
-  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+  Image image;
+  {
+    cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+    _nolock_take_image( image );
+  }
 
-  for (std::vector< DataRow >::const_iterator it = m_rows.begin();
-       it != m_rows.end(); ++it)
+  for (size_t i = image.head; i != npos; i = image.content.row(i).next)
   {
-    dest.push_back(it->rowkey());
+    dest.push_back(image.content.row(i).rowkey);
   }
 }
-//======================================================================
+//----------------------------------------------------------------------
+static uint64_t monotonic_msec()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-DataRow::DataRow(const std::string& rowkey,
-                 const std::string& __table_name)
-  : m_rowkey( rowkey ),
-    m_table_name(__table_name)
+//----------------------------------------------------------------------
+void DataTable::set_conflation(int interval_ms)
 {
-  m_fields[ id::row_key ] = rowkey;
+  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+
+  // publish anything held under the old interval
+  _nolock_flush_conflated();
+
+  m_conflate_ms  = (interval_ms > 0)? interval_ms : 0;
+  m_conflate_due = monotonic_msec() + m_conflate_ms;
 }
 
 //----------------------------------------------------------------------
-DataRow::iterator DataRow::begin() const
+int DataTable::conflation() const
 {
-  return DataRow::iterator( m_fields.begin() );
+  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+  return m_conflate_ms;
 }
 
 //----------------------------------------------------------------------
-DataRow::iterator DataRow::end() const
+int DataTable::flush_conflated()
 {
-  return DataRow::iterator( m_fields.end() );
+  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+
+  if (m_conflate_ms == 0) return 0;
+
+  uint64_t now = monotonic_msec();
+  if (now >= m_conflate_due)
+  {
+    _nolock_flush_conflated();
+
+    // next flush is a whole interval away, rather than catching up on
+    // intervals missed while the flush thread was delayed
+    m_conflate_due = now + m_conflate_ms;
+  }
+
+  return (int)(m_conflate_due - now);
 }
 
+//----------------------------------------------------------------------
+DataTable::UpdateCounts DataTable::update_counts() const
+{
+  cpp11::lock_guard<cpp11::mutex> guard( m_tablelock );
+  return m_counts;
+}
 
 //----------------------------------------------------------------------
-bool DataRow::update_fields(const std::map<std::string, std::string>& fields,
-                            std::list<TableEventPtr>& events)
+void DataTable::_nolock_flush_conflated()
+{
+  if (m_dirty_rows.empty()) return;
+
+  std::list< TableEventPtr > events;
+
+  for (std::vector< size_t >::const_iterator it = m_dirty_rows.begin();
+       it != m_dirty_rows.end(); ++it)
+  {
+    size_t const slot = *it;
+    const RowSlot& rs = m_content.row(slot);
+
+    // skip rows deleted since being made dirty, and repeated entries
+    if (not m_dirty_slots[slot]) continue;
+    m_dirty_slots[slot] = false;
+
+    RowMultiUpdate * eventptr = new RowMultiUpdate( m_table_name, rs.rowkey );
+    events.push_back( eventptr );
+
+    for (size_t c = 0; c < m_dirty_cells.size(); ++c)
+    {
+      if (m_dirty_cells[c][slot])
+      {
+        m_dirty_cells[c][slot] = false;
+        CellType const type = m_content.type(c, slot);
+        if (type == eText)
+        {
+          std::string buf;
+          eventptr->fields[ m_columns[c] ] = m_content.text(c, slot, buf);
+        }
+        else
+        {
+          RowMultiUpdate::Number number;
+          number.column = c;
+          number.type   = type;
+          number.bits   = m_content.number(c, slot).i;
+          eventptr->numbers.push_back( number );
+        }
+      }
+    }
+    Clock::row_timestamp(rs.updated, eventptr->fields[ id::row_last ]);
+
+    m_counts.published++;
+  }
+
+  m_dirty_rows.clear();
+
+  _nolock_publish_update( events );
+}
+
+//----------------------------------------------------------------------
+bool DataTable::_nolock_update_fields(
+  size_t slot,
+  const std::map<std::string, std::string>& fields,
+  const std::vector< size_t >& cols,
+  std::list<TableEventPtr>& events)
 {
   /*
 
@@ -852,103 +1559,254 @@ bool DataRow::update_fields(const std::map<std::string, std::string>& fields,
   RowMultiUpdate * eventptr = NULL;
   bool rowupdated = false;
 
+  // 'cols' gives the column of each field, in order; the reserved fields,
+  // which we do not allow to be updated, have none
+  std::vector< size_t >::const_iterator col = cols.begin();
   for (std::map<std::string, std::string>::const_iterator up = fields.begin();
-       up != fields.end(); ++up)
+       up != fields.end(); ++up, ++col)
   {
-    // skip reserved rows - we do not allow these to be updated
-    if (up->first == id::row_key
-        or up->first == id::row_last) continue;
+    if (*col == npos) continue;
 
-    // Get the existing value.  We will not update the field if the
-    // value is the same
-    Fields::iterator ours = m_fields.find( up->first );
-    if (ours == m_fields.end() or ours->second.value != up->second)
-    {
-      // we have discovered a field change
-      if (ours == m_fields.end())
-      {
-        m_fields[ up->first ] = up->second;
-      }
-      else
-      {
-         ours->second.value = up->second;
-      }
-      if (eventptr == NULL) eventptr = new RowMultiUpdate( m_table_name,
-                                                           m_rowkey );
-      eventptr->fields[ up->first ] = up->second;
-      rowupdated = true;
-    }
+    rowupdated |= _nolock_set_cell(slot, *col, up->second, eventptr);
   }
 
-  if (rowupdated)
+  if (rowupdated) _nolock_row_updated(slot, eventptr, events);
+
+  return rowupdated;
+}
+
+//----------------------------------------------------------------------
+/* Set a cell, returning true if its value changed.  A change is added to the
+ * row's update event, created on the first change, or when conflating, is
+ * only marked dirty, for the next flush. */
+bool DataTable::_nolock_set_cell(size_t slot, size_t col,
+                                 const std::string& value,
+                                 RowMultiUpdate*& eventptr)
+{
+  // Get the existing value.  We will not update the field if the
+  // value is the same
+  std::string buf;
+  if (m_content.present(col, slot) and m_content.type(col, slot) == eText
+      and m_content.text(col, slot, buf) == value)
+    return false;
+
+  // we have discovered a field change
+  m_content.set_text(col, slot, value);
+
+  // when conflating, just remember the change for the next flush
+  if (m_conflate_ms)
   {
-    time_t now = time(NULL);
-    tm parts;
-    localtime_r(&now, &parts);
-    char timeStr[50];
-    memset(timeStr, 0, sizeof(timeStr));
-    snprintf(timeStr,
-             sizeof(timeStr),
-             "%d/%02d/%02d %02d:%02d:%02d",
-             parts.tm_year + 1900,
-             parts.tm_mon + 1,
-             parts.tm_mday,
-             parts.tm_hour,parts.tm_min,parts.tm_sec);
-    timeStr[sizeof(timeStr)-1] = '\0';
-    std::string timestring = timeStr;
+    m_dirty_cells[col][slot] = true;
+    return true;
+  }
 
-    m_fields[ id::row_last ] = timestring;
-    eventptr->fields[ id::row_last ] = timestring;
+  if (eventptr == NULL) eventptr = new RowMultiUpdate(
+    m_table_name, m_content.row(slot).rowkey );
+  eventptr->fields[ m_columns[col] ] = value;
+  drop_number(eventptr, col);
+  return true;
+}
+
+//----------------------------------------------------------------------
+/* Drop a typed value set earlier in the same update, now replaced by text */
+void DataTable::drop_number(RowMultiUpdate* rev, size_t col)
+{
+  std::vector< RowMultiUpdate::Number >& numbers = rev->numbers;
+  for (size_t i = 0; i < numbers.size(); )
+  {
+    if (numbers[i].column == col)
+      numbers.erase( numbers.begin() + i );
+    else
+      ++i;
   }
+}
 
-  if (eventptr) events.push_back( eventptr );
+//----------------------------------------------------------------------
+/* Cells given by column index, from a RowHandle */
+bool DataTable::_nolock_set_cell(size_t slot, const RowHandle::Cell& cell,
+                                 RowMultiUpdate*& eventptr)
+{
+  if (cell.first >= m_columns.size())
+    throw std::out_of_range("column not found");
 
-  return rowupdated;
+  return _nolock_set_cell(slot, cell.first, cell.second, eventptr);
+}
+
+bool DataTable::_nolock_set_cell(size_t slot,
+                                 const RowHandle::TypedCell& cell,
+                                 RowMultiUpdate*& eventptr)
+{
+  if (cell.column >= m_columns.size())
+    throw std::out_of_range("column not found");
+
+  Number n;
+  if (cell.type == RowHandle::TypedCell::eDouble)
+    n.d = cell.value.d;
+  else
+    n.i = cell.value.i;
+
+  return _nolock_set_number(slot, cell.column, (CellType) cell.type, n,
+                            eventptr);
 }
 
 //----------------------------------------------------------------------
-bool DataRow::has_field(const std::string& fn) const
+/* As for a text cell, but the value is held as a number, and compared as
+ * one.  A value changing type is always a change.  Doubles are compared by
+ * representation, so that a NaN is unchanged when set again. */
+bool DataTable::_nolock_set_number(size_t slot, size_t col,
+                                   CellType type, Number value,
+                                   RowMultiUpdate*& eventptr)
 {
-  return m_fields.find( fn ) != m_fields.end();
+  if (m_content.present(col, slot) and m_content.type(col, slot) == type
+      and m_content.number(col, slot).i == value.i) return false;
+
+  m_content.set_number(col, slot, type, value);
+
+  if (m_conflate_ms)
+  {
+    m_dirty_cells[col][slot] = true;
+    return true;
+  }
+
+  // formatted only if the update is sent; see _nolock_format_numbers
+  if (eventptr == NULL) eventptr = new RowMultiUpdate(
+    m_table_name, m_content.row(slot).rowkey );
+  RowMultiUpdate::Number number;
+  number.column = col;
+  number.type   = type;
+  number.bits   = value.i;
+  eventptr->numbers.push_back( number );
+  return true;
 }
 
 //----------------------------------------------------------------------
-const std::string& DataRow::get_field(const std::string& fn) const
+/* Format the typed cells of a row update into its fields, for sending */
+void DataTable::_nolock_format_numbers(RowMultiUpdate* rev) const
 {
-  Fields::const_iterator iter = m_fields.find( fn );
+  char text[32];
+  for (std::vector< RowMultiUpdate::Number >::const_iterator it =
+         rev->numbers.begin(); it != rev->numbers.end(); ++it)
+  {
+    Number n;
+    n.i = it->bits;
+    size_t len = format_number((CellType) it->type, n, text);
+    rev->fields[ m_columns[it->column] ].assign(text, len);
+  }
+  rev->numbers.clear();
+}
 
-  if (iter == m_fields.end()) throw std::out_of_range("field not found");
+//----------------------------------------------------------------------
+/* Timestamp a row which has had cells changed, and either queue its update
+ * event, or when conflating, add it to the dirty rows */
+void DataTable::_nolock_row_updated(size_t slot, RowMultiUpdate* eventptr,
+                                    std::list<TableEventPtr>& events)
+{
+  time_t now = Clock::now();
+  m_content.row_for_write(slot).updated = now;
+  m_counts.received++;
 
-  return iter->second.value;
+  if (eventptr)
+  {
+    Clock::row_timestamp(now, eventptr->fields[ id::row_last ]);
+    events.push_back( eventptr );
+    m_counts.published++;
+  }
+  else if (not m_dirty_slots[slot])
+  {
+    m_dirty_slots[slot] = true;
+    m_dirty_rows.push_back( slot );
+  }
 }
 
 //----------------------------------------------------------------------
-bool DataRow::copy_field(const std::string& fn, std::string& dest) const
+bool DataTable::_nolock_copy_field(size_t slot,
+                                   const std::string& fn,
+                                   std::string& dest) const
 {
-  Fields::const_iterator iter = m_fields.find( fn );
+  if (fn == id::row_key or fn == id::row_last)
+    return copy_reserved(m_content.row(slot), fn, dest);
+
+  std::map<std::string, size_t>::const_iterator col = m_column_index.find(fn);
+  if (col == m_column_index.end()) return false;
 
-  if (iter == m_fields.end()) return false;
+  if (not m_content.present(col->second, slot)) return false;
+
+  std::string buf;
+  const std::string& value = m_content.text(col->second, slot, buf);
 
   // check before copy, to try to save allocation of memory etc.
-  if (dest != iter->second.value) dest = iter->second.value;
+  if (dest != value) dest = value;
+
+  return true;
+}
+
+//----------------------------------------------------------------------
+/* Copy a RowKey or RowLastUpdated field, returning false if the row has no
+ * value for it */
+bool DataTable::copy_reserved(const RowSlot& rs, const std::string& fn,
+                              std::string& dest)
+{
+  if (fn == id::row_key)
+  {
+    dest = rs.rowkey;
+    return true;
+  }
 
+  if (rs.updated == 0) return false;
+  Clock::row_timestamp(rs.updated, dest);
   return true;
 }
+
 //----------------------------------------------------------------------
-void DataRow::clear()
+void DataTable::copy_row(const Content& content,
+                         const std::vector< std::string >& columns,
+                         size_t slot, AdminInterface::Row& dest)
 {
-  m_fields.clear();
+  const RowSlot& rs = content.row(slot);
+  dest[ id::row_key ] = rs.rowkey;
+
+  if (rs.updated)
+    Clock::row_timestamp(rs.updated, dest[ id::row_last ]);
+
+  std::string buf;
+  for (size_t c = 0; c < columns.size(); ++c)
+  {
+    if (content.present(c, slot))
+      dest.insert( std::make_pair(columns[c],
+                                  content.text(c, slot, buf)) );
+  }
 }
 
 //----------------------------------------------------------------------
-void DataRow::copy_row(AdminInterface::Row& dest) const
+void DataTable::encode_row(const Image& image, size_t slot,
+                           sam::SAMProtocol& protocol,
+                           SamBuffer* sb)
 {
-  for (Fields::const_iterator it = m_fields.begin();
-       it != m_fields.end(); ++it)
+  const RowSlot& rs = image.content.row(slot);
+  protocol.encode_field(sb, id::row_key, rs.rowkey);
+
+  std::string buf;
+  if (rs.updated)
+  {
+    Clock::row_timestamp(rs.updated, buf);
+    protocol.encode_field(sb, id::row_last, buf);
+  }
+
+  for (size_t c = 0; c < image.columns.size(); ++c)
+  {
+    if (image.content.present(c, slot))
+      protocol.encode_field(sb, image.columns[c],
+                            image.content.text(c, slot, buf));
+  }
+
+  // per cell meta data
+  const PCMD& pcmd = image.pcmd.map();
+  PCMD::const_iterator rowpcmd = pcmd.find(rs.rowkey);
+  if (rowpcmd != pcmd.end())
   {
-    // TODO: use an insert hint here, to improve performance.  Should I use
-    // back() or end()? Maybe to a comparison?
-    dest.insert( std::make_pair(it->first, it->second.value) );
+    for (MetaForCol::const_iterator m = rowpcmd->second.begin();
+         m != rowpcmd->second.end(); ++m)
+      protocol.encode_child(sb, m->second);
   }
 }
 
@@ -1001,4 +1859,131 @@ TableDescrSerialiser::TableDescrSerialiser(const std::string& table_name)
 }
 
 
+//======================================================================
+static void check_handle(const DataTable* table)
+{
+  if (table == NULL) throw std::runtime_error("invalid table handle");
+}
+
+//----------------------------------------------------------------------
+const std::string& TableHandle::table_name() const
+{
+  check_handle(m_table);
+  return m_table->table_name();
+}
+
+//----------------------------------------------------------------------
+size_t TableHandle::column(const std::string& name)
+{
+  check_handle(m_table);
+  return m_table->column_index(name);
+}
+
+//----------------------------------------------------------------------
+RowHandle TableHandle::row(const std::string& rowkey)
+{
+  check_handle(m_table);
+  return RowHandle(m_table, rowkey);
+}
+
+//----------------------------------------------------------------------
+void TableHandle::update(const std::string& rowkey,
+                         const std::map<std::string, std::string>& fields)
+{
+  check_handle(m_table);
+  std::list< TableEventPtr > events;
+  m_table->update_row(rowkey, fields, events);
+}
+
+//----------------------------------------------------------------------
+RowHandle::RowHandle()
+  : m_table(NULL),
+    m_slot(0),
+    m_row_id(0)
+{
+}
+
+//----------------------------------------------------------------------
+RowHandle::RowHandle(DataTable* table, const std::string& rowkey)
+  : m_table(table),
+    m_rowkey(rowkey),
+    m_slot(0),
+    m_row_id(0)  // never a row id, so the row is found on first update
+{
+}
+
+//----------------------------------------------------------------------
+template<typename T>
+void RowHandle::update_cells(const T* begin, const T* end)
+{
+  check_handle(m_table);
+  if (begin == end) return;
+  std::list< TableEventPtr > events;
+  m_table->update_cells(m_rowkey, m_slot, m_row_id, begin, end, events);
+}
+
+//----------------------------------------------------------------------
+void RowHandle::update(size_t column, const std::string& value)
+{
+  Cell cell(column, value);
+  update_cells(&cell, &cell + 1);
+}
+
+void RowHandle::update_int64(size_t column, int64_t value)
+{
+  TypedCell cell = TypedCell::int64(column, value);
+  update_cells(&cell, &cell + 1);
+}
+
+void RowHandle::update_double(size_t column, double value)
+{
+  TypedCell cell = TypedCell::real(column, value);
+  update_cells(&cell, &cell + 1);
+}
+
+void RowHandle::update_bool(size_t column, bool value)
+{
+  TypedCell cell = TypedCell::boolean(column, value);
+  update_cells(&cell, &cell + 1);
+}
+
+//----------------------------------------------------------------------
+void RowHandle::update(const std::vector< Cell >& cells)
+{
+  if (not cells.empty()) update_cells(&cells[0], &cells[0] + cells.size());
+}
+
+void RowHandle::update(const std::vector< TypedCell >& cells)
+{
+  if (not cells.empty()) update_cells(&cells[0], &cells[0] + cells.size());
+}
+
+//----------------------------------------------------------------------
+RowHandle::TypedCell RowHandle::TypedCell::int64(size_t column, int64_t v)
+{
+  TypedCell cell;
+  cell.column  = column;
+  cell.type    = eInt64;
+  cell.value.i = v;
+  return cell;
+}
+
+RowHandle::TypedCell RowHandle::TypedCell::real(size_t column, double v)
+{
+  TypedCell cell;
+  cell.column  = column;
+  cell.type    = eDouble;
+  cell.value.d = v;
+  return cell;
+}
+
+RowHandle::TypedCell RowHandle::TypedCell::boolean(size_t column, bool v)
+{
+  TypedCell cell;
+  cell.column  = column;
+  cell.type    = eBool;
+  cell.value.i = v? 1 : 0;
+  return cell;
+}
+
 } // exio
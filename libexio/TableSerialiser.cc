@@ -19,6 +19,7 @@
 */
 #include "exio/TableSerialiser.h"
 #include "exio/MsgIDs.h"
+#include "exio/utils.h"
 
 namespace exio {
 
@@ -36,7 +37,9 @@ TableEventSerialiser::set_table_name(const std::string& __table_name)
 
 //----------------------------------------------------------------------
 UpdateSerialiser::UpdateSerialiser()
-  : m_row( NULL )
+  : m_body( NULL ),
+    m_row( NULL ),
+    m_rows( 0 )
 {
 }
 
@@ -54,7 +57,20 @@ void UpdateSerialiser::init_msg(sam::txMessage& m,
   body.put_field(id::rows, "1");
 
   // get handle to the container for the row data
-  m_row = &( body.put_child( id::row_prefix + "0") );
+  m_body = &body;
+  m_rows = 1;
+  m_row  = &( body.put_child( id::row_prefix + "0") );
+  m_row->put_field(id::row_key, row_key);
+}
+
+//----------------------------------------------------------------------
+void UpdateSerialiser::add_row(const std::string& row_key)
+{
+  std::string rowname = id::row_prefix + utils::to_str(m_rows);
+
+  m_body->put_field(id::rows, utils::to_str(++m_rows));
+
+  m_row = &( m_body->put_child( rowname ) );
   m_row->put_field(id::row_key, row_key);
 }
 
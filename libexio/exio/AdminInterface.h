@@ -23,6 +23,8 @@
 #include "exio/AdminCommand.h"
 #include "exio/AppSvc.h"
 
+#include <stdint.h>
+
 namespace exio
 {
 
@@ -30,6 +32,7 @@ class AdminInterfaceImpl;
 class AdminInterface;
 class AdminSession;
 class AdminSessionListener;
+class DataTable;
 
 /* Commonly used alert severity codes - note, leading two digits are the Alert
  * Severity Rating (ASR) */
@@ -43,6 +46,100 @@ static std::string const SEV_DEBUG    = "10-debug";
 
 const char* version_string();
 
+/* A row of a monitoring table, obtained from TableHandle::row.  Cells are
+ * given by column index, from TableHandle::column, so an update looks up
+ * neither the table, the row nor the columns by name.  The handle remembers
+ * where the row is held, and only finds it again by rowkey if the row has
+ * since been deleted, or the table cleared; an update creates the row if
+ * required.  A handle must not be used by more than one thread at a time.
+ *
+ * Cells can also be set from numbers, which the table holds as numbers: a
+ * change is detected by comparing numbers, and a value is formatted as text
+ * only when it is published or copied out. */
+class RowHandle
+{
+  public:
+    typedef std::pair<size_t, std::string> Cell;  // column index, value
+
+    /* A cell set from a number, for updating several cells together */
+    struct TypedCell
+    {
+        enum Type { eInt64 = 1, eDouble, eBool };
+
+        size_t column;
+        Type   type;
+        union
+        {
+            int64_t i;  // also a bool, as 0 or 1
+            double  d;
+        } value;
+
+        static TypedCell int64(size_t column, int64_t);
+        static TypedCell real(size_t column, double);
+        static TypedCell boolean(size_t column, bool);
+    };
+
+    RowHandle();
+
+    const std::string& rowkey() const { return m_rowkey; }
+
+    /* Update one cell.  Typed setters have their own names, since a string
+     * literal would otherwise convert to bool. */
+    void update(size_t column, const std::string& value);
+    void update_int64(size_t column, int64_t value);
+    void update_double(size_t column, double value);
+    void update_bool(size_t column, bool value);
+
+    /* Update several cells, which are published as a single row update */
+    void update(const std::vector< Cell >& cells);
+    void update(const std::vector< TypedCell >& cells);
+
+  private:
+    friend class TableHandle;
+    RowHandle(DataTable*, const std::string& rowkey);
+
+    template<typename T> void update_cells(const T* begin, const T* end);
+
+    DataTable * m_table;
+    std::string m_rowkey;
+    size_t m_slot;    // where the row was last found
+    size_t m_row_id;  // identifies the row held in that slot
+};
+
+/* A monitoring table, obtained from AdminInterface::table.  A handle can be
+ * kept, and used in place of the table name, so that updates do not have to
+ * find the table, nor take the lock protecting the collection of tables.
+ * Tables are never removed, so handles remain valid for the life of the
+ * AdminInterface. */
+class TableHandle
+{
+  public:
+    TableHandle() : m_table(NULL) {}
+
+    bool valid() const { return m_table != NULL; }
+
+    const std::string& table_name() const;
+
+    /* Index of a column, adding the column if new.  Column indexes do not
+     * change for the life of the table.  Throws for the reserved RowKey and
+     * RowLastUpdated columns, which cannot be updated. */
+    size_t column(const std::string& name);
+
+    RowHandle row(const std::string& rowkey);
+
+    /* As AdminInterface::monitor_update, for this table.  A convenience:
+     * only the table lookup is saved, as the row and the columns are still
+     * found by name.  Repeated updates should use a RowHandle. */
+    void update(const std::string& rowkey,
+                const std::map<std::string, std::string>& fields);
+
+  private:
+    friend class AdminInterface;
+    explicit TableHandle(DataTable* table) : m_table(table) {}
+
+    DataTable * m_table;
+};
+
 class AdminInterface
 {
   public:
@@ -115,6 +212,17 @@ class AdminInterface
     void add_columns(const std::string& tablename,
                      const std::list<std::string>&);
 
+    /* Conflate updates to a table: rather than publishing each update as it
+     * occurs, changed rows are published at most once per interval, with
+     * their latest values.  Zero, the default, disables conflation. */
+    void table_conflation(const std::string& tablename, int interval_ms);
+
+    /* Counts of the row updates which changed a table, and of the row
+     * updates it has published; fewer are published when conflating.
+     * Returns false if there is no such table. */
+    bool table_update_counts(const std::string& tablename,
+                             uint64_t& received,
+                             uint64_t& published) const;
 
     void clear_table(const std::string& tablename);
 
@@ -128,6 +236,15 @@ class AdminInterface
                         const std::string& rowkey,
                         const std::map<std::string, std::string>& fields);
 
+    /* Get a handle for updating a table, creating the table if required */
+    TableHandle table(const std::string& tablename);
+
+    /* Update many rows of a table together.  The rows are applied under a
+     * single table lock, in rowkey order, and are published to subscribers
+     * as multi-row table updates, rather than as one message per row. */
+    void monitor_update_batch(const std::string& tablename,
+                              const AdminInterface::Table& rows);
+
     void monitor_update_meta(const std::string& table_name,
                              const std::string& rowkey,
                              const std::string& column,
@@ -80,6 +80,9 @@ class AdminInterfaceImpl : public AdminSessionListener
     bool session_exists(const SID& id) const;
     bool session_open(const SID& id) const;
 
+    /* Wire format of a session; text if it is not found */
+    sam::WireFormat session_format(const SID&) const;
+
     void session_list(std::list< SID > &) const;
 
     void session_info(SID, sid_desc&, bool& found) const;
@@ -99,6 +102,17 @@ class AdminInterfaceImpl : public AdminSessionListener
                   const SID&);
     void send_one(const std::list<sam::txMessage>&,
                   const SID&);
+    void send_many(OutboundMsg&,
+                   const std::vector<SID>&);
+
+    /* Send under a conflation key, see AdminSession::enqueueToSend */
+    void send_keyed(OutboundMsg&,
+                    const std::string& key,
+                    const std::vector<SID>&);
+
+    /* Move slow consumers out of 'ids' and into 'slow' */
+    void split_slow(std::vector<SID>& ids, std::vector<SID>& slow) const;
+
     void send_all(const sam::txMessage& msg);
 
 
@@ -144,6 +158,12 @@ class AdminInterfaceImpl : public AdminSessionListener
     void add_columns(const std::string& tablename,
                      const std::list<std::string>&);
 
+    void table_conflation(const std::string& tablename, int interval_ms);
+
+    bool table_update_counts(const std::string& tablename,
+                             uint64_t& received,
+                             uint64_t& published) const;
+
     void clear_table(const std::string& tablename);
 
     void delete_row(const std::string& tablename,
@@ -156,6 +176,11 @@ class AdminInterfaceImpl : public AdminSessionListener
                         const std::string& rowkey,
                         const std::map<std::string, std::string>& fields);
 
+    void monitor_update_batch(const std::string& table_name,
+                              const AdminInterface::Table& rows);
+
+    DataTable* monitor_table(const std::string& table_name);
+
     void monitor_update_meta(const std::string& table_name,
                              const std::string& rowkey,
                              const std::string& column,
@@ -200,6 +225,11 @@ class AdminInterfaceImpl : public AdminSessionListener
                                      const std::string&);
 
     void init_session_io(AdminSession*);
+    Reactor* select_reactor();
+
+    /* Encode a message, before it is sent, in the formats of the sessions
+     * it is for */
+    void encode_for(OutboundMsg&, const std::vector<SID>&);
 
 
   private:
@@ -245,7 +275,13 @@ class AdminInterfaceImpl : public AdminSessionListener
     mutable cpp11::mutex m_create_session_lock;
 
     AdminInterface * m_ai;
-    Reactor * m_reactor;
+
+    struct
+    {
+        std::vector<Reactor*> items;
+        size_t next;  // round-robin start, to share out equally loaded
+        cpp11::mutex lock;
+    } m_reactors;
 };
 
 } // namespace exio
@@ -39,6 +39,14 @@ namespace exio
 
 class AdminInterface;
 class AppSvc;
+class OutboundMsg;
+class SharedBuffer;
+
+/* Outbound bytes pending, above which a session is considered a slow
+ * consumer.  Table updates to a slow consumer are sent as complete rows,
+ * keyed by table and row, so that a newer update replaces an older one
+ * still queued; see Client::queue. */
+#define EXIO_SESSION_SLOW_BYTES (1024*1024)
 
 
 /* Warning: the callback methods will be invoked by the AdminSession's socket
@@ -72,6 +80,29 @@ class AdminSession : public ClientCallback
     /* Error code indicates success.  Zero/false means no error.  Other
      * returns value indicates encoding or IO problem. */
     bool enqueueToSend(const sam::txMessage&);
+    bool enqueueToSend(const SharedBuffer&);
+
+    /* Queue under a conflation key; replaces any message with the same key
+     * that has not yet been written */
+    bool enqueueToSend(const SharedBuffer&, const std::string& key);
+
+    /* Queue a message shared with other sessions, in this session's wire
+     * format, optionally under a conflation key */
+    bool enqueueToSend(OutboundMsg&);
+    bool enqueueToSend(OutboundMsg&, const std::string& key);
+
+    /* Whether outbound data is backing up */
+    bool is_slow() const { return bytes_pend() > EXIO_SESSION_SLOW_BYTES; }
+
+    /* Encode a message once, so that it can be queued to many sessions
+     * without being encoded again.  Returns true on failure. */
+    static bool encode(AppSvc&, const sam::txMessage&, SharedBuffer&,
+                       sam::WireFormat = sam::eTextFormat);
+
+    /* Format of messages sent to the peer; text unless the peer asked for
+     * binary in its logon */
+    void wire_format(sam::WireFormat);
+    sam::WireFormat wire_format() const;
 
     /* Request session to close */
     void close();
@@ -104,15 +135,22 @@ class AdminSession : public ClientCallback
     uint64_t bytes_out()  const;
     uint64_t bytes_in()   const;
     uint64_t bytes_pend() const;
+    uint64_t msgs_out()   const;
+    uint64_t writes_out() const;
+    uint64_t msgs_replaced() const;
 
   protected:
     virtual size_t process_input(Client*, const char*, int);
+    virtual size_t input_needed(Client*);
     virtual void   process_close(Client*);
 
   private:
 
     void notify_of_close();
 
+    bool enqueue(const SharedBuffer&, const std::string* key);
+    bool send_names(size_t required);
+
   private:
     AdminSession(const AdminSession &);  // no copy
     AdminSession & operator=(const AdminSession &); // no assignment
@@ -141,9 +179,14 @@ class AdminSession : public ClientCallback
     time_t    m_start;
 
     sam::SAMProtocol m_samp;
+    sam::txView      m_view;  // reused for each inbound message
 
     Client*  m_io_handle;
 
+    /* State used by the threads queueing to the session; kept out of this
+     * header, which is installed, as are its types */
+    struct Impl;
+    Impl* m_impl;
 };
 
   std::ostream & operator<<(std::ostream&, const SID & id);
@@ -29,10 +29,31 @@ namespace exio
 
 struct Config
 {
+    // I/O event notification mechanism used by the reactor.  ePoll is the
+    // portable fallback; eEpoll keeps a persistent kernel interest set.
+    enum Poller { ePoll = 0, eEpoll };
+
+    Config()
+      : server_port(0),
+        poller(eEpoll),
+        reactors(1),
+        reactor_workers(2)
+    {
+    }
+
     std::string serviceid;
 
-    // Port to listen, or EXIO_NO_SERVER to disable server socket
+    // Port to listen, or EXIO_NO_SERVER to disable server socket.  Zero, the
+    // default, as for a value-initialised Config before it had a constructor,
+    // listens on a port chosen by the system.
     int server_port;
+
+    Poller poller;
+
+    // Number of I/O reactors that sessions are shared across, and the number
+    // of worker threads owned by each reactor.
+    int reactors;
+    int reactor_workers;
 };
 
 
@@ -22,6 +22,8 @@
 
 
 #include "exio/ReactorReadBuffer.h"
+#include "exio/ReactorRingBuffer.h"
+#include "exio/SharedBuffer.h"
 
 #include "thread.h"
 #include "mutex.h"
@@ -31,6 +33,8 @@
 #include <queue>
 #include <deque>
 #include <list>
+#include <map>
+#include <string>
 
 #include <stdint.h>
 
@@ -41,7 +45,7 @@ namespace exio {
   class Reactor;
   class RawMsg;
 
-#define EXIO_CLIENT_CHUNK_SIZE 1024  // TODO: move to using dynamic memory
+#define EXIO_CLIENT_RING_SIZE 16384  // per-client inbound ring
 
 
 class ReactorClient
@@ -59,6 +63,8 @@ class ReactorClient
 
     virtual void handle_close() = 0;
 
+    /* Poll events wanted, POLLIN, POLLOUT and POLLRDHUP. Errors and hangups
+     * are always reported. */
     virtual int  events() = 0;
     virtual bool has_work() = 0;
 
@@ -73,6 +79,10 @@ class ReactorClient
     time_t  last_write() const { return m_last_write; }
     time_t  last_read()  const { return m_last_read; }
 
+    /* Messages fully written, and the write syscalls used to write them */
+    uint64_t msgs_out()   const { return m_msgs_out; }
+    uint64_t writes_out() const { return m_writes_out; }
+
     void update_run_state_for_worker(char& oldstate, char& newstate);
     void update_run_state_for_reactor(char& oldstate, char& newstate);
     void set_run_state();
@@ -108,6 +118,8 @@ class ReactorClient
 
     uint64_t m_bytes_out;
     uint64_t m_bytes_in;
+    uint64_t m_msgs_out;
+    uint64_t m_writes_out;
     time_t   m_last_write;
     time_t   m_last_read;
 
@@ -120,8 +132,16 @@ class ReactorClient
     char m_runstate;
     cpp11::mutex m_runstate_mutex;
 
+    // Events currently registered with the reactor poller. Only accessed by
+    // the reactor thread.
+    int m_poll_events;
+
+    // Set while the client is on the reactor's dirty list, so that it is
+    // listed at most once between reactor wakeups.
+    cpp11::atomic<bool> m_dirty;
 
     friend class Reactor;
+    friend class EpollPoller;
 };
 
 
@@ -142,8 +162,24 @@ class Client : public ReactorClient
     /* Queue data to send  / close socket */
     int queue(const char*, size_t, bool request_close = false);
 
+    /* Queue a shared buffer to send; the bytes are referenced, not copied.
+     * The full size is still charged to this client's pending limit, since a
+     * slow consumer keeps the shared memory alive for as long as it is
+     * queued. */
+    int queue(const SharedBuffer&, bool request_close = false);
+
+    /* Queue a shared buffer under a key.  If a message with the same key is
+     * still waiting to be written, it is removed, and the new message is
+     * added at the back of the queue, so a slow consumer holds at most one
+     * message per key.  A keyed message must therefore carry the complete
+     * state for its key, rather than a change to an earlier message. */
+    int queue(const SharedBuffer&, const std::string& key);
+
     size_t pending_out() const;
 
+    /* Keyed messages removed from the queue, unsent, by a later message */
+    uint64_t msgs_replaced() const;
+
     // TODO: add pending_in() method.  Little more tricky, because pending
     // bytes are on both the queue and the memory buffer, so, need to ready
     // from two locations.
@@ -158,7 +194,8 @@ class Client : public ReactorClient
     Client(const Client&); // no copy
     Client& operator=(const Client&); // no assignment
 
-    int  process_inbound_bytes(ReactorReadBuffer&);
+    size_t deliver_input(const char*, size_t);
+    void   consume_input(size_t);
 
 
     /* Reactor callbacks */
@@ -174,29 +211,23 @@ class Client : public ReactorClient
 
     void shutdown_outq();
 
+    int enqueue(const char*, size_t, const SharedBuffer*,
+                const std::string* key, bool request_close);
+
     LogService* m_logsvc;
 
 
     bool m_log_io_events;
 
-    struct DataChunk
-    {
-        char   buf[EXIO_CLIENT_CHUNK_SIZE];
-        size_t size;
-        size_t start;
+    /* Inbound bytes.  The reactor thread reads into the ring and the worker
+     * decodes from it in place.  A message which straddles the ring end, or
+     * is larger than the ring, is assembled instead in m_buf. */
+    ReactorRingBuffer      m_ring;
+    cpp11::atomic<size_t>  m_in_seen;     // ring write_count seen by worker
+    cpp11::atomic<bool>    m_in_blocked;  // reactor dropped POLLIN, ring full
 
-        DataChunk() : size(0), start(0) {}
-    };
-
-    struct DataFifo
-    {
-        cpp11::mutex              mutex;
-        std::list < DataChunk >   items;   // TODO: deque better?
-        size_t                    itemcount;
-        cpp11::condition_variable cond;
-        size_t                    pending;  // total data size in queue
-        DataFifo();
-    } m_datafifo;
+    enum InState { eInOpen = 0, eInClosed, eInCloseDone };
+    cpp11::atomic<int>     m_in_state;
 
     struct OutboundQueue
     {
@@ -205,6 +236,12 @@ class Client : public ReactorClient
         size_t               itemcount;
         bool                 acceptmore;
         size_t               pending;  // total data size in queue
+
+        /* Queued messages that have a key.  A message being written is
+         * marked busy, and cannot be replaced. */
+        typedef std::map< std::string, std::list<RawMsg>::iterator > KeyIndex;
+        KeyIndex             keyed;
+        uint64_t             replaced;
         OutboundQueue();
     } m_out_q;
 
@@ -213,7 +250,8 @@ class Client : public ReactorClient
     ClientCallback *       m_cb; // null => callbacks not allowed
 
     size_t m_out_pend_max;
-    ReactorReadBuffer m_buf;
+    ReactorReadBuffer m_buf;  // linear overflow for m_ring
+    size_t m_in_need;  // length of partial message awaited, 0 if unknown
 
   protected:
 
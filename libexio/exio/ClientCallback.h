@@ -32,6 +32,12 @@ class ClientCallback
     /** Data has arrived on the the underlying IO session */
     virtual size_t process_input(Client*, const char*, int) = 0;
 
+    /** Length of the message at the start of the input not consumed by the
+     * last process_input, if known, else 0.  The IO session then waits for
+     * that many bytes before calling process_input again, and can size its
+     * buffer for the message once. */
+    virtual size_t input_needed(Client*) { return 0; }
+
     /** Underlying IO session has closed */
     virtual void   process_close(Client*) = 0;
 };
@@ -0,0 +1,40 @@
+#ifndef EXIO_CLOCK_H
+#define EXIO_CLOCK_H
+
+#include "exio/SharedBuffer.h"
+
+#include <string>
+
+#include <time.h>
+
+namespace exio {
+
+/*
+ * Coarse clock, of whole seconds, shared by everything which only needs the
+ * time to the second: the RowLastUpdated field of table rows, the last read
+ * and write times of clients, and session and reactor housekeeping.  The
+ * time is read from the kernel's coarse clock, where available, which is
+ * cheaper than time().  The RowLastUpdated text of the latest second is
+ * formatted once, and then shared, immutable, by all callers until the
+ * second changes; copying it to a string uses a per-thread copy, without
+ * locking.  All methods may be called from any thread.
+ */
+class Clock
+{
+  public:
+    /* Current time, in seconds */
+    static time_t now();
+
+    /* RowLastUpdated text of a time, in the format "%d/%02d/%02d
+     * %02d:%02d:%02d".  Text for the latest second is taken from the cache;
+     * other times are formatted on each call. */
+    static SharedBuffer row_timestamp(time_t);
+    static void row_timestamp(time_t, std::string& dest);
+
+  private:
+    Clock();  // no instances
+};
+
+} // namespace exio
+
+#endif
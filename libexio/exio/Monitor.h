@@ -25,8 +25,13 @@
 #include <map>
 #include <string>
 #include <list>
+#include <vector>
 
 #include "mutex.h"
+#include "atomic.h"
+#include "thread.h"
+
+#include <stdint.h>
 
 
 
@@ -86,7 +91,10 @@ class Monitor
 
     void update_table(const std::string & table_name,
                       const std::string & row_key,
-                      std::map<std::string, std::string> fields);
+                      const std::map<std::string, std::string>& fields);
+
+    void update_table_batch(const std::string & table_name,
+                            const AdminInterface::Table& rows);
 
     void update_meta(const std::string & table_name,
                      const std::string & row_key,
@@ -95,6 +103,10 @@ class Monitor
 
     void clear_all_tables();
 
+    /* Get a table, creating it if required.  Tables are never removed, so
+     * the table can be used after the tables-lock is released. */
+    DataTable* table(const std::string& table_name);
+
     /* Obtain a list of monitoring tables */
     std::list< std::string > tables() const;
 
@@ -114,19 +126,60 @@ class Monitor
 
     size_t table_size(const std::string& tablename);
 
+    /* Set the conflation interval of a table, creating the table if
+     * required.  Conflated tables are flushed by an internal thread, which is
+     * started when first needed. */
+    void conflate_table(const std::string& tablename, int interval_ms);
+
+    /* Get a table's conflation interval and its counts of row updates
+     * received and published.  Returns false if there is no such table. */
+    bool table_update_counts(const std::string& tablename,
+                             int& interval_ms,
+                             uint64_t& received,
+                             uint64_t& published) const;
+
+    /* Stop internal threads; must be called before the objects the tables
+     * publish to are destroyed */
+    void stop();
+
   private:
     Monitor(const Monitor&); // no copy
     Monitor& operator=(const Monitor&); // no assignment
 
-    DataTable* create_table_NOLOCK(const std::string& table_name);
-
-    // Tables that are being monitored
+    // Tables that are being monitored.  The collection is striped by a hash
+    // of the table name, each stripe having its own lock, so that threads
+    // using different tables rarely contend.  Tables are never removed, so a
+    // table found under a stripe lock can be used after the lock is released.
     typedef std::map< std::string, DataTable* > TableCollection;
 
-    TableCollection m_tables;
-    mutable cpp11::mutex m_mutex;  // protect tables
+    struct Stripe
+    {
+        cpp11::mutex    mutex;  // protect tables
+        TableCollection tables;
+        char pad[64];  // keep the locks of stripes on separate cache lines
+    };
+
+    static const size_t STRIPES = 32;
+
+    Stripe& stripe(const std::string& table_name) const;
+
+    /* Find a table, returning NULL if there is none */
+    DataTable* find_table(const std::string& table_name) const;
+
+    /* Get every table, for work which must not hold a stripe lock */
+    void all_tables(std::vector< DataTable* >&) const;
+
+    DataTable* create_table_NOLOCK(Stripe&, const std::string& table_name);
+
+    void conflation_TEP();
+
+    mutable Stripe m_stripes[STRIPES];
 
     AdminInterfaceImpl * m_ai;
+
+    cpp11::mutex m_mutex;  // protect conflation thread
+    cpp11::thread * m_conflation_thread;  // protected by m_mutex
+    cpp11::atomic_bool m_is_stopping;
 };
 
 } // namespace exio
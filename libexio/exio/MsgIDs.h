@@ -72,6 +72,7 @@ namespace id  /* identifiers */
   static const std::string text           = "text";
   static const std::string user           = "user";
   static const std::string value          = "value";
+  static const std::string wireformat     = "wireformat";
 
   // true/false representation
   static const std::string True   = "1";  // yes
@@ -97,6 +98,7 @@ namespace id  /* identifiers */
   static const sam::qname QN_serviceid      = QNAME( head, serviceid );
   static const sam::qname QN_tablename      = QNAME( head, tablename );
   static const sam::qname QN_testrequest    = QNAME( head, testrequest );
+  static const sam::qname QN_wireformat     = QNAME( head, wireformat );
 
   // message types
   static const std::string admindescr   = "admindescr";
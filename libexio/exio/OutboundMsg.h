@@ -0,0 +1,58 @@
+/*
+    Copyright 2013, Darren Smith
+
+    This file is part of exio, a library for providing administration,
+    monitoring and alerting capabilities to an application.
+
+    exio is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    exio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with exio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef EXIO_OUTBOUNDMSG_H
+#define EXIO_OUTBOUNDMSG_H
+
+#include "exio/sam.h"
+#include "exio/SharedBuffer.h"
+
+namespace exio
+{
+
+class AppSvc;
+
+/* A message to be queued to many sessions.  It is encoded at most once for
+ * each wire format, when first needed, and the encoded bytes are shared by
+ * all sessions using that format.  A message given already encoded is only
+ * available in that format. */
+class OutboundMsg
+{
+  public:
+    OutboundMsg(AppSvc&, const sam::txMessage&);
+
+    /* A message which is already encoded */
+    OutboundMsg(AppSvc&, const SharedBuffer&, sam::WireFormat);
+
+    /* Get the encoding for a format.  Returns true on failure. */
+    bool encoded(sam::WireFormat, SharedBuffer&);
+
+  private:
+    OutboundMsg(const OutboundMsg&);
+    OutboundMsg& operator=(const OutboundMsg&);
+
+    AppSvc& m_appsvc;
+    const sam::txMessage* m_msg;  // or NULL, if constructed encoded
+    SharedBuffer m_buf[2];        // indexed by WireFormat
+    bool         m_failed[2];
+};
+
+} // namespace exio
+
+#endif
@@ -22,6 +22,7 @@
 #define EXIO_REACTOR_H
 
 #include "exio/Client.h"
+#include "exio/AppSvc.h"
 
 #include "thread.h"
 #include "atomic.h"
@@ -33,12 +34,24 @@ namespace exio {
   class LogService;
   class ReactorMsg;
   class ReactorNotifQ;
+  class ReactorPoller;
 
 
 class Reactor
 {
   public:
-    Reactor(LogService*, int nworkers=2);
+
+    /* Load indicators, used for balancing clients over several reactors */
+    struct Load
+    {
+        size_t   clients;    // clients added and not yet deleted
+        uint64_t wakeups;    // returns from poll
+        uint64_t io_events;  // client I/O events dispatched
+        Load() : clients(0), wakeups(0), io_events(0) {}
+    };
+
+    Reactor(LogService*, int nworkers=2,
+            Config::Poller poller = Config::eEpoll);
     ~Reactor();
 
     void add_client(ReactorClient*);
@@ -48,10 +61,13 @@ class Reactor
 //    void request_release(ReactorClient*);
     void request_attn();
 
-    void invalidate();
+    /* Note that a client's poll events or work might have changed */
+    void invalidate(ReactorClient*);
 
     const std::vector< std::pair<pthread_t,int> >& thread_ids() const;
 
+    Load load() const;
+
   private:
     Reactor(const Reactor&); // no copy
     Reactor& operator=(const Reactor&); // no assignment
@@ -62,20 +78,21 @@ class Reactor
     void worker_TEP(int index);
     bool worker_TEP_impl();
 
+    void handle_io_events(ReactorClient*, int revents);
     void handle_reactor_msg(const ReactorMsg&);
     void attend_clients();
+    void examine(ReactorClient*);
 
     LogService* m_log;
     cpp11::atomic_bool m_is_stopping;
 
-    int m_pipefd[2]; // TODO: move into the NotifQ
-
 
     std::vector<ReactorClient*> m_clients;
     std::set<ReactorClient*>    m_destroying;
     time_t m_last_cleanup;
 
     ReactorNotifQ * m_notifq;
+    ReactorPoller * m_poller;
     cpp11::thread * m_io;
 
     struct RunQ
@@ -87,6 +104,19 @@ class Reactor
         RunQ () : itemcount(0) {}
     } m_runq;
 
+    /* Clients invalidated since the reactor last looked at them */
+    struct DirtyQ
+    {
+        cpp11::mutex                  mutex;
+        std::vector<ReactorClient*>   items;
+    } m_dirty;
+
+    /* Load counters.  Only the reactor thread increments wakeups and
+     * io_events; all are read without ordering by load(). */
+    cpp11::atomic<size_t>   m_load_clients;
+    cpp11::atomic<uint64_t> m_load_wakeups;
+    cpp11::atomic<uint64_t> m_load_io_events;
+
     std::vector<cpp11::thread*> m_workers;
     std::vector< std::pair<pthread_t,int> > m_thr_ids;    // 0 is reactor
 };
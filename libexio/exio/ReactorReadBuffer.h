@@ -38,8 +38,13 @@ class ReactorReadBuffer
 
     size_t bytesavail() const { return m_bytesavail; }
 
+    /* Increase the capacity by half */
     size_t grow();
 
+    /* Ensure the capacity is at least n bytes, reallocating to exactly n if
+     * not.  Pending bytes are moved to the start of the new array. */
+    void reserve(size_t n);
+
     /* Any used bytes in the buffer are moved to the start of the array. */
     void shift_pending_to_array_start()
     {
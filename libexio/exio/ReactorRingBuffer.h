@@ -0,0 +1,87 @@
+#ifndef EXIO_REACTORRINGBUFFER_H
+#define EXIO_REACTORRINGBUFFER_H
+
+#include "mutex.h"
+#include "atomic.h"
+
+#include <algorithm>
+
+#include <string.h>
+#include <sys/types.h>
+
+namespace exio {
+
+/*
+ * Single-producer / single-consumer byte ring.  The producer, the reactor
+ * thread, reads from a socket directly into the free space; the consumer, a
+ * worker thread, decodes the readable bytes in place.  The only shared state
+ * is the pair of read/write counters, so no lock is needed.
+ *
+ * Counters increase monotonically and are reduced modulo the capacity, which
+ * is rounded up to a power of two.
+ */
+class ReactorRingBuffer
+{
+  public:
+
+    explicit ReactorRingBuffer(size_t cap);
+
+    ~ReactorRingBuffer()
+    {
+      delete [] m_buf;
+    }
+
+    size_t capacity() const { return m_cap; }
+
+    /* Producer side */
+
+    size_t space() const { return m_cap - (m_w.load() - m_r.load()); }
+
+    /* Read from fd into the free space, with a single readv().  Returns the
+     * result of readv(), with errno copied into 'err'. */
+    ssize_t read_from(int fd, int& err);
+
+    /* Total bytes ever written, can be compared by the consumer to detect
+     * arrival of new data */
+    size_t write_count() const { return m_w.load(); }
+
+    /* Consumer side */
+
+    size_t readable() const { return m_w.load() - m_r.load(); }
+
+    /* Start of the readable bytes.  Only the first 'len' bytes are
+     * contiguous; the remainder, if any, is wrapped to the array start. */
+    const char* peek(size_t& len) const
+    {
+      size_t r   = m_r.load();
+      size_t off = r & (m_cap-1);
+      size_t n   = m_w.load() - r;
+      len = std::min(n, m_cap - off);
+      return m_buf + off;
+    }
+
+    /* Whether the contiguous readable bytes end at the array end, so that
+     * later bytes will be written at the start of the array */
+    bool peek_at_end(const char* p, size_t len) const
+    {
+      return p + len == m_buf + m_cap;
+    }
+
+    /* Copy n readable bytes, handling wrap-around, without consuming */
+    void copy_out(char* dest, size_t n) const;
+
+    void consume(size_t n) { m_r.store(m_r.load() + n); }
+
+  private:
+    ReactorRingBuffer(const ReactorRingBuffer&);
+    ReactorRingBuffer& operator=(const ReactorRingBuffer&);
+
+    size_t m_cap;
+    char*  m_buf;
+    cpp11::atomic<size_t> m_w;  // written by producer
+    cpp11::atomic<size_t> m_r;  // written by consumer
+};
+
+} // namespace exio
+
+#endif
@@ -22,6 +22,7 @@
 #define EXIO_SAMBUFFER_H
 
 #include "exio/sam.h"
+#include "exio/SharedBuffer.h"
 
 #include <vector>
 
@@ -49,6 +50,9 @@ class SamBuffer
     // encode header (once all data has been added)
     virtual void encode_header() = 0;
 
+    // as above, for a specific SAM version, such as SAM0200
+    virtual void encode_header(const char* version) = 0;
+
     // obtain location and size of data
     virtual const char* msg_start() const = 0;
     virtual size_t      msg_size()  const = 0;
@@ -95,8 +99,14 @@ class DynamicSamBuffer : public SamBuffer
 {
   public:
     DynamicSamBuffer(size_t reserve = 512);
+    DynamicSamBuffer(const DynamicSamBuffer&);
+    DynamicSamBuffer& operator=(const DynamicSamBuffer&);
     ~DynamicSamBuffer();
 
+    /* Hand the encoded message over to 'dest', without copying it.  The
+     * buffer is left empty. */
+    void transfer(SharedBuffer& dest);
+
     void append(const char* src, size_t srclen);
     void append(char src);
 
@@ -105,11 +115,17 @@ class DynamicSamBuffer : public SamBuffer
 
     void check_space(size_t n);
 
+    /* Discard data appended after the first 'msglen' bytes; used to back out
+     * a partially encoded item.  Only valid before encode_header. */
+    void truncate(size_t msglen);
+
     virtual void encode_header();
+    virtual void encode_header(const char* version);
 
   private:
 
-    std::vector<char> m_buf;
+    char*  m_buf;       // from malloc(), so it can be given to a SharedBuffer
+    size_t m_size;
 
     size_t m_msg_start; // msg start pointer
     size_t m_wptr;      // write pointer
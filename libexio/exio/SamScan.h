@@ -0,0 +1,31 @@
+#ifndef EXIO_SAMSCAN_H
+#define EXIO_SAMSCAN_H
+
+#include <sys/types.h>
+
+namespace sam {
+
+/*
+ * Delimiter scanning for the SAM encoder and decoder.  On x86 the scan is
+ * done 32 or 16 bytes at a time with AVX2 or SSE2, chosen at startup from the
+ * capabilities of the CPU; elsewhere a table driven scalar loop is used.
+ * Unlike strcspn, the input does not have to be NUL terminated.
+ */
+
+/* Return the first SAM special character (see SPECIAL_CHARS) in [p,end), or
+ * end if there is none */
+const char* find_special(const char* p, const char* end);
+
+/* Return the first occurrence of either 'a' or 'b' in [p,end), or end */
+const char* find_either(const char* p, const char* end, char a, char b);
+
+/* Name of the kernels in use: "avx2", "sse2" or "scalar" */
+const char* scan_kernel();
+
+/* Select kernels by name, for testing and benchmarking.  Returns false if
+ * the name is unknown or not supported by this CPU. Not thread safe. */
+bool set_scan_kernel(const char* name);
+
+} // namespace sam
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef EXIO_SHAREDBUFFER_H
+#define EXIO_SHAREDBUFFER_H
+
+#include "mutex.h"
+#include "atomic.h"
+
+#include <sys/types.h>
+
+namespace exio {
+
+/*
+ * Immutable, reference counted byte buffer.  Used for an encoded message that
+ * is queued to many clients: the bytes are stored once, each queued copy of
+ * the handle holds a reference, and the memory is released when the last
+ * reference goes.  Handles may be copied and released on any thread.
+ */
+class SharedBuffer
+{
+  public:
+
+    /* Empty buffer, holding no memory */
+    SharedBuffer() : m_rep(NULL) {}
+
+    /* Allocate a buffer and copy 'len' bytes from 'src' */
+    SharedBuffer(const char* src, size_t len);
+
+    /* Take ownership of 'block', memory from malloc(), whose content is the
+     * 'len' bytes at 'src' within it.  Nothing is copied. */
+    static SharedBuffer adopt(char* block, const char* src, size_t len);
+
+    SharedBuffer(const SharedBuffer& rhs) : m_rep(rhs.m_rep) { acquire(); }
+
+    SharedBuffer& operator=(const SharedBuffer& rhs)
+    {
+      if (m_rep != rhs.m_rep)
+      {
+        release();
+        m_rep = rhs.m_rep;
+        acquire();
+      }
+      return *this;
+    }
+
+    ~SharedBuffer() { release(); }
+
+    const char* data() const { return m_rep? m_rep->mem  : NULL; }
+    size_t      size() const { return m_rep? m_rep->size : 0; }
+    bool       empty() const { return size() == 0; }
+
+    /* Number of handles referring to the buffer; zero if empty */
+    int use_count() const { return m_rep? m_rep->refs.load() : 0; }
+
+  private:
+
+    struct Rep
+    {
+      cpp11::atomic<int> refs;
+      const char* mem;
+      size_t size;
+      char*  block;  // allocation holding mem, released with free()
+    };
+
+    void acquire() { if (m_rep) m_rep->refs.fetch_add(1); }
+    void release();
+
+    Rep* m_rep;
+};
+
+} // namespace exio
+
+#endif
@@ -22,104 +22,39 @@
 
 #include "exio/TableEvents.h"
 #include "exio/AdminInterface.h"
+#include "exio/AdminSessionID.h"
+#include "exio/SharedBuffer.h"
 
 #include "mutex.h"
+#include "atomic.h"
 
 #include <algorithm>
 #include <sstream>
+#include <tr1/unordered_map>
+
+#include <stdint.h>
 
 namespace exio
 {
 
 class AdminInterfaceImpl;
 class AppSvc;
-class SID;
-
-/**
- * Represent a row of data in a table.
- */
-class DataRow
-{
-    class FieldMeta
-    {
-    };
-
-    struct Field
-    {
-        std::string value;
-        FieldMeta   meta;
-
-        Field() {}
-        Field(const std::string & v) : value(v) {}
-    };
-
-    typedef std::map< std::string, Field > Fields;
-
-  public:
-
-    class iterator
-    {
-      public:
-
-        bool operator==(const iterator& rhs) const
-        {
-          return m_iter == rhs.m_iter;
-        }
-
-        bool operator!=(const iterator& rhs) const
-        {
-          return m_iter != rhs.m_iter;
-        }
-
-        void operator++()  { ++m_iter; }
-
-        const std::string& name() const { return m_iter->first;}
-        const std::string& value() const { return m_iter->second.value;}
-
-      private:
-        iterator(Fields::const_iterator i) : m_iter(i) {}
-        Fields::const_iterator m_iter;
-
-        friend class DataRow;
-    };
-
-  public:
-
-    /* Methods */
-
-    explicit DataRow(const std::string& rowkey,
-                     const std::string& __table_name);
-
-    const std::string& rowkey() const { return m_rowkey; }
-
-    bool update_fields(const std::map<std::string, std::string>& fields,
-                       std::list<TableEventPtr>& events);
-
-    void copy_row(AdminInterface::Row& dest) const;
-
-    bool               has_field(const std::string&) const;
-
-    /** Get field, or throw out_of_range exception if not found */
-    const std::string& get_field(const std::string&) const;
-
-    /** Copy field. Return value is true if field was found. */
-    bool copy_field(const std::string&, std::string&) const;
-
-    void clear();
-
-    iterator       begin() const;
-    iterator       end()   const;
-
-  private:
-
-    std::string m_rowkey;
-    std::string m_table_name;  // table this row belongs to.
-    Fields m_fields;
-};
-
+class SamBuffer;
 
 /*
  * Represent a table of data, which is the basic unit of monitoring in exio.
+ *
+ * Table content is stored by column: each column holds one value per row
+ * slot, so a cell costs a string and a presence bit, rather than a map node
+ * keyed by a copy of the column name.  The reserved RowKey and RowLastUpdated
+ * fields are held once per row, and synthesised when a row is copied or
+ * serialised.
+ *
+ * Copies of the whole table, and snapshots sent to subscribers, are read from
+ * an image of the table, which shares the table's storage until the table
+ * next changes it.  An image is taken under the table lock at the cost of
+ * copying a pointer per block of rows; the rows are then copied or encoded
+ * without the lock, so updates do not wait for them.
  */
 class DataTable
 {
@@ -150,8 +85,8 @@ class DataTable
     size_t get_column_count() const;
     size_t get_row_count() const;
 
-    const std::string& get_row_field(const std::string & rowkey,
-                                     const std::string & column) const;
+    std::string get_row_field(const std::string & rowkey,
+                              const std::string & column) const;
 
     void clear_table();
 
@@ -162,6 +97,11 @@ class DataTable
                     const std::map<std::string, std::string> & fields,
                     std::list<TableEventPtr>& events);
 
+    /* Update many rows, under a single lock, publishing the changes as
+     * multi-row updates */
+    void update_rows(const AdminInterface::Table& rows,
+                     std::list<TableEventPtr>& events);
+
     /* Update per-cell-meta-data */
     void update_meta(const std::string & rowkey,
                      const std::string & column,
@@ -170,6 +110,18 @@ class DataTable
 
     void add_columns(const std::list<std::string>& cols);
 
+    /* Index of a column, adding it if new; used by TableHandle */
+    size_t column_index(const std::string& column);
+
+    /* Update cells of a row, given by column index; used by RowHandle.  The
+     * row is expected in slot, holding row_id, else is found or added by
+     * rowkey, and slot and row_id are set to where it is now held. */
+    template<typename T>
+    void update_cells(const std::string& rowkey,
+                      size_t& slot, size_t& row_id,
+                      const T* begin, const T* end,
+                      std::list<TableEventPtr>& events);
+
     /* Can throw */
     void add_subscriber(const SID& session);
 
@@ -185,24 +137,56 @@ class DataTable
     void snapshot();
 
     size_t size() const;
+
+    /* Conflation.  With a non-zero interval, row updates are not published as
+     * they occur.  Instead the changed cells are marked dirty, and each dirty
+     * row is published once per interval, as a single update carrying the
+     * latest values.  An interval of zero, the default, publishes every
+     * update immediately; changing the interval flushes pending updates. */
+    void set_conflation(int interval_ms);
+    int  conflation() const;
+
+    /* Publish dirty rows if the conflation interval has elapsed.  Returns the
+     * milliseconds until the next flush is due, or 0 if not conflating. */
+    int flush_conflated();
+
+    /* Row updates applied to the table, and row updates published */
+    struct UpdateCounts
+    {
+        uint64_t received;
+        uint64_t published;
+        UpdateCounts() : received(0), published(0) {}
+    };
+    UpdateCounts update_counts() const;
   private:
 
 
-    void _nolock_add_row(const std::string& rowkey,
-                         std::list<TableEventPtr>& events);
+    size_t _nolock_add_row(const std::string& rowkey,
+                           std::list<TableEventPtr>& events);
 
     bool _nolock_has_row(const std::string& rowkey) const;
 
     void _nolock_publish_update(std::list<TableEventPtr>&);
 
-    void _nolock_send_snapshopt(const SID&);
+    void _nolock_flush_conflated();
+
     //void _nolock_send_snapshopt_as_single_msg(const SID&);
 
-    void add_column_NOLOCK(const std::string & column,
-                           std::list<TableEventPtr>& events);
+    size_t add_column_NOLOCK(const std::string & column,
+                             std::list<TableEventPtr>& events);
+
+    /* Column of each field, adding any new; npos for the reserved fields */
+    void _nolock_field_columns(const std::map<std::string, std::string>&,
+                               std::vector< size_t >& cols,
+                               std::list<TableEventPtr>& events);
 
     void copy_subscribers(std::vector< SID > &subs) const;
 
+    /* Send a snapshot to sessions held as pending subscribers, followed by
+     * the updates published meanwhile, and then make them subscribers */
+    struct Image;
+    void send_snapshot(const Image&, const std::vector< SID >& sessions);
+
     std::string m_table_name;
     AdminInterfaceImpl * m_ai;
     AppSvc * m_appsvc;
@@ -210,14 +194,216 @@ class DataTable
     std::vector< std::string >      m_columns;
     std::map< std::string, size_t > m_column_index;
 
-    // TODO: do we need to have a separate vector<> and map<> ? Why not just
-    // use a map<> ?
-    std::vector< DataRow >          m_rows;
-    std::map< std::string, size_t > m_row_index;
+    /* Rows are held in slots which never move, so a row's slot number is
+     * stable for its lifetime.  Slots of deleted rows are recycled through a
+     * free list.  Used slots are also linked in insertion order, which is the
+     * order rows are presented in snapshots and copies. */
+    struct RowSlot
+    {
+        std::string rowkey;
+        size_t      id;       // unique to the row, or 0 if slot is free
+        time_t      updated;  // RowLastUpdated, or 0 if never updated
+        size_t      prev;     // insertion order, or npos at either end
+        size_t      next;
+
+        RowSlot() : id(0), updated(0), prev(npos), next(npos) {}
+        RowSlot(const std::string& k, size_t i)
+          : rowkey(k), id(i), updated(0), prev(npos), next(npos) {}
+    };
+
+    /* Cell types, numbered as for RowHandle::TypedCell.  Typed cells are held
+     * as a number, and formatted to text only when read. */
+    enum CellType
+    {
+      eText   = 0,
+      eInt64  = RowHandle::TypedCell::eInt64,
+      eDouble = RowHandle::TypedCell::eDouble,
+      eBool   = RowHandle::TypedCell::eBool
+    };
+    union Number
+    {
+        int64_t i;  // also a bool, as 0 or 1
+        double  d;
+    };
+
+    static const size_t npos = (size_t)-1;
+
+    /* Row slots, with their cells, are stored in blocks of BLOCK_ROWS slots.
+     * A block is reference counted, and shared between the table and any
+     * images of it; the table copies a block before changing it, while it is
+     * still shared.  A block holds cells only for the columns it has had set,
+     * so adding a column does not touch existing blocks. */
+    static const size_t BLOCK_ROWS = 32;
+
+    struct BlockColumn
+    {
+        std::string   values[BLOCK_ROWS];   // text cells
+        bool          present[BLOCK_ROWS];
+        unsigned char types[BLOCK_ROWS];    // CellType
+        Number        numbers[BLOCK_ROWS];  // typed cells
+
+        BlockColumn();
+    };
+
+    struct Block
+    {
+        cpp11::atomic<int> refs;
+        RowSlot slots[BLOCK_ROWS];
+        std::vector< BlockColumn > cols;   // by column id
+
+        Block() : refs(1) {}
+        Block(const Block&);
+      private:
+        Block& operator=(const Block&);
+    };
+
+    /* Row slots and cells, of the table or of an image of it.  Readers may
+     * use an image on any thread; writers are the table, under its lock. */
+    class Content
+    {
+      public:
+        Content() : m_used(0), m_ncols(0) {}
+        ~Content() { clear(); }
+
+        /* Share the blocks of another, releasing any held */
+        void share(const Content&);
+
+        /* Release all slots; columns are kept */
+        void clear();
+
+        /* Slots used, whether holding a row or free */
+        size_t slots() const { return m_used; }
+
+        size_t add_slot();
+        void   add_column() { m_ncols++; }
+
+        const RowSlot& row(size_t slot) const
+        {
+          return m_blocks[slot / BLOCK_ROWS]->slots[slot % BLOCK_ROWS];
+        }
+        RowSlot& row_for_write(size_t slot)
+        {
+          return writable(slot / BLOCK_ROWS)->slots[slot % BLOCK_ROWS];
+        }
+
+        bool present(size_t col, size_t slot) const
+        {
+          const BlockColumn* c = cells(col, slot);
+          return c and c->present[slot % BLOCK_ROWS];
+        }
+        CellType type(size_t col, size_t slot) const
+        {
+          const BlockColumn* c = cells(col, slot);
+          return c? (CellType) c->types[slot % BLOCK_ROWS] : eText;
+        }
+        Number number(size_t col, size_t slot) const
+        {
+          return cells(col, slot)->numbers[slot % BLOCK_ROWS];
+        }
+
+        /* Text of a present cell.  Text cells are returned directly, and
+         * typed cells are formatted into buf, which is returned. */
+        const std::string& text(size_t col, size_t slot,
+                                std::string& buf) const;
+
+        void set_text(size_t col, size_t slot, const std::string& value);
+        void set_number(size_t col, size_t slot, CellType, Number);
+
+        /* Remove all cells of a slot, and reset the slot */
+        void clear_slot(size_t slot);
+
+      private:
+        Content(const Content&);
+        Content& operator=(const Content&);
+
+        const BlockColumn* cells(size_t col, size_t slot) const
+        {
+          const Block* b = m_blocks[slot / BLOCK_ROWS];
+          return (col < b->cols.size())? &b->cols[col] : NULL;
+        }
+        BlockColumn& cells_for_write(size_t col, size_t slot);
+
+        Block* writable(size_t block);
+        static void release(Block*);
+
+        std::vector< Block* > m_blocks;
+        size_t m_used;
+        size_t m_ncols;
+    };
+
+    size_t _nolock_find_row(const std::string& rowkey) const;
+
+    bool _nolock_update_fields(size_t slot,
+                               const std::map<std::string, std::string>&,
+                               const std::vector< size_t >& cols,
+                               std::list<TableEventPtr>& events);
+
+    bool _nolock_set_cell(size_t slot, size_t col, const std::string& value,
+                          RowMultiUpdate*& eventptr);
+    bool _nolock_set_cell(size_t slot, const RowHandle::Cell&,
+                          RowMultiUpdate*& eventptr);
+    bool _nolock_set_cell(size_t slot, const RowHandle::TypedCell&,
+                          RowMultiUpdate*& eventptr);
+    bool _nolock_set_number(size_t slot, size_t col, CellType, Number,
+                            RowMultiUpdate*& eventptr);
+
+    void _nolock_row_updated(size_t slot, RowMultiUpdate* eventptr,
+                             std::list<TableEventPtr>& events);
+
+    void _nolock_format_numbers(RowMultiUpdate*) const;
+    static void drop_number(RowMultiUpdate*, size_t col);
+
+    static size_t format_number(CellType, Number, char* dest);
+
+    bool _nolock_copy_field(size_t slot,
+                            const std::string& field,
+                            std::string& dest) const;
+
+    static void copy_row(const Content&,
+                         const std::vector< std::string >& columns,
+                         size_t slot, AdminInterface::Row& dest);
+
+    static bool copy_reserved(const RowSlot&, const std::string& field,
+                              std::string& dest);
+
+    Content                m_content;
+    std::vector< size_t >  m_free_slots;
+    size_t                 m_head_slot;  // oldest row
+    size_t                 m_tail_slot;  // newest row
+    size_t                 m_row_count;
+    size_t                 m_next_row_id;
+
+    /* Conflation marks, indexed by slot, and for cells, by column id */
+    std::vector< bool >                m_dirty_slots;
+    std::vector< std::vector< bool > > m_dirty_cells;
+
+    typedef std::tr1::unordered_map< std::string, size_t > RowIndex;
+    RowIndex m_row_index;  // rowkey to slot
 
     mutable cpp11::mutex m_subscriberslock;
     std::vector< SID > m_subscribers;
 
+    /* Sessions waiting for a snapshot, encoded without the table lock,
+     * before they become subscribers.  Updates published meanwhile are held
+     * for each, to be sent after its snapshot.  Entries are added and
+     * removed under both locks, and the backlogs are kept under the
+     * table-lock; a session unsubscribing meanwhile is marked cancelled,
+     * under the subscribers-lock.  The backlog is held in the session's wire
+     * format.  After the snapshot, the backlog is taken under the locks and
+     * sent without them, until none remains; the session stays pending
+     * until then, so that updates keep their order. */
+    struct Pending
+    {
+        SID  session;
+        sam::WireFormat format;
+        std::vector< SharedBuffer > backlog;
+        bool cancelled;
+
+        Pending(const SID& s, sam::WireFormat f)
+          : session(s), format(f), cancelled(false) {}
+    };
+    std::list< Pending > m_pending;
+
     // Note: if ever the subscriber-lock and table-lock have to be held at the
     // same time, then the table-lock must be locked first, followed by the
     // subscribers-lock
@@ -232,12 +418,12 @@ class DataTable
 
     /* Per-cell-meta-data
      *
-     * NOTE: currently we are not storing this directly in the DataRow.
+     * NOTE: currently we are not storing this directly in the table cells.
      * Simple reason is that it is possible to assign meta data to a cell that
      * does not exist, eg, for a row or column that is presently not part of
      * the actual table.  Thus, if we tryied to palce our meta data inside
-     * DataRow, we would need to handle DataRow instances which didn't
-     * actually correspond to any real data.
+     * the cells, we would need to handle cells which didn't actually
+     * correspond to any real data.
      */
 
   public:
@@ -245,8 +431,65 @@ class DataTable
     typedef std::map< std::string, MetaForCol  > PCMD; // per-cell-meta-data
 
   private:
-    PCMD m_pcmd;  // map of rowkey to col-to-meta
+    /* Per-cell-meta-data held by the table and shared with its images.  As
+     * with the blocks of Content, a shared map is copied before a change,
+     * and sharing is only under the table-lock. */
+    class MetaData
+    {
+      public:
+        MetaData() : m_data(NULL) {}
+        ~MetaData() { release(m_data); }
+
+        /* Share the map of another, releasing any held */
+        void share(const MetaData&);
+
+        const PCMD& map() const;
+        PCMD& map_for_write();
+
+      private:
+        MetaData(const MetaData&);
+        MetaData& operator=(const MetaData&);
+
+        struct Data
+        {
+            cpp11::atomic<int> refs;
+            PCMD pcmd;
+            Data() : refs(1) {}
+        };
+        static void release(Data*);
+
+        Data* m_data;
+    };
+
+    MetaData m_pcmd;  // map of rowkey to col-to-meta
+
+    /* A consistent, read-only copy of the table, taken under the table-lock
+     * and read without it */
+    struct Image
+    {
+        Content content;
+        size_t  head;
+        size_t  rows;
+        std::vector< std::string > columns;
+        MetaData pcmd;  // shared only for a snapshot
+    };
+    void _nolock_take_image(Image&) const;
+
+    static void build_snapshot(AppSvc&, const std::string& table_name,
+                               const Image&, sam::WireFormat,
+                               std::vector< SharedBuffer >&);
+    static void encode_row(const Image&, size_t slot, sam::SAMProtocol&,
+                           SamBuffer*);
+
     int m_batchsize;
+
+    sam::txArena m_msg_arena;  // for messages built during a publish
+
+    /* Conflation state */
+    int m_conflate_ms;
+    uint64_t m_conflate_due;            // monotonic msec of next flush
+    std::vector< size_t > m_dirty_rows; // slots, in order first made dirty
+    UpdateCounts m_counts;
 };
 
 
@@ -23,6 +23,9 @@
 #include <string>
 #include <map>
 #include <list>
+#include <vector>
+
+#include <stdint.h>
 
 #include "exio/sam.h"
 
@@ -216,6 +219,16 @@ struct RowMultiUpdate : public TableEvent
     std::string row_key;
     std::map<std::string, std::string> fields;
 
+    /* Typed cells changed by the update.  They are held as set, and the
+     * table formats them into 'fields' only if the update is to be sent. */
+    struct Number
+    {
+        size_t  column;  // index of the column in the table
+        int     type;    // as RowHandle::TypedCell::Type
+        int64_t bits;    // value, as stored by the table
+    };
+    std::vector< Number > numbers;
+
     RowMultiUpdate(const std::string& __table_name,
                    const std::string& __row_key)
       : TableEvent(eRowMultiUpdate, __table_name),
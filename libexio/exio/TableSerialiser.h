@@ -67,6 +67,12 @@ class UpdateSerialiser : public TableEventSerialiser
                   const std::string& table_name,
                   const std::string& row_key);
 
+    /* Start another row in the current message.  Subsequent calls of
+     * add_update will update this row. */
+    void add_row(const std::string& row_key);
+
+    size_t rows() const { return m_rows; }
+
     // Return true if field was added ok, ie, there was enough space. False
     // means that the message is now too large to fit in the encoding
     // protocol.
@@ -74,7 +80,9 @@ class UpdateSerialiser : public TableEventSerialiser
                     const std::string& value);
 
   private:
+    sam::txContainer* m_body;
     sam::txContainer* m_row;
+    size_t            m_rows;
 };
 
 }
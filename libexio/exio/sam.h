@@ -21,11 +21,16 @@
 #define __SAM_HXX_
 
 #include <stdexcept>
+#include <deque>
+#include <iterator>
 #include <list>
 #include <ostream>
 #include <vector>
 #include <map>
 
+#include <stddef.h>
+#include <stdint.h>
+
 // Macro for defining a qname (a Qualified Name, for describing the path to a
 // field in a txContainer message).
 
@@ -46,6 +51,14 @@ namespace sam
 {
   static const char * const SAM0100 = "SAM0100";  // len 7
   static const char * const SAM0101 = "SAM0101";  // len 7
+
+  /* Binary formats.  These use the same header as SAM0101, followed by a
+   * body of length-prefixed strings which need no escaping.  Field and
+   * container names can be sent as ids from a dictionary, which is built up
+   * on each session by SAM0201 frames.  A session only uses them if its
+   * peer asks for them at logon. */
+  static const char * const SAM0200 = "SAM0200";  // binary message
+  static const char * const SAM0201 = "SAM0201";  // dictionary names
   static const char   MSG_START     = '{' ;
   static const char   MSG_END       = '}';
   static const char   MSG_DELIM     = '\n';
@@ -61,6 +74,13 @@ namespace sam
 
   static const size_t MAX_MSG_LEN   = 99999;  // for SAM0100, 5 digits
 
+  /* Encoding used for messages sent to a session */
+  enum WireFormat
+  {
+    eTextFormat = 0,  // SAM0100/SAM0101
+    eBinaryFormat     // SAM0200
+  };
+
   // TODO: remove from sam.h
   struct Converters
   {
@@ -83,6 +103,129 @@ class qname;
 class txContainer;
 class txField;
 
+/*
+ * Bump allocator, from which the nodes of a txMessage can be allocated, so
+ * that building and tearing down a message costs a few large allocations
+ * rather than several per field.  Memory is carved sequentially from chunks
+ * and is only reclaimed by reset(), which requires that all objects built in
+ * the arena have been destroyed first.
+ *
+ * Strings held by items are std::string, so a name or value longer than the
+ * small string capacity still has its characters on the heap.
+ */
+class txArena
+{
+  public:
+    explicit txArena(size_t chunk_size = 4096);
+    ~txArena();
+
+    void* allocate(size_t n)
+    {
+      n = (n + ALIGN - 1) & ~(ALIGN - 1);
+      if ((size_t)(m_end - m_next) < n) grow(n);
+
+      void* p = m_next;
+      m_next += n;
+      return p;
+    }
+
+    /* Reclaim all memory.  If several chunks were used, they are replaced by
+     * a single chunk large enough for the same demand (within a limit), so a
+     * reused arena settles at one chunk. */
+    void reset();
+
+    size_t chunks() const { return m_chunks.size(); }
+
+    /* Bytes handed out since construction or the last reset */
+    size_t used() const;
+
+  private:
+    txArena(const txArena&);
+    txArena& operator=(const txArena&);
+
+    static const size_t ALIGN = 2 * sizeof(void*);
+
+    void grow(size_t n);
+    void add_chunk(size_t n);
+    void free_chunks();
+
+    struct Chunk
+    {
+        char*  mem;
+        size_t size;
+    };
+
+    std::vector< Chunk > m_chunks;
+    char*  m_next;
+    char*  m_end;
+    size_t m_chunk_size;  // size of the next chunk
+    size_t m_prior;       // bytes used in chunks before the current one
+};
+
+/*
+ * Allocator for the item lists and maps of a txContainer.  It refers to the
+ * container's arena pointer, rather than holding a copy, so that an empty
+ * container can be placed on an arena after construction.  With no arena it
+ * uses the heap.  Deallocation from an arena is a no-op.
+ */
+template <typename T>
+class txAllocator
+{
+  public:
+    typedef T         value_type;
+    typedef T*        pointer;
+    typedef const T*  const_pointer;
+    typedef T&        reference;
+    typedef const T&  const_reference;
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U> struct rebind { typedef txAllocator<U> other; };
+
+    txAllocator() : m_arena(NULL) {}
+    explicit txAllocator(txArena* const* arena) : m_arena(arena) {}
+
+    template <typename U>
+    txAllocator(const txAllocator<U>& rhs) : m_arena(rhs.source()) {}
+
+    pointer allocate(size_type n, const void* = 0)
+    {
+      if (m_arena and *m_arena)
+        return static_cast<pointer>((*m_arena)->allocate(n * sizeof(T)));
+      return static_cast<pointer>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(pointer p, size_type)
+    {
+      if (not (m_arena and *m_arena)) ::operator delete(p);
+    }
+
+    void construct(pointer p, const T& val) { new((void*)p) T(val); }
+    void destroy(pointer p) { p->~T(); }
+
+    size_type max_size() const { return size_type(-1) / sizeof(T); }
+
+    pointer       address(reference x) const       { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+
+    txArena* const* source() const { return m_arena; }
+
+  private:
+    txArena* const* m_arena;
+};
+
+template <typename T, typename U>
+inline bool operator==(const txAllocator<T>& a, const txAllocator<U>& b)
+{
+  return a.source() == b.source();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const txAllocator<T>& a, const txAllocator<U>& b)
+{
+  return a.source() != b.source();
+}
+
 /*
   Implementation note: have removed the m_owner field, because (1) it was
   complicating the copy constructor and assignment operator, and (2) there was
@@ -174,11 +317,142 @@ class txField : public txItem
 };
 
 
-/* Keep things simpler by using map instead of multimap */
-typedef std::list< txItem* >                 ItemList;
-//typedef std::map<std::string, txItem*>       ItemMap;
-typedef std::map<std::string, txField*>      FieldMap;
-typedef std::map<std::string, txContainer*>  ChildMap;
+/* Items of a container, in the order added */
+typedef std::vector< txItem*, txAllocator<txItem*> > ItemList;
+
+/*
+ * The fields and the child containers of a txContainer, each in name order.
+ * A container builds its order when first iterated, and keeps it until the
+ * container changes; the order is shared by the container and its
+ * iterators, and deleted by the last to release it.
+ */
+class txNameOrder
+{
+  public:
+    static void hold(txNameOrder*);
+    static void release(txNameOrder*);
+
+    txItem* const* begin(bool container) const
+    {
+      const std::vector<txItem*>& v = container? m_children : m_fields;
+      return v.empty()? NULL : &v[0];
+    }
+    txItem* const* end(bool container) const
+    {
+      const std::vector<txItem*>& v = container? m_children : m_fields;
+      return begin(container) + v.size();
+    }
+
+  private:
+    txNameOrder() : m_refs(1) {}
+    txNameOrder(const txNameOrder&);
+    txNameOrder& operator=(const txNameOrder&);
+
+    int m_refs;  // changed atomically
+    std::vector<txItem*> m_fields;
+    std::vector<txItem*> m_children;
+
+    friend class txContainer;
+};
+
+/*
+ * Iterator over either the fields or the child containers of a txContainer,
+ * in name order.  It dereferences to a (name, item) pair, as did the
+ * iterators of the maps which containers formerly used, and visits items in
+ * the same order as they did.  Since items are held in the order added, it
+ * walks the name order kept by the container, holding it so that it
+ * outlives any change to the container.  Code which wants the order added,
+ * which is also the order encoded, should walk items().
+ */
+template <typename T, bool CONTAINER>
+class txKindIterator
+{
+  public:
+    typedef std::forward_iterator_tag      iterator_category;
+    typedef std::pair< std::string, T* >   value_type;
+    typedef ptrdiff_t                      difference_type;
+    typedef const value_type*              pointer;
+    typedef const value_type&              reference;
+
+    txKindIterator() : m_order(NULL), m_pos(NULL), m_end(NULL) {}
+
+    /* Begin iterating an order, taking over the caller's hold on it */
+    explicit txKindIterator(txNameOrder* order)
+      : m_order(order),
+        m_pos(order->begin(CONTAINER)),
+        m_end(order->end(CONTAINER))
+    {
+    }
+
+    txKindIterator(const txKindIterator& rhs)
+      : m_order(rhs.m_order), m_pos(rhs.m_pos), m_end(rhs.m_end)
+    {
+      if (m_order) txNameOrder::hold(m_order);
+    }
+
+    txKindIterator& operator=(const txKindIterator& rhs)
+    {
+      if (rhs.m_order) txNameOrder::hold(rhs.m_order);
+      if (m_order) txNameOrder::release(m_order);
+      m_order = rhs.m_order;
+      m_pos   = rhs.m_pos;
+      m_end   = rhs.m_end;
+      return *this;
+    }
+
+    ~txKindIterator() { if (m_order) txNameOrder::release(m_order); }
+
+    reference operator*() const
+    {
+      m_value.first  = (*m_pos)->name();
+      m_value.second = static_cast<T*>(*m_pos);
+      return m_value;
+    }
+    pointer operator->() const { return &(operator*()); }
+
+    txKindIterator& operator++() { ++m_pos; return *this; }
+    txKindIterator  operator++(int)
+    {
+      txKindIterator tmp(*this);
+      ++*this;
+      return tmp;
+    }
+
+    /* All ended iterators are equal, so that one begun over an empty range,
+     * or run to its end, compares equal to the end iterator */
+    bool operator==(const txKindIterator& rhs) const
+    {
+      if (at_end() or rhs.at_end()) return at_end() and rhs.at_end();
+      return m_pos == rhs.m_pos;
+    }
+    bool operator!=(const txKindIterator& rhs) const
+    {
+      return not (*this == rhs);
+    }
+
+  private:
+
+    bool at_end() const { return m_pos == m_end; }
+
+    txNameOrder*   m_order;
+    txItem* const* m_pos;
+    txItem* const* m_end;
+    mutable value_type m_value;
+};
+
+/* Named for the maps which once held fields and children, so that code
+ * using their iterator types still builds */
+struct FieldMap
+{
+    typedef txKindIterator<txField, false> iterator;
+    typedef iterator                       const_iterator;
+};
+
+struct ChildMap
+{
+    typedef txKindIterator<txContainer, true> iterator;
+    typedef iterator                          const_iterator;
+};
 
 /**
  * Container of data objects.  A container contains two sets of data: a
@@ -196,6 +470,15 @@ typedef std::map<std::string, txContainer*>  ChildMap;
  * Implemention notes
  * ~~~~~~~~~~~~~~~~~~
  *
+ * Items are held in a single vector, in the order added, alongside a vector
+ * of lookup keys: a hash of each item name, with the low bit marking a
+ * container.  A typical container has few items, so a lookup scans the keys
+ * and only compares names on a key match.  Once a container grows past
+ * INDEX_THRESHOLD items, a hash index of the keys is also kept.  The index
+ * is maintained by the methods which add and remove items, rather than
+ * built on first lookup, so that const lookups never modify the container
+ * and remain safe to make from several threads.
+ *
  * Currently the txContainer inherits from txItem.  This choice was motivated
  * for two reasons: (1) to share implementation details; (2) to treat fields &
  * containers in a generic manner.
@@ -218,11 +501,17 @@ class txContainer : public txItem
 
     txContainer();
     explicit txContainer(const std::string& name);
+    txContainer(const std::string& name, txArena*);
+
+    /* A copy is built on the heap; assignment keeps the target's arena */
     txContainer(const txContainer&);
     virtual txContainer* clone() const;
     txContainer & operator=(const txContainer &);
     void merge(const txContainer &);
 
+    /* Arena the items of this container are allocated from, or NULL */
+    txArena* arena() const { return m_arena; }
+
 
     ~txContainer();
 
@@ -255,12 +544,16 @@ class txContainer : public txItem
     bool check_field(const std::string& field, const std::string& value) const;
     bool check_field(const qname& field, const std::string& value) const;
 
-    // iterators
-    FieldMap::iterator field_begin() { return m_field_map.begin(); }
-    FieldMap::iterator field_end()   { return m_field_map.end(); }
-
-    FieldMap::const_iterator field_begin() const { return m_field_map.begin(); }
-    FieldMap::const_iterator field_end() const { return m_field_map.end(); }
+    // iterators, in name order
+    FieldMap::iterator field_begin() const
+    {
+      if (m_fields == 0) return FieldMap::iterator();
+      return FieldMap::iterator( name_order() );
+    }
+    FieldMap::iterator field_end() const
+    {
+      return FieldMap::iterator();
+    }
 
 
     /* ----- Operations on member Containers ----- */
@@ -281,12 +574,16 @@ class txContainer : public txItem
     const txContainer* find_child(const qname&) const;
 
 
-    // iterators
-    ChildMap::iterator child_begin()  { return m_child_map.begin(); }
-    ChildMap::iterator child_end()    { return m_child_map.end(); }
-
-    ChildMap::const_iterator child_begin() const { return m_child_map.begin(); }
-    ChildMap::const_iterator child_end() const { return m_child_map.end(); }
+    // iterators, in name order
+    ChildMap::iterator child_begin() const
+    {
+      if (m_items.size() == m_fields) return ChildMap::iterator();
+      return ChildMap::iterator( name_order() );
+    }
+    ChildMap::iterator child_end() const
+    {
+      return ChildMap::iterator();
+    }
 
     /* Other */
 
@@ -302,14 +599,44 @@ class txContainer : public txItem
 
   private:
 
+    typedef std::vector< uint32_t, txAllocator<uint32_t> > KeyList;
+
+    static const size_t INDEX_THRESHOLD = 16;
+    static const size_t npos = (size_t)-1;
+
+    static uint32_t key_of(const std::string& name, bool container);
+
+    size_t find_item(const std::string& name, bool container) const;
+    void   erase_item(size_t pos);
+    void   index_item(size_t pos);
+    void   rebuild_index();
+
     void add_internally(txItem * f);
 
+    /* The name order of the items, built if need be, and held for the
+     * caller.  Const readers may build it concurrently; it is dropped by any
+     * change to the items. */
+    txNameOrder* name_order() const;
+    void drop_name_order();
+
+    txField*     new_field(const std::string&, const std::string&);
+    txContainer* new_child(const std::string&);
+    txItem*      copy_item(const txItem&);
+    void         destroy(txItem*);
+
+    /* Only permitted while empty */
+    void arena(txArena*);
+
+    txArena* m_arena;
+
     // Preserve the order in which each Item was added
     ItemList m_items;
+    KeyList  m_keys;    // lookup key of each item
+    KeyList  m_index;   // open addressed, item position + 1, or 0 if free
+    size_t   m_fields;  // number of items which are fields
+    mutable txNameOrder* m_order;  // or NULL until iterated
 
-//    ItemMap   m_item_map;
-    FieldMap  m_field_map;
-    ChildMap  m_child_map;
+    friend class txMessage;
 };
 
 
@@ -321,6 +648,15 @@ class txMessage
     txMessage() {}
     explicit txMessage(const std::string& type);
 
+    /* Message whose nodes are allocated from 'arena', which must outlive it.
+     * Copies of the message are built on the heap. */
+    txMessage(const std::string& type, txArena* arena);
+
+    /* Place an empty message on an arena, or back on the heap if NULL.
+     * Throws if the message is not empty. */
+    void arena(txArena*);
+    txArena* arena() const { return m_root.arena(); }
+
     txContainer& root()             { return m_root; }
     const txContainer& root() const { return m_root; }
 
@@ -337,6 +673,77 @@ class txMessage
 
 //----------------------------------------------------------------------
 
+/**
+ * Flat, read-only view of a decoded message, produced by
+ * SAMProtocol::decodeView.  Fields and containers are held in a single array
+ * in encoded order, each container being followed by its contents.  Names and
+ * values point directly into the decoded bytes, which must outlive the view.
+ * Only a string which contained escape characters is copied, unescaped, into
+ * storage owned by the view.
+ *
+ * A view can be reused for successive decodes, retaining its storage, so
+ * that once warmed up, decoding performs no allocation.
+ */
+class txView
+{
+  public:
+
+    struct Str
+    {
+        const char* ptr;
+        size_t      len;
+
+        std::string str() const { return std::string(ptr, len); }
+        bool operator==(const char*) const;
+    };
+
+    struct Item
+    {
+        Str    name;
+        Str    value;      // empty for a container
+        size_t parent;     // enclosing container, or npos for the top level
+        size_t end;        // one past the last item contained, if a container
+        bool   container;
+    };
+
+    static const size_t npos = (size_t)-1;
+
+    txView();
+
+    const Str&  type() const { return m_type; }
+
+    size_t size() const { return m_items.size(); }
+    bool   empty() const { return m_items.empty(); }
+
+    const Item& operator[](size_t i) const { return m_items[i]; }
+
+    /* Search the members of a container, or of the top level if container is
+     * npos.  If a name is repeated, the last is found, matching the
+     * overwrite semantics of txContainer.  Return npos if not found. */
+    size_t find_field(size_t container, const char* name) const;
+    size_t find_child(size_t container, const char* name) const;
+    size_t find_field(const qname&) const;
+
+    /* Build the equivalent txMessage, for code which uses containers */
+    void copy_to(txMessage&) const;
+
+    void clear();
+
+  private:
+
+    size_t find(size_t container, const char* name, bool container_wanted) const;
+    void copy_items(txContainer&, size_t begin, size_t end) const;
+
+    Str               m_type;
+    std::vector<Item> m_items;
+    std::string       m_unescaped;  // reserved up front, so never reallocated
+                                    // while items point into it
+
+    friend class SAMProtocol;
+};
+
+//----------------------------------------------------------------------
+
 struct qname_builder
 {
     qname_builder& operator,(const std::string&s)
@@ -482,16 +889,84 @@ class OverFlow : public std::exception
 //----------------------------------------------------------------------
 
 
+/*
+ * Names which the binary encoding sends as ids.  Ids are assigned in order of
+ * first use, and a single dictionary is shared by all encoders in the
+ * process, so that a message encoded once can be queued to many sessions.
+ * Each session sends its peer the names it has not yet defined, ahead of the
+ * first message which uses them.  Long names, and names beyond the capacity,
+ * are not added, and are encoded in full.  Thread safe: finding a name
+ * already held takes no lock, only adding a name does.
+ *
+ * Names are never removed, since any session may yet need them, so the
+ * capacity bounds both the memory held, which is allocated up front, and the
+ * names a new session is sent.
+ * The global dictionary holds GLOBAL_NAMES; column and field names are
+ * usually first seen early, so it is the later, rarer names which go
+ * without ids.
+ */
+class txNameDict
+{
+  public:
+    static const size_t npos = (size_t)-1;
+    static const size_t MAX_NAMES    = 65536;  // most a peer may define
+    static const size_t MAX_NAME_LEN = 64;
+    static const size_t GLOBAL_NAMES = 4096;
+
+    explicit txNameDict(size_t capacity);
+    ~txNameDict();
+
+    /* Id of a name, adding it if new.  Returns npos if the name is not in
+     * the dictionary and cannot be added. */
+    size_t lookup(const std::string&);
+
+    size_t size() const;
+
+    /* Append the names with ids in [first, last) to dest */
+    void names(size_t first, size_t last, std::vector<std::string>& dest) const;
+
+    /* The dictionary used by SAMProtocol::encodeBinary */
+    static txNameDict& global();
+
+  private:
+    txNameDict(const txNameDict&);
+    txNameDict& operator=(const txNameDict&);
+
+    struct Impl;
+    Impl* m_impl;
+};
+
+//----------------------------------------------------------------------
+
 class SAMProtocol
 {
   public:
 
-    SAMProtocol(exio::AppSvc& appsvc); // TODO: should only need logsvc
+    /* The streaming encoding writes 'stream' format; encodeMsg and
+     * encodeBinary are fixed to theirs. */
+    SAMProtocol(exio::AppSvc& appsvc, // TODO: should only need logsvc
+                WireFormat stream = eTextFormat);
 
     /* Attempt to encode the message into the buffer provided. The buffer will
      * expand as required. */
     size_t encodeMsg(const txMessage& msg, exio::SamBuffer* sbuf);
 
+    /* Streaming encoding, for building a message one item at a time without
+     * first assembling a txMessage.  encode_begin writes the message type
+     * and opens the root container; encode_open and encode_close bracket a
+     * child container; encode_end closes the root and writes the header,
+     * returning the message size.  Until encode_end, the buffer msg_size()
+     * is the number of body bytes encoded so far, so a caller can stop at an
+     * item boundary.  A binary message needs the peer to have been sent its
+     * names, as for encodeBinary. */
+    void   encode_begin(exio::SamBuffer*, const std::string& msgtype);
+    void   encode_open(exio::SamBuffer*, const std::string& name);
+    void   encode_field(exio::SamBuffer*, const std::string& name,
+                        const std::string& value);
+    void   encode_child(exio::SamBuffer*, const txContainer& child);
+    void   encode_close(exio::SamBuffer*);
+    size_t encode_end(exio::SamBuffer*);
+
     /* Attempt to encode the message into the buffer provided. If there is not
      * enought room in the buffer, or the message size exceeds the SAM
      * limit, an OverFlow exception is thrown. */
@@ -524,12 +999,60 @@ class SAMProtocol
      */
     size_t decodeMsg(txMessage& msg, const char* start, size_t len);
 
+    /* As decodeMsg, but decodes to a flat view over the input bytes, rather
+     * than building a container tree.  The view is only valid while the
+     * bytes decoded remain unchanged.  It is left empty if the SAM version
+     * is not supported. */
+    size_t decodeView(txView& view, const char* start, size_t len);
+
+    /* As decodeView, setting 'decoded' false if the bytes consumed carried
+     * no message, such as a dictionary frame or an unsupported version. */
+    size_t decodeView(txView& view, const char* start, size_t len,
+                      bool& decoded);
+
+    /* Encode as a SAM0200 binary message, with names from the global
+     * dictionary.  The peer must first be sent the names the message
+     * requires; see names_required and encode_names. */
+    size_t encodeBinary(const txMessage& msg, exio::SamBuffer* sbuf);
+
+    /* Encode a SAM0201 frame defining the global dictionary names with ids
+     * in [first, last) */
+    size_t encode_names(exio::SamBuffer* sbuf, size_t first, size_t last);
+
+    /* Number of dictionary names an encoded SAM0200 message requires the
+     * peer to have been sent; 0 for any other message */
+    static size_t names_required(const char* start, size_t len);
+
+    /* Decoding is resumable.  When the input holds the header of a message
+     * but not all of its bytes, the message length is remembered, and
+     * returned here; later calls return 0 without rescanning the header
+     * until that many bytes are available.  This assumes each call presents
+     * the input from the start of the same message, as a stream reader does;
+     * it is reset once a message is decoded.  Returns 0 if no incomplete
+     * message is pending. */
+    size_t pending_length() const { return m_pending; }
+
     static bool isSpecialChar(char c);
 
   private:
-    const char* decode(txContainer* parent, const char* p, const char* end);
+    size_t read_header(const char* start, size_t len, const char*& body,
+                       bool& supported);
+    size_t decode_view(txView&, const char* start, size_t len, bool& decoded);
+    const char* decode(txView&, size_t parent, const char* p, const char* end);
+    const char* scan_str(txView&, const char* p, const char* end, char delim,
+                         txView::Str& dest);
     void fail(const char* error);
 
+    const char* decode_binary(txView&, size_t parent, const char* p,
+                              const char* end);
+    const char* read_name(const char* p, const char* end, bool is_id,
+                          txView::Str& dest);
+    void decode_names(const char* p, const char* end);
+    void encode_binary_items(exio::SamBuffer*, const txContainer*,
+                             txNameDict&);
+    static void encode_binary_name(exio::SamBuffer*, unsigned char op,
+                                   const std::string& name, txNameDict&);
+
     static void write_str(exio::SamBuffer*, const std::string & str);
     static void write_str_calc(const std::string str, size_t & n);
 
@@ -549,9 +1072,16 @@ class SAMProtocol
     }
 
     void encode_contents(exio::SamBuffer*, const txContainer* msg);
+    void encode_items(exio::SamBuffer*, const txContainer* msg);
     void encode_contents_calc(const txContainer* msg, size_t& n);
 
     exio::AppSvc& m_appsvc;
+    WireFormat m_stream;  // format of the streaming encoding
+    size_t m_pending;  // length of incomplete message, or 0
+
+    // names defined by the peer's SAM0201 frames, indexed by id; a deque,
+    // so that decoded views can point into the names as more are added
+    std::deque<std::string> m_names;
 };
 
 // inline bool txContainer::has_any(const std::string& f)   const
@@ -577,12 +1107,12 @@ inline size_t txContainer::count_any()    const
 
 inline size_t txContainer::count_field()  const
 {
-  return m_field_map.size();
+  return m_fields;
 }
 
 inline size_t txContainer::count_child()  const
 {
-  return m_child_map.size();
+  return m_items.size() - m_fields;
 }
 
 inline size_t txContainer::size() const
@@ -23,6 +23,8 @@
 #include <string>
 #include <vector>
 
+#include <stdint.h>
+
 namespace exio {
 namespace utils {
 
@@ -38,12 +40,22 @@ namespace utils {
   /* Convert integer to string */
   std::string to_str(int);
 
+  /* Format numbers as text, without iostreams.  Each writes to buf, which
+   * must have room for 32 chars, and returns the length written.  Doubles
+   * are written in the shortest form, of up to 17 significant digits, that
+   * reads back as the same value. */
+  size_t format_int64(int64_t, char* buf);
+  size_t format_double(double, char* buf);
+
   /* wrapper for strerr */
   std::string strerror(int __errno);
 
   /* date-timestamp */
   std::string datetimestamp(time_t now_secs);
 
+  /* date-timestamp, in the format used for the RowLastUpdated field */
+  std::string row_timestamp(time_t now_secs);
+
 
 }} // namespace
 
@@ -21,11 +21,19 @@
 #include "exio/Logger.h"
 #include "exio/utils.h"
 #include "exio/SamBuffer.h"
+#include "exio/SamScan.h"
 #include "exio/AppSvc.h"
 
+#include "mutex.h"
+#include "atomic.h"
+
+#include <tr1/functional>
+
 #include <string.h>
 #include <stdio.h>
+#include <algorithm>
 #include <sstream>
+#include <new>
 #include <math.h>
 
 
@@ -69,6 +77,75 @@ namespace /* unnamed namespace for internal linkage*/
     }
   }
 
+  /* SAM0200 item opcodes.  The name after an opcode with BIN_NAME_ID set is
+   * a dictionary id, otherwise it is a string. */
+  const unsigned char BIN_END     = 0;
+  const unsigned char BIN_FIELD   = 1;
+  const unsigned char BIN_CHILD   = 2;
+  const unsigned char BIN_NAME_ID = 4;
+
+  /* Lengths and ids are written as varints, 7 bits per byte, low bits
+   * first, with the top bit set on all but the last byte. */
+  void put_varint(exio::SamBuffer* sb, size_t n)
+  {
+    char buf[10];
+    size_t i = 0;
+    while (n >= 0x80)
+    {
+      buf[i++] = (char)((n bitand 0x7F) bitor 0x80);
+      n >>= 7;
+    }
+    buf[i++] = (char) n;
+    sb->append(buf, i);
+  }
+
+  void put_bytes(exio::SamBuffer* sb, const std::string& str)
+  {
+    put_varint(sb, str.size());
+    sb->append(str.data(), str.size());
+  }
+
+  const char* get_varint(const char* p, const char* end, size_t& n)
+  {
+    n = 0;
+    for (int shift = 0; p < end and shift < 64; shift += 7)
+    {
+      unsigned char const c = *p++;
+      n |= (size_t)(c bitand 0x7F) << shift;
+      if ((c bitand 0x80) == 0) return p;
+    }
+    throw std::runtime_error("SAM0200 bad length");
+  }
+
+  const char* get_bytes(const char* p, const char* end,
+                        sam::txView::Str& dest)
+  {
+    size_t len;
+    p = get_varint(p, end, len);
+    if (len > (size_t)(end - p))
+      throw std::runtime_error("SAM0200 string exceeds message");
+    dest.ptr = p;
+    dest.len = len;
+    return p + len;
+  }
+
+  /* The number of dictionary names required ends a SAM0200 message, as four
+   * bytes, least significant first, so it can be written once the items
+   * have been encoded. */
+  void put_uint32(exio::SamBuffer* sb, size_t n)
+  {
+    char buf[4];
+    for (int i = 0; i < 4; ++i) buf[i] = (char)(n >> (8*i));
+    sb->append(buf, 4);
+  }
+
+  size_t get_uint32(const char* p)
+  {
+    size_t n = 0;
+    for (int i = 3; i >= 0; --i) n = (n << 8) bitor (unsigned char) p[i];
+    return n;
+  }
+
 } // namespace
 
 namespace sam
@@ -104,8 +181,10 @@ qname qname::parse(const char * src)
 }
 
 //======================================================================
-SAMProtocol::SAMProtocol(exio::AppSvc& appsvc)
-  : m_appsvc(appsvc)
+SAMProtocol::SAMProtocol(exio::AppSvc& appsvc, WireFormat stream)
+  : m_appsvc(appsvc),
+    m_stream(stream),
+    m_pending(0)
 {
 }
 //----------------------------------------------------------------------
@@ -114,77 +193,36 @@ void SAMProtocol::write_str(exio::SamBuffer* sb, const std::string & str)
   /* WARNING: any changes to the encoding must be reflected in the
    * corresponding _calc method. */
 
-  /* Search for a special character.
-
-     size_t strcspn(const char *s, const char *reject);
-
-     The strcspn() function calculates the length of the initial segment of s
-     which consists entirely of characters not in reject.
-  */
-
-  const char*  src    = str.c_str();
-  size_t const len    = str.size();
-  size_t const accept = strcspn(src, sam::SPECIAL_CHARS);
+  const char*       src = str.data();
+  const char* const end = src + str.size();
 
-  if (accept == len)
-  {
-    // no special characters - yay!
-    sb->append(src, len);
-  }
-  else
+  // copy the runs between special characters, escaping each special
+  while (true)
   {
-    sb->append(src, accept);
-    src  += accept;
+    const char* special = sam::find_special(src, end);
+    sb->append(src, special - src);
 
-    // now write out the region containing special chars, which has to be done
-    // character by character
-    for (size_t i = 0; i < (len-accept); ++i)
-    {
-      if ( SAMProtocol::isSpecialChar(*src) )
-      {
-        sb->append( sam::ESCAPE );
-      }
+    if (special == end) break;
 
-      sb->append( *src++ );
-    }
+    sb->append( sam::ESCAPE );
+    sb->append( *special );
+    src = special + 1;
   }
 }
 
 //----------------------------------------------------------------------
 void SAMProtocol::write_str_calc(const std::string str, size_t & n)
 {
-  /* Search for a special character.
+  const char*       src = str.data();
+  const char* const end = src + str.size();
 
-     size_t strcspn(const char *s, const char *reject);
+  n += str.size();
 
-     The strcspn() function calculates the length of the initial segment of s
-     which consists entirely of characters not in reject.
-  */
-
-  const char*  src    = str.c_str();
-  size_t const len    = str.size();
-  size_t const accept = strcspn(src, sam::SPECIAL_CHARS);
-
-  if (accept == len)
-  {
-    // no special characters - yay!
-    n += len;
-  }
-  else
+  // each special character is preceded by an escape
+  while ((src = sam::find_special(src, end)) != end)
   {
-    n   += accept;  // simulate the write
-    src += accept;
-
-    // now write out the region containing special chars, which has to be done
-    // character by character
-    for (size_t i = 0; i < (len-accept); ++i)
-    {
-      if ( SAMProtocol::isSpecialChar(*src) )
-      {
-        ++n;
-      }
-      n++; src++;
-    }
+    ++n;
+    ++src;
   }
 }
 
@@ -226,23 +264,9 @@ size_t SAMProtocol::encodeMsg(const txMessage& msg,
   /* WARNING: any changes to the encoding must be reflected in the
    * corresponding _calc method. */
 
-  // start encoding from the message type
-  SAMProtocol::write_noescape(sb, META_DELIM);
-  SAMProtocol::write_noescape(sb, msg.type().c_str(), msg.type().length());
-  SAMProtocol::write_noescape(sb, META_DELIM);
-
-  encode_contents(sb, &( msg.root() ));
-
-  SAMProtocol::write_noescape(sb, MSG_END);
-  SAMProtocol::write_noescape(sb, MSG_DELIM);
-
-//  *p = '\0';
-
-  // write the remaining part of the Sam header
-  sb->encode_header();
-
-  size_t bytes = sb->msg_size();
-  return bytes;
+  encode_begin(sb, msg.type());
+  encode_items(sb, &( msg.root() ));
+  return encode_end(sb);
 
 
 //--
@@ -277,6 +301,101 @@ size_t SAMProtocol::encodeMsg(const txMessage& msg,
 //   return bytes;
 }
 
+//----------------------------------------------------------------------
+void SAMProtocol::encode_begin(exio::SamBuffer* sb, const std::string& msgtype)
+{
+  if (m_stream == eBinaryFormat)
+  {
+    SAMProtocol::write_noescape(sb, META_DELIM);  // ends the header
+    put_bytes(sb, msgtype);
+    return;
+  }
+
+  // start encoding from the message type
+  SAMProtocol::write_noescape(sb, META_DELIM);
+  SAMProtocol::write_noescape(sb, msgtype.c_str(), msgtype.length());
+  SAMProtocol::write_noescape(sb, META_DELIM);
+
+  SAMProtocol::write_noescape(sb, SEQ_START);
+}
+//----------------------------------------------------------------------
+void SAMProtocol::encode_open(exio::SamBuffer* sb, const std::string& name)
+{
+  if (m_stream == eBinaryFormat)
+  {
+    encode_binary_name(sb, BIN_CHILD, name, txNameDict::global());
+    return;
+  }
+
+  SAMProtocol::write_noescape(sb, name.c_str(), name.length());
+  SAMProtocol::write_noescape(sb, VALUE_DELIM);
+  SAMProtocol::write_noescape(sb, SEQ_START);
+}
+//----------------------------------------------------------------------
+void SAMProtocol::encode_field(exio::SamBuffer* sb,
+                               const std::string& name,
+                               const std::string& value)
+{
+  if (m_stream == eBinaryFormat)
+  {
+    encode_binary_name(sb, BIN_FIELD, name, txNameDict::global());
+    put_bytes(sb, value);
+    return;
+  }
+
+  SAMProtocol::write_noescape(sb, name.c_str(), name.length());
+  SAMProtocol::write_noescape(sb, VALUE_DELIM);
+  SAMProtocol::write_str(sb, value);
+  SAMProtocol::write_noescape(sb, FIELD_DELIM);
+}
+//----------------------------------------------------------------------
+void SAMProtocol::encode_child(exio::SamBuffer* sb, const txContainer& child)
+{
+  if (m_stream == eBinaryFormat)
+  {
+    txNameDict& dict = txNameDict::global();
+    encode_binary_name(sb, BIN_CHILD, child.name(), dict);
+    encode_binary_items(sb, &child, dict);
+    return;
+  }
+
+  SAMProtocol::write_noescape(sb, child.name().c_str(), child.name().length());
+  SAMProtocol::write_noescape(sb, VALUE_DELIM);
+  encode_contents(sb, &child);
+  SAMProtocol::write_noescape(sb, FIELD_DELIM);
+}
+//----------------------------------------------------------------------
+void SAMProtocol::encode_close(exio::SamBuffer* sb)
+{
+  if (m_stream == eBinaryFormat)
+  {
+    sb->append( (char) BIN_END );
+    return;
+  }
+
+  SAMProtocol::write_noescape(sb, SEQ_END);
+  SAMProtocol::write_noescape(sb, FIELD_DELIM);
+}
+//----------------------------------------------------------------------
+size_t SAMProtocol::encode_end(exio::SamBuffer* sb)
+{
+  if (m_stream == eBinaryFormat)
+  {
+    sb->append( (char) BIN_END );
+    put_uint32(sb, txNameDict::global().size());  // as in encodeBinary
+    sb->encode_header(SAM0200);
+    return sb->msg_size();
+  }
+
+  SAMProtocol::write_noescape(sb, SEQ_END);
+  SAMProtocol::write_noescape(sb, MSG_END);
+  SAMProtocol::write_noescape(sb, MSG_DELIM);
+
+  // write the remaining part of the Sam header
+  sb->encode_header();
+
+  return sb->msg_size();
+}
 //----------------------------------------------------------------------
 size_t SAMProtocol::calc_encoded_size(const txMessage& msg)
 {
@@ -332,6 +451,13 @@ void SAMProtocol::encode_contents(exio::SamBuffer* sb, const txContainer* c)
    * corresponding _calc method. */
 
   SAMProtocol::write_noescape(sb, SEQ_START);
+  encode_items(sb, c);
+  SAMProtocol::write_noescape(sb, SEQ_END);
+}
+
+//----------------------------------------------------------------------
+void SAMProtocol::encode_items(exio::SamBuffer* sb, const txContainer* c)
+{
   for (ItemList::const_iterator iter = c -> items().begin();
        iter != c -> items().end(); ++iter)
   {
@@ -349,8 +475,90 @@ void SAMProtocol::encode_contents(exio::SamBuffer* sb, const txContainer* c)
     }
     SAMProtocol::write_noescape(sb, FIELD_DELIM);
   }
+}
 
-  SAMProtocol::write_noescape(sb, SEQ_END);
+//----------------------------------------------------------------------
+size_t SAMProtocol::encodeBinary(const txMessage& msg, exio::SamBuffer* sb)
+{
+  txNameDict& dict = txNameDict::global();
+
+  SAMProtocol::write_noescape(sb, META_DELIM);  // ends the header
+  put_bytes(sb, msg.type());
+  encode_binary_items(sb, &( msg.root() ), dict);
+
+  // Ids are only ever added, so every id used is below the dictionary size
+  // as it stands now
+  put_uint32(sb, dict.size());
+
+  sb->encode_header(SAM0200);
+  return sb->msg_size();
+}
+
+//----------------------------------------------------------------------
+void SAMProtocol::encode_binary_items(exio::SamBuffer* sb,
+                                      const txContainer* c,
+                                      txNameDict& dict)
+{
+  for (ItemList::const_iterator iter = c -> items().begin();
+       iter != c -> items().end(); ++iter)
+  {
+    const txContainer* child = (*iter)->asContainer();
+    encode_binary_name(sb, child? BIN_CHILD : BIN_FIELD, (*iter)->name(), dict);
+
+    if (child)
+    {
+      encode_binary_items(sb, child, dict);
+    }
+    else if ( const txField* field = (*iter)->asField() )
+    {
+      put_bytes(sb, field->value());
+    }
+  }
+
+  sb->append( (char) BIN_END );
+}
+
+//----------------------------------------------------------------------
+void SAMProtocol::encode_binary_name(exio::SamBuffer* sb, unsigned char op,
+                                     const std::string& name,
+                                     txNameDict& dict)
+{
+  size_t const id = dict.lookup(name);
+  if (id != txNameDict::npos)
+  {
+    sb->append( (char)(op bitor BIN_NAME_ID) );
+    put_varint(sb, id);
+  }
+  else
+  {
+    sb->append( (char) op );
+    put_bytes(sb, name);
+  }
+}
+
+//----------------------------------------------------------------------
+size_t SAMProtocol::encode_names(exio::SamBuffer* sb,
+                                 size_t first, size_t last)
+{
+  std::vector<std::string> names;
+  txNameDict::global().names(first, last, names);
+
+  SAMProtocol::write_noescape(sb, META_DELIM);  // ends the header
+  put_varint(sb, first);
+  put_varint(sb, names.size());
+  for (size_t i = 0; i < names.size(); ++i) put_bytes(sb, names[i]);
+
+  sb->encode_header(SAM0201);
+  return sb->msg_size();
+}
+
+//----------------------------------------------------------------------
+size_t SAMProtocol::names_required(const char* start, size_t len)
+{
+  size_t const head_len = 1 + 7 + 1;  // {SAM0200:
+  if (len < head_len + 4 or memcmp(start+1, SAM0200, 7) != 0) return 0;
+
+  return get_uint32(start + len - 4);
 }
 
 //----------------------------------------------------------------------
@@ -380,9 +588,10 @@ void SAMProtocol::encode_contents_calc(const txContainer* c, size_t& n)
 }
 
 //----------------------------------------------------------------------
-size_t SAMProtocol::decodeMsg(txMessage& msg,
-                              const char* start,
-                              size_t len )
+size_t SAMProtocol::read_header(const char* start,
+                                size_t len,
+                                const char*& body,
+                                bool& supported)
 {
   const char* const end = start + len;
 
@@ -391,115 +600,230 @@ size_t SAMProtocol::decodeMsg(txMessage& msg,
   // Define max message len as approx 2G 2147483647.
   static size_t max_msglen = 2147483647;
 
-  size_t consumed = 0;
+  if (start >= end) return 0;
 
-  if (start < end)
+  size_t bytesavail = end - start;
+
+  /* Check we have enough bytes for the message length section. Note that
+   * here we don't know how many bytes are used for the msg length. So we
+   * only detect the SAM type. */
+  size_t const head_len = 1 + 7 + 1 ; //   {SAM0100:
+  if (bytesavail < head_len ) return 0;
+
+  if ((*start != MSG_START) or (start[8] != META_DELIM))
   {
-    size_t bytesavail = end - start;
+    throw std::runtime_error("bad SAM header");
+  }
 
-    /* Check we have enough bytes for the message length section. Note that
-     * here we don't know how many bytes are used for the msg length. So we
-     * only detect the SAM type. */
-    size_t const head_len = 1 + 7 + 1 ; //   {SAM0100:
-    if (bytesavail < head_len ) return 0;
+  supported = false;
+  if ( memcmp(start+1,SAM0100,7) == 0)
+  {
+    supported = true;
+  }
+  else if ( memcmp(start+1,SAM0101,7) == 0 )
+  {
+    supported = true;
+  }
+  else if ( memcmp(start+1,SAM0200,7) == 0 or
+            memcmp(start+1,SAM0201,7) == 0 )
+  {
+    supported = true;
+  }
 
-    if ((*start != MSG_START) or (start[8] != META_DELIM))
-    {
-      throw std::runtime_error("bad SAM header");
-    }
+  /* Example SAM headers
+     ~~~~~~~~~~~~~~~~~~~
 
-    bool sam_ver_supported = false;
-    if ( memcmp(start+1,SAM0100,7) == 0)
-    {
-      sam_ver_supported = true;
-    }
-    else if ( memcmp(start+1,SAM0101,7) == 0 )
+     {SAM0100:00065:request:[head=[command=,],body=[args_COUNT=0,],]}
+     {SAM0101:2147483647:x:
+     01234567890123
+  */
+
+
+  /* Decode the message length, without making any assumption about how many
+   * bytes are used for the msglen section. */
+  const char* p = start + head_len;
+  size_t msglen = 0;
+
+  while (p < end and isdigit(*p))
+  {
+    msglen = (msglen * 10) + (*p bitand 0x0F);
+
+    // protect our application by assuming a max message size
+    if (msglen > max_msglen)
     {
-      sam_ver_supported = true;
+      throw std::runtime_error("SAM message exceeds maximum length");
     }
 
-    /* Example SAM headers
-       ~~~~~~~~~~~~~~~~~~~
+    p++;
+  }
 
-       {SAM0100:00065:request:[head=[command=,],body=[args_COUNT=0,],]}
-       {SAM0101:2147483647:x:
-       01234567890123
-    */
+  if (p >= end) return 0; // not enough data for msglen
 
 
-    /* Decode the message length, without making any assumption about how many
-     * bytes are used for the msglen section. */
-    const char* p = start + head_len;
-    size_t msglen = 0;
+  if (*p != sam::META_DELIM)
+    throw std::runtime_error("SAM header bad msglen");
 
-    while (p < end and isdigit(*p))
-    {
-      msglen = (msglen * 10) + (*p bitand 0x0F);
+  if (bytesavail < msglen)
+  {
+    m_pending = msglen;  // not enough data for body
+    return 0;
+  }
 
-      // protect our application by assuming a max message size
-      if (msglen > max_msglen)
-      {
-        throw std::runtime_error("SAM message exceeds maximum length");
-      }
+  m_pending = 0;
+  body = p + 1;  // skip META_DELIM
 
-      p++;
-    }
+  return msglen;
+}
 
-    if (p >= end) return 0; // not enough data for msglen
+//----------------------------------------------------------------------
+size_t SAMProtocol::decodeMsg(txMessage& msg,
+                              const char* start,
+                              size_t len )
+{
+  // Decode to a view, and then copy out into the container tree
+  txView view;
+  bool decoded = false;
+  size_t consumed = decode_view(view, start, len, decoded);
 
+  if (decoded) view.copy_to(msg);
 
-    if (*p != sam::META_DELIM)
-      throw std::runtime_error("SAM header bad msglen");
+  return consumed;
+}
 
-    const char* const msgend = start + msglen;
+//----------------------------------------------------------------------
+size_t SAMProtocol::decodeView(txView& view,
+                               const char* start,
+                               size_t len )
+{
+  bool decoded;
+  return decode_view(view, start, len, decoded);
+}
 
-    if (bytesavail < msglen) return 0; // not enough data for body
+//----------------------------------------------------------------------
+size_t SAMProtocol::decodeView(txView& view,
+                               const char* start,
+                               size_t len,
+                               bool& decoded)
+{
+  return decode_view(view, start, len, decoded);
+}
 
-    if (sam_ver_supported)
-    {
-      p++;  // skip META_DELIM
+//----------------------------------------------------------------------
+size_t SAMProtocol::decode_view(txView& view,
+                                const char* start,
+                                size_t len,
+                                bool& decoded)
+{
+  const char* p = NULL;
+  bool supported = false;
 
-      // Extract message name
-      std::string vs;
-      vs.reserve(50);
+  decoded = false;
 
-      while (p < msgend and *p != sam::META_DELIM)
-      {
-        if (*p == sam::ESCAPE) p++;
-        if (p < msgend) vs.append(1, *p);
-        p++;
-      }
+  // still waiting for the rest of a message whose header has been read
+  if (len < m_pending) return 0;
 
-      if (p >= msgend or *p != sam::META_DELIM)
-        throw std::runtime_error("SAM header missing message type");
+  size_t msglen = read_header(start, len, p, supported);
 
-      p++;  // skip META_DELIM
+  if (msglen == 0) return 0;
 
-      msg.reset();
-      msg.type(vs);
+  view.clear();
 
-      decode(&(msg.root()), p, msgend);
-    }
-    else
-    {
-      std::string samheader(start+1, 7);
-      _WARN_(m_appsvc.log(), "Unsupported SAM format, \"" << samheader << '"');
-    }
+  if (supported and memcmp(start+1, SAM0201, 7) == 0)
+  {
+    decode_names(p, start + msglen);
+  }
+  else if (supported and memcmp(start+1, SAM0200, 7) == 0)
+  {
+    const char* const msgend = start + msglen;
 
-    consumed += msglen;
+    if (msgend - p < 4) fail("SAM0200 message too short");
+    if (get_uint32(msgend - 4) > m_names.size())
+      fail("SAM0200 message requires names not yet defined");
+
+    p = get_bytes(p, msgend, view.m_type);
+    p = decode_binary(view, txView::npos, p, msgend - 4);
+    if (p != msgend - 4) fail("SAM0200 message has trailing data");
+    decoded = true;
   }
+  else if (supported)
+  {
+    const char* const msgend = start + msglen;
 
-  return consumed;
+    // Unescaped strings are never longer than the message, so by reserving
+    // that much now, the strings already pointing into m_unescaped remain
+    // valid as more are added.
+    view.m_unescaped.reserve(msglen);
+
+    // Extract message name
+    p = scan_str(view, p, msgend, sam::META_DELIM, view.m_type);
+
+    if (p >= msgend or *p != sam::META_DELIM)
+      throw std::runtime_error("SAM header missing message type");
+
+    p++;  // skip META_DELIM
+
+    decode(view, txView::npos, p, msgend);
+    decoded = true;
+  }
+  else
+  {
+    std::string samheader(start+1, 7);
+    _WARN_(m_appsvc.log(), "Unsupported SAM format, \"" << samheader << '"');
+  }
+
+  return msglen;
 }
 
+//----------------------------------------------------------------------
+/**
+ * Scan a string which ends at the delimiter, or at 'end'.  Returns a pointer
+ * to the delimiter.  The string is referred to in place, unless it contains
+ * escapes, in which case it is unescaped into the view's storage.
+ */
+const char* SAMProtocol::scan_str(txView& view,
+                                  const char* p,
+                                  const char* end,
+                                  char delim,
+                                  txView::Str& dest)
+{
+  const char* const begin = p;
+
+  p = sam::find_either(p, end, delim, sam::ESCAPE);
+
+  if (p >= end or *p == delim)
+  {
+    dest.ptr = begin;
+    dest.len = p - begin;
+    return p;
+  }
+
+  std::string& buf = view.m_unescaped;
+  size_t const offset = buf.size();
+  buf.append(begin, p - begin);
+
+  // p is at an escape; copy the escaped character, then the run up to the
+  // next escape or delimiter
+  while (p < end and *p == sam::ESCAPE)
+  {
+    if (++p >= end) break;
+    const char* run = p++;
+    p = sam::find_either(p, end, delim, sam::ESCAPE);
+    buf.append(run, p - run);
+  }
+
+  dest.ptr = buf.data() + offset;
+  dest.len = buf.size() - offset;
+  return p;
+}
 
+//----------------------------------------------------------------------
 /**
- * Decode the raw bytes, storing data inside the container.  The
- * next byte to decode is at position 'p', and 'p' is valid if p <
- * end. The next byte should be SEQ_P.  Returns a pointer to the
- * next byte of unparsed data.
+ * Decode the raw bytes, appending items to the view.  The next byte to
+ * decode is at position 'p', and 'p' is valid if p < end. The next byte
+ * should be SEQ_P.  Returns a pointer to the next byte of unparsed data.
  */
-const char* SAMProtocol::decode(txContainer* parent,
+const char* SAMProtocol::decode(txView& view,
+                                size_t parent,
                                 const char* p,
                                 const char* end)
 {
@@ -509,99 +833,431 @@ const char* SAMProtocol::decode(txContainer* parent,
   {
     if ( *p == sam::SEQ_END) return ++p; // this container done
 
+    // note: refer to the item by index, since the recursive decode of a
+    // container appends further items
+    size_t const index = view.m_items.size();
+
+    txView::Item item;
+    item.parent    = parent;
+    item.end       = index + 1;
+    item.container = false;
+    item.value.ptr = p;
+    item.value.len = 0;
+
     /* ----- decode fieldname ----- */
 
-    std::string fieldname;
-    fieldname.reserve(50);
+    p = scan_str(view, p, end, sam::VALUE_DELIM, item.name);
+
+    if (p >= end) fail("ran out of data, expected field-value-delim");
+    if (*p != sam::VALUE_DELIM) fail("failed to find field-value-delim");
+
+    p++; // skip the VALUE_DELIM
+
+    /* ----- decode field-value ----- */
+
+    if (p < end and *p == SEQ_START)
+    {
+      // we have found a sub container
+      item.container = true;
+      view.m_items.push_back( item );
+      p = decode(view, index, p, end); // recursive
+      view.m_items[index].end = view.m_items.size();
+    }
+    else
+    {
+      // simple value string
+      p = scan_str(view, p, end, sam::FIELD_DELIM, item.value);
+      view.m_items.push_back( item );
+    }
+
+    if (p >= end)
+      fail("ran out of data when expecting field delim");
+
+    if (*p != sam::FIELD_DELIM)
+      fail("expected field delim");
+
+    p++;
+  }  // main processing loop
+
+  return p;
+}
+
+/** Raise an exception to indicate a parsing exception. */
+void SAMProtocol::fail(const char* error)
+{
+  throw std::runtime_error(error);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Decode the items of a SAM0200 container, appending them to the view, up to
+ * and including its BIN_END.  Names and values point into the input, or into
+ * the dictionary.  Returns a pointer to the next byte.
+ */
+const char* SAMProtocol::decode_binary(txView& view,
+                                       size_t parent,
+                                       const char* p,
+                                       const char* end)
+{
+  while (p < end)
+  {
+    unsigned char const op = *p++;
+    if (op == BIN_END) return p;
+
+    size_t const index = view.m_items.size();
+
+    txView::Item item;
+    item.parent    = parent;
+    item.end       = index + 1;
+    item.container = false;
+    item.value.ptr = p;
+    item.value.len = 0;
+
+    p = read_name(p, end, op bitand BIN_NAME_ID, item.name);
+
+    switch (op bitand ~BIN_NAME_ID)
+    {
+      case BIN_FIELD :
+      {
+        p = get_bytes(p, end, item.value);
+        view.m_items.push_back( item );
+        break;
+      }
+      case BIN_CHILD :
+      {
+        item.container = true;
+        view.m_items.push_back( item );
+        p = decode_binary(view, index, p, end); // recursive
+        view.m_items[index].end = view.m_items.size();
+        break;
+      }
+      default: fail("SAM0200 bad item type");
+    }
+  }
+
+  fail("ran out of data, expected end of container");
+  return p;
+}
+
+//----------------------------------------------------------------------
+const char* SAMProtocol::read_name(const char* p,
+                                   const char* end,
+                                   bool is_id,
+                                   txView::Str& dest)
+{
+  if (not is_id) return get_bytes(p, end, dest);
+
+  size_t id;
+  p = get_varint(p, end, id);
+  if (id >= m_names.size()) fail("SAM0200 name id not defined");
+
+  dest.ptr = m_names[id].data();
+  dest.len = m_names[id].size();
+  return p;
+}
+
+//----------------------------------------------------------------------
+/* Add the names of a SAM0201 frame to the dictionary.  The frame holds the
+ * id of its first name, which must follow on from those already defined,
+ * the count of names, and the names. */
+void SAMProtocol::decode_names(const char* p, const char* end)
+{
+  size_t first, count;
+  p = get_varint(p, end, first);
+  p = get_varint(p, end, count);
+
+  if (first != m_names.size()) fail("SAM0201 names out of sequence");
+  if (count > txNameDict::MAX_NAMES - first) fail("SAM0201 too many names");
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    txView::Str name;
+    p = get_bytes(p, end, name);
+    m_names.push_back( name.str() );
+  }
+}
+
+//======================================================================
+
+
+//======================================================================
+
+
+// Message::Message()
+//   : m_root(NULL)
+// {
+// }
+
+// Message::Message(const std::string& name)
+//   : m_name(name),
+//     m_root(NULL)
+// {
+// }
+
+// void Message::reset(const std::string& name)
+// {
+//   m_name = name;
+//   m_root.clear();
+// }
+
+// void Message::to_stream(std::ostream& os, bool _inline) const
+// {
+//   os << "Message:" << m_name << "={";
+//   if (not _inline) os << '\n';
+//   m_root.to_stream(os, _inline, 1);
+//   os << "}\n";  // always terminate message with a newline
+// }
+
+
+//======================================================================
+struct txNameDict::Impl
+{
+    /* Open addressed and insert only.  A slot holds one more than the id of
+     * the name hashed to it, or 0 if empty, and is stored only after the
+     * name is in place; so a reader which finds a slot set can compare the
+     * name without a lock.  Slots outnumber names by at least two to one,
+     * so a probe always meets an empty slot. */
+    cpp11::mutex mutex;  // held to add a name
+    size_t capacity;
+    size_t mask;
+    std::string* names;
+    cpp11::atomic<size_t>* slots;
+    cpp11::atomic<size_t> count;
+
+    explicit Impl(size_t __capacity)
+      : capacity(__capacity),
+        mask(1),
+        names(NULL),
+        slots(NULL)
+    {
+      while (mask < 2 * capacity) mask <<= 1;
+      names = new std::string[capacity ? capacity : 1];
+      slots = new cpp11::atomic<size_t>[mask];
+      --mask;
+    }
+
+    ~Impl()
+    {
+      delete [] slots;
+      delete [] names;
+    }
+
+    /* Slot holding name, or else the empty slot ending its probe */
+    size_t probe(const std::string& name, size_t h, size_t& slot) const
+    {
+      for (slot = h & mask; ; slot = (slot + 1) & mask)
+      {
+        size_t const v = slots[slot].load(cpp11::memory_order_acquire);
+        if (v == 0 or names[v-1] == name) return v;
+      }
+    }
+};
+
+//----------------------------------------------------------------------
+txNameDict::txNameDict(size_t capacity)
+  : m_impl(NULL)
+{
+  size_t const most = MAX_NAMES;
+  m_impl = new Impl( std::min(capacity, most) );
+}
+
+//----------------------------------------------------------------------
+txNameDict::~txNameDict()
+{
+  delete m_impl;
+}
+
+//----------------------------------------------------------------------
+size_t txNameDict::lookup(const std::string& name)
+{
+  if (name.size() > MAX_NAME_LEN) return npos;
+
+  size_t const h = std::tr1::hash<std::string>()(name);
+  size_t slot;
+
+  // names already held are found without the lock
+  size_t v = m_impl->probe(name, h, slot);
+  if (v) return v-1;
+  if (m_impl->count.load(cpp11::memory_order_acquire) >= m_impl->capacity)
+    return npos;
+
+  cpp11::lock_guard<cpp11::mutex> guard( m_impl->mutex );
+
+  // probe again, in case another thread added it
+  v = m_impl->probe(name, h, slot);
+  if (v) return v-1;
 
-    while (p < end and *p != sam::VALUE_DELIM)
-    {
-      if (*p == sam::ESCAPE) p++;
-      if (p < end) fieldname.append(1,*p);
-      p++;
-    }
+  size_t const id = m_impl->count.load(cpp11::memory_order_relaxed);
+  if (id >= m_impl->capacity) return npos;
 
-    if (p >= end) fail("ran out of data, expected field-value-delim");
-    if (*p != sam::VALUE_DELIM) fail("failed to find field-value-delim");
+  m_impl->names[id] = name;
+  m_impl->count.store(id+1, cpp11::memory_order_release);
+  m_impl->slots[slot].store(id+1, cpp11::memory_order_release);
+  return id;
+}
 
-    p++; // skip the VALUE_DELIM
+//----------------------------------------------------------------------
+size_t txNameDict::size() const
+{
+  return m_impl->count.load(cpp11::memory_order_acquire);
+}
 
-    /* ----- decode field-value ----- */
+//----------------------------------------------------------------------
+void txNameDict::names(size_t first, size_t last,
+                       std::vector<std::string>& dest) const
+{
+  // names below the count are set and never change
+  last = std::min(last, size());
+  for (size_t i = first; i < last; ++i) dest.push_back( m_impl->names[i] );
+}
 
-    if ( *p == SEQ_START)
-    {
-      // we have found a sub container
-      txContainer& subcont = parent->put_child( fieldname );
-      p = decode(&subcont, p, end); // recursive
-    }
-    else
-    {
-      // simple value string
-      std::string value;
-      value.reserve(50);
+//----------------------------------------------------------------------
+txNameDict& txNameDict::global()
+{
+  static txNameDict dict(GLOBAL_NAMES);
+  return dict;
+}
 
-      while (p < end && *p != sam::FIELD_DELIM)
-      {
-        if (*p == sam::ESCAPE) p++;
-        if (p < end) value.append(1,*p);
-        p++;
-      }
+//======================================================================
+txArena::txArena(size_t chunk_size)
+  : m_next(NULL),
+    m_end(NULL),
+    m_chunk_size(std::max(chunk_size, (size_t) 64)),
+    m_prior(0)
+{
+}
 
-      parent->put_field(fieldname, value);
-    }
+//----------------------------------------------------------------------
+txArena::~txArena()
+{
+  free_chunks();
+}
 
-    if (p >= end)
-      fail("ran out of data when expecting field delim");
+//----------------------------------------------------------------------
+void txArena::add_chunk(size_t n)
+{
+  Chunk c;
+  c.mem  = new char[n];
+  c.size = n;
+  m_chunks.push_back(c);
 
-    if (*p != sam::FIELD_DELIM)
-      fail("expected field delim");
+  m_next = c.mem;
+  m_end  = c.mem + n;
+}
 
-    p++;
-  }  // main processing loop
+//----------------------------------------------------------------------
+void txArena::grow(size_t n)
+{
+  if (not m_chunks.empty()) m_prior += m_next - m_chunks.back().mem;
 
-  return p;
+  // chunks double in size, up to a limit, so the number of chunks grows
+  // only logarithmically with the size of a message
+  add_chunk( std::max(n, m_chunk_size) );
+  m_chunk_size = std::min(2 * m_chunk_size, (size_t) 256 * 1024);
 }
 
-/** Raise an exception to indicate a parsing exception. */
-void SAMProtocol::fail(const char* error)
+//----------------------------------------------------------------------
+void txArena::free_chunks()
 {
-  throw std::runtime_error(error);
+  for (std::vector< Chunk >::iterator i = m_chunks.begin();
+       i != m_chunks.end(); ++i)
+    delete [] i->mem;
+
+  m_chunks.clear();
+  m_next  = NULL;
+  m_end   = NULL;
+  m_prior = 0;
 }
 
-//======================================================================
+//----------------------------------------------------------------------
+void txArena::reset()
+{
+  if (m_chunks.empty()) return;
 
+  if (m_chunks.size() == 1)
+  {
+    m_next  = m_chunks[0].mem;
+    m_prior = 0;
+    return;
+  }
 
-//======================================================================
+  // Coalesce into one chunk sized for the demand just seen, so a reused
+  // arena stops allocating; capped, so one large message is not retained.
+  size_t demand = 0;
+  for (std::vector< Chunk >::iterator i = m_chunks.begin();
+       i != m_chunks.end(); ++i)
+    demand += i->size;
 
+  free_chunks();
+  add_chunk( std::min(demand, (size_t) 1024 * 1024) );
+}
 
-// Message::Message()
-//   : m_root(NULL)
-// {
-// }
+//----------------------------------------------------------------------
+size_t txArena::used() const
+{
+  return m_chunks.empty()? 0 : m_prior + (m_next - m_chunks.back().mem);
+}
 
-// Message::Message(const std::string& name)
-//   : m_name(name),
-//     m_root(NULL)
-// {
-// }
+//======================================================================
+txField* txContainer::new_field(const std::string& name,
+                                const std::string& value)
+{
+  if (m_arena)
+    return new (m_arena->allocate(sizeof(txField))) txField(name, value);
+  else
+    return new txField(name, value);
+}
 
-// void Message::reset(const std::string& name)
-// {
-//   m_name = name;
-//   m_root.clear();
-// }
+//----------------------------------------------------------------------
+txContainer* txContainer::new_child(const std::string& name)
+{
+  if (m_arena)
+    return new (m_arena->allocate(sizeof(txContainer)))
+      txContainer(name, m_arena);
+  else
+    return new txContainer(name);
+}
 
-// void Message::to_stream(std::ostream& os, bool _inline) const
-// {
-//   os << "Message:" << m_name << "={";
-//   if (not _inline) os << '\n';
-//   m_root.to_stream(os, _inline, 1);
-//   os << "}\n";  // always terminate message with a newline
-// }
+//----------------------------------------------------------------------
+txItem* txContainer::copy_item(const txItem& src)
+{
+  // deep copy, allocated from this container's arena
+  if (const txContainer* c = src.asContainer())
+  {
+    txContainer* copy = new_child( c->name() );
+    for (ItemList::const_iterator iter = c->m_items.begin();
+         iter != c->m_items.end(); ++iter)
+      copy->add_internally( copy->copy_item( **iter ) );
+    return copy;
+  }
+  else
+  {
+    const txField* f = src.asField();
+    return new_field( f->name(), f->value() );
+  }
+}
+
+//----------------------------------------------------------------------
+void txContainer::destroy(txItem* item)
+{
+  if (m_arena)
+    item->~txItem();  // memory is reclaimed when the arena is reset
+  else
+    delete item;
+}
 
+//----------------------------------------------------------------------
+void txContainer::arena(txArena* a)
+{
+  if (a == m_arena) return;
 
-//======================================================================
+  // the allocators refer to m_arena, so it can only change while nothing
+  // has been allocated
+  if (not empty())
+    throw std::runtime_error("cannot change arena of non-empty container");
 
+  m_arena = a;
+}
 
 //----------------------------------------------------------------------
 
@@ -619,7 +1275,7 @@ txField& txContainer::put_field(const std::string& fname,
   else
   {
     // TODO: need a try/catch
-    txField * f = new txField(fname, fvalue);
+    txField * f = new_field(fname, fvalue);
     add_internally( f );
     return *f;
   }
@@ -655,30 +1311,16 @@ txField& txContainer::put_field(const qname& qn,
 
 txField* txContainer::find_field(const std::string& f)
 {
-  FieldMap::iterator iter = m_field_map.find( f );
-  if (iter != m_field_map.end())
-  {
-    return iter->second;
-  }
-  else
-  {
-    return NULL;
-  }
+  size_t pos = find_item(f, false);
+  return (pos == npos)? NULL : static_cast<txField*>( m_items[pos] );
 }
 
 //----------------------------------------------------------------------
 
 const txField* txContainer::find_field(const std::string& f) const
 {
-  FieldMap::const_iterator iter = m_field_map.find( f );
-  if (iter != m_field_map.end())
-  {
-    return iter->second;
-  }
-  else
-  {
-    return NULL;
-  }
+  size_t pos = find_item(f, false);
+  return (pos == npos)? NULL : static_cast<const txField*>( m_items[pos] );
 }
 
 //----------------------------------------------------------------------
@@ -692,19 +1334,158 @@ void txContainer::add_internally(txItem * item)
   // Note, we MUST add the item pointer, because that pointer value might be
   // returned to the client.
 
+  const bool container = item->isContainer();
+
+  drop_name_order();
   m_items.push_back( item );
-//  m_item_map.insert( std::make_pair(item->name(), item) );
+  m_keys.push_back( key_of(item->name(), container) );
+  if (not container) m_fields++;
+
+  if (not m_index.empty())
+    index_item( m_items.size() - 1 );
+  else if (m_items.size() > INDEX_THRESHOLD)
+    rebuild_index();
+}
+
+//----------------------------------------------------------------------
+static bool by_name(const txItem* a, const txItem* b)
+{
+  return a->name() < b->name();
+}
+
+//----------------------------------------------------------------------
+/* Only const readers share the order, so a pointer to it found set stays
+ * valid; the container changes only while it has no other users, and
+ * iterators keep their own hold. */
+txNameOrder* txContainer::name_order() const
+{
+  txNameOrder* order = __atomic_load_n(&m_order, __ATOMIC_ACQUIRE);
+  if (order == NULL)
+  {
+    txNameOrder* built = new txNameOrder;
+    built->m_fields.reserve( m_fields );
+    built->m_children.reserve( m_items.size() - m_fields );
+    for (ItemList::const_iterator i = m_items.begin(); i != m_items.end(); ++i)
+    {
+      if ((*i)->isContainer())
+        built->m_children.push_back( *i );
+      else
+        built->m_fields.push_back( *i );
+    }
+    std::sort(built->m_fields.begin(),   built->m_fields.end(),   by_name);
+    std::sort(built->m_children.begin(), built->m_children.end(), by_name);
 
-  if (item->isContainer())
+    // another reader may have built it first, in which case use theirs
+    if (__atomic_compare_exchange_n(&m_order, &order, built, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      order = built;
+    else
+      delete built;
+  }
+  txNameOrder::hold(order);
+  return order;
+}
+
+//----------------------------------------------------------------------
+void txContainer::drop_name_order()
+{
+  if (m_order) txNameOrder::release(m_order);
+  m_order = NULL;
+}
+
+//----------------------------------------------------------------------
+void txNameOrder::hold(txNameOrder* order)
+{
+  __atomic_fetch_add(&order->m_refs, 1, __ATOMIC_RELAXED);
+}
+
+//----------------------------------------------------------------------
+void txNameOrder::release(txNameOrder* order)
+{
+  if (__atomic_fetch_sub(&order->m_refs, 1, __ATOMIC_ACQ_REL) == 1)
+    delete order;
+}
+
+//----------------------------------------------------------------------
+uint32_t txContainer::key_of(const std::string& name, bool container)
+{
+  // FNV-1a, with the low bit replaced by the item kind
+  uint32_t h = 2166136261u;
+  for (std::string::const_iterator i = name.begin(); i != name.end(); ++i)
   {
-    txContainer* container = dynamic_cast<txContainer*>(item);
-    m_child_map.insert( std::make_pair(item->name(), container) );
+    h ^= (unsigned char) *i;
+    h *= 16777619u;
   }
-  else
+  return (h & ~1u) | (container? 1u : 0u);
+}
+
+//----------------------------------------------------------------------
+size_t txContainer::find_item(const std::string& name, bool container) const
+{
+  const uint32_t key = key_of(name, container);
+
+  if (m_index.empty())
+  {
+    // small container: scan the keys, which are contiguous
+    const size_t n = m_keys.size();
+    for (size_t i = 0; i < n; ++i)
+    {
+      if (m_keys[i] == key and m_items[i]->name() == name) return i;
+    }
+    return npos;
+  }
+
+  const size_t mask = m_index.size() - 1;
+  for (size_t slot = (key >> 1) & mask; ; slot = (slot + 1) & mask)
+  {
+    const uint32_t entry = m_index[slot];
+    if (entry == 0) return npos;
+
+    const size_t i = entry - 1;
+    if (m_keys[i] == key and m_items[i]->name() == name) return i;
+  }
+}
+
+//----------------------------------------------------------------------
+void txContainer::index_item(size_t pos)
+{
+  // keep the index at most half full
+  if (2 * m_items.size() > m_index.size())
   {
-    txField* field = dynamic_cast<txField*>(item);
-    m_field_map.insert( std::make_pair(item->name(), field) );
+    rebuild_index();
+    return;
   }
+
+  const size_t mask = m_index.size() - 1;
+  size_t slot = (m_keys[pos] >> 1) & mask;
+  while (m_index[slot]) slot = (slot + 1) & mask;
+  m_index[slot] = pos + 1;
+}
+
+//----------------------------------------------------------------------
+void txContainer::rebuild_index()
+{
+  m_index.clear();
+  if (m_items.size() <= INDEX_THRESHOLD) return;
+
+  size_t size = 64;
+  while (size < 4 * m_items.size()) size *= 2;
+  m_index.resize(size, 0);
+
+  for (size_t i = 0; i < m_items.size(); ++i) index_item(i);
+}
+
+//----------------------------------------------------------------------
+void txContainer::erase_item(size_t pos)
+{
+  drop_name_order();
+  if (not m_items[pos]->isContainer()) m_fields--;
+
+  m_items.erase( m_items.begin() + pos );
+  m_keys.erase( m_keys.begin() + pos );
+
+  // positions have shifted, so the index is rebuilt
+  if (not m_index.empty()) rebuild_index();
 }
 
 //----------------------------------------------------------------------
@@ -720,7 +1501,7 @@ txContainer& txContainer::put_child(const std::string& f)
   else
   {
     // TODO: handle throws here -- might need to delete
-    txContainer * c = new txContainer( f );
+    txContainer * c = new_child( f );
     add_internally( c );
     return *c;
   }
@@ -738,7 +1519,7 @@ txContainer& txContainer::put_child(const txContainer& src)
   else
   {
     // TODO: handle throws here -- might need to delete
-    txContainer * c = new txContainer( src ); // deep copy
+    txContainer * c = static_cast<txContainer*>( copy_item( src ) );
     add_internally( c );
     return *c;
   }
@@ -748,33 +1529,65 @@ txContainer& txContainer::put_child(const txContainer& src)
 
 txContainer::~txContainer()
 {
+  drop_name_order();
   for (ItemList::iterator i = m_items.begin(); i != m_items.end(); ++i)
   {
-    delete *i;
+    destroy(*i);
   }
 }
 //----------------------------------------------------------------------
 txContainer::txContainer()
+  : m_arena(NULL),
+    m_items(ItemList::allocator_type(&m_arena)),
+    m_keys(KeyList::allocator_type(&m_arena)),
+    m_index(KeyList::allocator_type(&m_arena)),
+    m_fields(0),
+    m_order(NULL)
 {
 }
 //----------------------------------------------------------------------
 txContainer::txContainer(const std::string& name)
-  : txItem( name )
+  : txItem( name ),
+    m_arena(NULL),
+    m_items(ItemList::allocator_type(&m_arena)),
+    m_keys(KeyList::allocator_type(&m_arena)),
+    m_index(KeyList::allocator_type(&m_arena)),
+    m_fields(0),
+    m_order(NULL)
+{
+}
+//----------------------------------------------------------------------
+txContainer::txContainer(const std::string& name, txArena* arena)
+  : txItem( name ),
+    m_arena(arena),
+    m_items(ItemList::allocator_type(&m_arena)),
+    m_keys(KeyList::allocator_type(&m_arena)),
+    m_index(KeyList::allocator_type(&m_arena)),
+    m_fields(0),
+    m_order(NULL)
 {
 }
 //----------------------------------------------------------------------
 
 // copy constructor
 txContainer::txContainer(const txContainer& rhs)
-  : txItem( rhs.name() )
+  : txItem( rhs.name() ),
+    m_arena(NULL),
+    m_items(ItemList::allocator_type(&m_arena)),
+    m_keys(KeyList::allocator_type(&m_arena)),
+    m_index(KeyList::allocator_type(&m_arena)),
+    m_fields(0),
+    m_order(NULL)
 {
   // TODO: add try/catch here, just in case one of the copy fails. If we
   // catch, we should undo the operation.
+  m_items.reserve( rhs.m_items.size() );
+  m_keys.reserve( rhs.m_items.size() );
   for (ItemList::const_iterator iter = rhs.items().begin();
        iter != rhs.items().end();
        iter++)
   {
-    add_internally( (*iter)->clone() );
+    add_internally( copy_item(**iter) );
   }
 }
 
@@ -795,7 +1608,7 @@ txContainer & txContainer::operator=(const txContainer & rhs)
        iter != rhs.m_items.end();
        iter++)
   {
-    this -> add_internally( (*iter)->clone() );
+    this -> add_internally( copy_item(**iter) );
   }
 
   return *this;
@@ -842,56 +1655,36 @@ txContainer& txContainer::put_child(const qname& qn)
 
 txContainer* txContainer::find_child(const std::string& f)
 {
-  ChildMap::iterator iter = m_child_map.find( f );
-  if (iter != m_child_map.end())
-  {
-    return iter->second;
-  }
-  else
-  {
-    return NULL;
-  }
+  size_t pos = find_item(f, true);
+  return (pos == npos)? NULL : static_cast<txContainer*>( m_items[pos] );
 }
 
 //----------------------------------------------------------------------
 
 const txContainer* txContainer::find_child(const std::string& f) const
 {
-  ChildMap::const_iterator iter = m_child_map.find( f );
-  if (iter != m_child_map.end())
-  {
-    return iter->second;
-  }
-  else
-  {
-    return NULL;
-  }
+  size_t pos = find_item(f, true);
+  return (pos == npos)? NULL : static_cast<const txContainer*>( m_items[pos] );
 }
 
 //----------------------------------------------------------------------
 
 void txContainer::clear()
 {
-  // tell sub containers to clear()
-  for (ChildMap::iterator iter = m_child_map.begin();
-       iter != m_child_map.end();
-       ++iter)
-  {
-    iter->second->clear();
-  }
-
-  // now delete our items
+  // delete our items; sub containers delete their own
   for (ItemList::iterator iter = m_items.begin();
        iter != m_items.end();
        ++iter)
   {
-    delete *iter;
+    destroy(*iter);
   }
 
-  // now clear out our state
+  // now clear out our state, retaining capacity for reuse
+  drop_name_order();
   m_items.clear();
-  m_field_map.clear();
-  m_child_map.clear();
+  m_keys.clear();
+  m_index.clear();
+  m_fields = 0;
 }
 
 //----------------------------------------------------------------------
@@ -901,6 +1694,109 @@ txMessage::txMessage(const std::string& type)
 {
 }
 
+//----------------------------------------------------------------------
+txMessage::txMessage(const std::string& type, txArena* arena)
+  : m_root( type, arena )
+{
+}
+
+//----------------------------------------------------------------------
+void txMessage::arena(txArena* a)
+{
+  m_root.arena(a);
+}
+
+//======================================================================
+bool txView::Str::operator==(const char* s) const
+{
+  return strncmp(ptr, s, len) == 0 and s[len] == '\0';
+}
+
+//----------------------------------------------------------------------
+txView::txView()
+{
+  m_type.ptr = "";
+  m_type.len = 0;
+}
+
+//----------------------------------------------------------------------
+void txView::clear()
+{
+  // clear() retains the capacity of both the vector and the string
+  m_type.ptr = "";
+  m_type.len = 0;
+  m_items.clear();
+  m_unescaped.clear();
+}
+
+//----------------------------------------------------------------------
+size_t txView::find(size_t container,
+                    const char* name,
+                    bool container_wanted) const
+{
+  size_t i   = (container == npos)? 0 : container + 1;
+  size_t end = (container == npos)? m_items.size() : m_items[container].end;
+  size_t found = npos;
+
+  // step over the contents of nested containers
+  for (; i < end; i = m_items[i].end)
+  {
+    if (m_items[i].container == container_wanted and m_items[i].name == name)
+      found = i;
+  }
+
+  return found;
+}
+
+//----------------------------------------------------------------------
+size_t txView::find_field(size_t container, const char* name) const
+{
+  return find(container, name, false);
+}
+
+//----------------------------------------------------------------------
+size_t txView::find_child(size_t container, const char* name) const
+{
+  return find(container, name, true);
+}
+
+//----------------------------------------------------------------------
+size_t txView::find_field(const qname& qn) const
+{
+  if (qn.empty()) return npos;
+
+  size_t current = npos;
+  for (size_t i = 0; i < ( qn.size() - 1 ); ++i)
+  {
+    current = find_child(current, qn[i].c_str());
+    if (current == npos) return npos;
+  }
+
+  return find_field(current, qn[ qn.size() - 1 ].c_str());
+}
+
+//----------------------------------------------------------------------
+void txView::copy_to(txMessage& msg) const
+{
+  msg.reset();
+  msg.type( m_type.str() );
+  copy_items(msg.root(), 0, m_items.size());
+}
+
+//----------------------------------------------------------------------
+void txView::copy_items(txContainer& dest, size_t begin, size_t end) const
+{
+  for (size_t i = begin; i < end; i = m_items[i].end)
+  {
+    const Item& item = m_items[i];
+    if (item.container)
+      copy_items(dest.put_child( item.name.str() ), i + 1, item.end);
+    else
+      dest.put_field( item.name.str(), item.value.str() );
+  }
+}
+
+//======================================================================
 void txMessage::reset()
 {
   m_root.clear();
@@ -1099,25 +1995,15 @@ void txContainer::remove(const std::string& n)
   // TODO: instead of this method, probably want to have remove_child() and
   // remove_field() and remove_any()
 
-  // look for a field
-  {
-    FieldMap::iterator f = m_field_map.find(n);
-    if (f != m_field_map.end())
-    {
-      delete f->second;
-      m_field_map.erase(f);
-      m_items.remove(f->second);
-    }
-  }
-
+  // look for a field, then a container
+  for (int container = 0; container < 2; ++container)
   {
-    // look for a container
-    ChildMap::iterator c = m_child_map.find(n);
-    if (c != m_child_map.end())
+    size_t pos = find_item(n, container);
+    if (pos != npos)
     {
-      delete c->second;
-      m_child_map.erase(c);
-      m_items.remove(c->second);
+      txItem* item = m_items[pos];
+      erase_item(pos);
+      destroy(item);
     }
   }
 }
@@ -1141,7 +2027,7 @@ void txContainer::merge(const txContainer& src)
     */
     if ((*i)->isContainer())
     {
-      txContainer* src_container = dynamic_cast<txContainer*>(*i);
+      txContainer* src_container = static_cast<txContainer*>(*i);
 
       if (c!=NULL)
       {
@@ -1154,7 +2040,7 @@ void txContainer::merge(const txContainer& src)
     }
     else
     {
-      txField* src_field = dynamic_cast<txField*>(*i);
+      txField* src_field = static_cast<txField*>(*i);
 
       put_field( *src_field );
     }
@@ -22,7 +22,10 @@
 #include <sstream>
 #include <iomanip>
 
+#include <math.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 namespace exio {
 namespace utils {
@@ -50,11 +53,83 @@ std::vector<std::string> tokenize(const char* src,
 //----------------------------------------------------------------------
 std::string to_str(int i)
 {
-  // TODO: for perf, here I could use a look up for say, the first 100 numbers
-
-  std::ostringstream os;
-  os << i;
-  return os.str();
+  char buf[32];
+  return std::string(buf, format_int64(i, buf));
+}
+//----------------------------------------------------------------------
+size_t format_int64(int64_t i, char* buf)
+{
+  // digits are produced in reverse, from the magnitude as unsigned, which
+  // also holds the magnitude of the most negative value
+  char tmp[24];
+  char* p = tmp + sizeof(tmp);
+  uint64_t u = (i < 0)? (uint64_t)0 - (uint64_t)i : (uint64_t)i;
+  do
+  {
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  } while (u);
+
+  size_t len = 0;
+  if (i < 0) buf[len++] = '-';
+  size_t const ndigits = tmp + sizeof(tmp) - p;
+  memcpy(buf + len, p, ndigits);
+  len += ndigits;
+  buf[len] = '\0';
+  return len;
+}
+//----------------------------------------------------------------------
+size_t format_double(double d, char* buf)
+{
+  if (d != d)          return (size_t) sprintf(buf, "nan");
+  if (d ==  HUGE_VAL)  return (size_t) sprintf(buf, "inf");
+  if (d == -HUGE_VAL)  return (size_t) sprintf(buf, "-inf");
+
+  /* Most values, such as prices and quantities, are exactly an integer with
+   * a few decimal places.  Those are written from the integer of their
+   * digits: r / 10^k is correctly rounded, so when it equals d, the text
+   * "r/10^k" reads back as d.  Integers up to 1e15 are exact in a double. */
+  static const double pow10[] = { 1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+                                  1e9 };
+  for (int k = 0; k < 10; ++k)
+  {
+    double const scaled = d * pow10[k];
+    if (fabs(scaled) >= 1e15) break;
+
+    int64_t const r = llround(scaled);
+    if ((double) r / pow10[k] != d) continue;
+
+    if (k == 0) return format_int64(r, buf);
+
+    // insert the decimal point, k digits from the end, padding with zeros
+    char digits[32];
+    size_t n = format_int64((r < 0)? -r : r, digits);
+    size_t len = 0;
+    if (r < 0) buf[len++] = '-';
+    if (n <= (size_t) k)
+    {
+      buf[len++] = '0';
+      buf[len++] = '.';
+      for (size_t z = n; z < (size_t) k; ++z) buf[len++] = '0';
+      memcpy(buf + len, digits, n);
+      len += n;
+    }
+    else
+    {
+      memcpy(buf + len, digits, n - k);
+      len += n - k;
+      buf[len++] = '.';
+      memcpy(buf + len, digits + n - k, k);
+      len += k;
+    }
+    buf[len] = '\0';
+    return len;
+  }
+
+  // otherwise the shortest of 15 or 17 significant digits which reads back
+  int len = snprintf(buf, 32, "%.15g", d);
+  if (strtod(buf, NULL) != d) len = snprintf(buf, 32, "%.17g", d);
+  return (size_t) len;
 }
 //----------------------------------------------------------------------
 std::string strerror(int e)
@@ -105,5 +180,23 @@ std::string datetimestamp(time_t now)
   return os.str();
 }
 
+//----------------------------------------------------------------------
+std::string row_timestamp(time_t now)
+{
+  tm parts;
+  localtime_r(&now, &parts);
+  char timeStr[50];
+  memset(timeStr, 0, sizeof(timeStr));
+  snprintf(timeStr,
+           sizeof(timeStr),
+           "%d/%02d/%02d %02d:%02d:%02d",
+           parts.tm_year + 1900,
+           parts.tm_mon + 1,
+           parts.tm_mday,
+           parts.tm_hour,parts.tm_min,parts.tm_sec);
+  timeStr[sizeof(timeStr)-1] = '\0';
+  return timeStr;
+}
+
 
 }} // namespace
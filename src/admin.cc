@@ -58,9 +58,11 @@ struct ProgramOptions
     std::list< std::string > cmdargs;
 
     int verbose; // count of '-d'
+    bool binary; // ask for the binary wire format
 
     ProgramOptions()
-      : verbose(0)
+      : verbose(0),
+        binary(false)
     {
     }
 } program_options;
@@ -625,6 +627,7 @@ void usage()
   std::cout << "exio admin command-line client, version " PACKAGE_VERSION "\n\n";
 
   std::cout << "Options:\n\n";
+  std::cout << "  -b,--binary\trequest binary SAM0200 messages from the server\n";
   std::cout << "  -d\tlog exio problems; repeat twice for info, thrice for debug\n";
   std::cout << "  -v,--version\tversion info";
   std::cout << std::endl;
@@ -651,6 +654,7 @@ void process_cmd_line(int argc, char** argv)
 
 //  int digit_optind = 0;
   static struct option longopts[] = {
+    {"binary", no_argument, 0, 'b'},
     {"help", no_argument, 0, 'h'},
     {"version", no_argument, 0, 'v'},
     {NULL, 0, NULL, 0}
@@ -671,7 +675,7 @@ void process_cmd_line(int argc, char** argv)
 
       // 'c' is the option character returned
     int c = getopt_long(argc, argv,
-                        "hdv",
+                        "bhdv",
                         longopts, &longindex);
 
     if (c == -1) break;
@@ -682,6 +686,7 @@ void process_cmd_line(int argc, char** argv)
 
     switch(c)
     {
+      case 'b' : program_options.binary = true; break;
       case 'd' : program_options.verbose++; break;
       case 'h' : usage(); exit(0);
       case 'v' : version(); exit(0);
@@ -792,6 +797,9 @@ int __main(const int argc, char** argv)
   logon.root().put_field(exio::id::QN_serviceid, serviceid);
   logon.root().put_field(exio::id::QN_head_user, build_user_id());
 
+  if (program_options.binary)
+    logon.root().put_field(exio::id::QN_wireformat, sam::SAM0200);
+
   if (not program_options.cmd.empty())
   {
     /* because we are going to send a command, lets include the
@@ -852,6 +860,11 @@ int __main(const int argc, char** argv)
   admin_session_guard.reset();
   delete sptr;
 
+  // The interface threads use the logger, so stop them before it is
+  // destroyed, on return.
+  delete g_ai;
+  g_ai = NULL;
+
   return retval;
 }
 
@@ -0,0 +1,184 @@
+#include "exio/AdminInterface.h"
+#include "exio/AppSvc.h"
+#include "exio/utils.h"
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+/*
+ * Measure the cost of updating a table of numbers: prices as doubles and
+ * quantities as integers.  Compares formatting values with ostringstream for
+ * monitor_update, as applications have done, with updates through a row
+ * handle of cells formatted the same way, and of typed cells, which are held
+ * as numbers and formatted only when read.  Also checks that the number
+ * formatter writes values which read back exactly, and that typed cells read
+ * back as expected.
+ */
+
+exio::ConsoleLogger logger(exio::ConsoleLogger::eStdout,
+                           exio::ConsoleLogger::eWarn,
+                           true);
+
+static double now_sec()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void report(const char* phase, int n, double secs)
+{
+  std::cout << phase << ": updates=" << n
+            << " secs=" << secs
+            << " ns_per_update=" << (secs * 1e9 / n) << "\n";
+}
+
+static std::string to_s(const char* prefix, int i)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+  return buf;
+}
+
+template<typename T> static std::string ostr(T v)
+{
+  std::ostringstream os;
+  os << v;
+  return os.str();
+}
+
+static const int ncols = 10;  // half prices, half quantities
+
+static double price(int i, int c) { return 100 + (i % 1000) * 0.25 + c; }
+static int64_t qty(int i, int c)  { return (int64_t)(i % 5000) * 100 + c; }
+
+//----------------------------------------------------------------------
+static bool check_format()
+{
+  const double values[] = { 0, 1, -1, 0.5, -0.05, 100.25, 1e-7, 123456.789,
+                            0.1 + 0.2, 1.0 / 3, 1e300, -2.5e-300, 9007199254740993.0,
+                            4503599627370495.5 };
+  bool ok = true;
+  char buf[32];
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+  {
+    exio::utils::format_double(values[i], buf);
+    if (strtod(buf, NULL) != values[i])
+    {
+      std::cout << "format_double: " << buf << " does not read back\n";
+      ok = false;
+    }
+  }
+
+  exio::utils::format_double(100.25, buf);
+  ok = ok and std::string(buf) == "100.25";
+  exio::utils::format_double(-0.05, buf);
+  ok = ok and std::string(buf) == "-0.05";
+  exio::utils::format_int64(INT64_MIN, buf);
+  ok = ok and std::string(buf) == "-9223372036854775808";
+
+  return ok;
+}
+
+//----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  int n = (argc > 1)? atoi(argv[1]) : 200000;
+  int nrows = (argc > 2)? atoi(argv[2]) : 1000;
+
+  bool ok = check_format();
+
+  exio::Config config;
+  config.serviceid = "cell_bench";
+  exio::AdminInterface ai(config, &logger);
+
+  std::vector< std::string > colnames;
+  for (int c = 0; c < ncols; ++c)
+    colnames.push_back( to_s((c < ncols/2)? "price_" : "qty_", c) );
+
+  std::vector< std::string > rowkeys;
+  for (int r = 0; r < nrows; ++r) rowkeys.push_back( to_s("row", r) );
+
+  /* text, by name, formatted with ostringstream */
+  std::map<std::string, std::string> fields;
+  double t0 = now_sec();
+  for (int i = 0; i < n; ++i)
+  {
+    for (int c = 0; c < ncols; ++c)
+      fields[ colnames[c] ] = (c < ncols/2)? ostr(price(i, c))
+        : ostr(qty(i, c));
+    ai.monitor_update("text_map", rowkeys[i % nrows], fields);
+  }
+  report("text_map", n, now_sec() - t0);
+
+  /* text, through handles */
+  {
+    exio::TableHandle th = ai.table("text_handle");
+    std::vector< exio::RowHandle > rows;
+    for (int r = 0; r < nrows; ++r) rows.push_back( th.row(rowkeys[r]) );
+
+    std::vector< exio::RowHandle::Cell > cells;
+    for (int c = 0; c < ncols; ++c)
+      cells.push_back( exio::RowHandle::Cell(th.column(colnames[c]), "") );
+
+    t0 = now_sec();
+    for (int i = 0; i < n; ++i)
+    {
+      for (int c = 0; c < ncols; ++c)
+        cells[c].second = (c < ncols/2)? ostr(price(i, c)) : ostr(qty(i, c));
+      rows[i % nrows].update(cells);
+    }
+    report("text_handle", n, now_sec() - t0);
+  }
+
+  /* typed, through handles */
+  {
+    exio::TableHandle th = ai.table("typed_handle");
+    std::vector< exio::RowHandle > rows;
+    for (int r = 0; r < nrows; ++r) rows.push_back( th.row(rowkeys[r]) );
+
+    std::vector< size_t > colidx;
+    for (int c = 0; c < ncols; ++c) colidx.push_back(th.column(colnames[c]));
+
+    std::vector< exio::RowHandle::TypedCell > cells( ncols );
+    t0 = now_sec();
+    for (int i = 0; i < n; ++i)
+    {
+      for (int c = 0; c < ncols; ++c)
+        cells[c] = (c < ncols/2)
+          ? exio::RowHandle::TypedCell::real(colidx[c], price(i, c))
+          : exio::RowHandle::TypedCell::int64(colidx[c], qty(i, c));
+      rows[i % nrows].update(cells);
+    }
+    report("typed_handle", n, now_sec() - t0);
+
+    // typed cells read back as text
+    rows[0].update_bool(th.column("flag"), true);
+    std::string dest;
+    int const last = ((n - 1) / nrows) * nrows;  // last update of row 0
+    ok = ok
+      and ai.copy_field("typed_handle", rowkeys[0], colnames[0], dest)
+      and strtod(dest.c_str(), NULL) == price(last, 0)
+      and ai.copy_field("typed_handle", rowkeys[0], colnames[ncols-1], dest)
+      and dest == ostr(qty(last, ncols-1))
+      and ai.copy_field("typed_handle", rowkeys[0], "flag", dest)
+      and dest == "true";
+
+    // and both tables hold the same text
+    exio::AdminInterface::Row text, typed;
+    ai.copy_row("text_map", rowkeys[0], text);
+    ai.copy_row("typed_handle", rowkeys[0], typed);
+    for (int c = 0; c < ncols; ++c)
+      ok = ok and strtod(text[colnames[c]].c_str(), NULL)
+        == strtod(typed[colnames[c]].c_str(), NULL);
+  }
+
+  std::cout << "checks=" << (ok? "ok" : "FAIL") << "\n";
+  return ok? 0 : 1;
+}
@@ -287,6 +287,10 @@ int __main(int argc, char** argv)
                           &adminSendAlert);
   ai->add_admin(ac);
 
+  // prices change far faster than anyone can read them, so publish each
+  // changed row at most every 100 ms
+  ai->table_conflation("lse", 100);
+
   // main loop
   ai->start();
 
@@ -301,13 +305,14 @@ int __main(int argc, char** argv)
 
   while(true)
   {
+    // publish all prices together, as a single multi-row update
+    exio::AdminInterface::Table rows;
     for (std::vector<StockPrice>::iterator i = names.begin(); i != names.end(); ++i)
     {
-      std::map<std::string, std::string> up;
       i->update();
-      i->table(up);
-      ai->monitor_update("lse", i->name, up);
+      i->table(rows[i->name]);
     }
+    ai->monitor_update_batch("lse", rows);
 
 
     usleep(100);
@@ -0,0 +1,130 @@
+#include "exio/AdminInterface.h"
+#include "exio/AppSvc.h"
+
+#include "thread.h"
+
+#include <iostream>
+#include <vector>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+/*
+ * Measure updates from several application threads, each updating its own
+ * table through monitor_update, as with 8 threads updating 8 tables.  With
+ * the tables spread over independently locked parts of the registry, the
+ * rate of updates should grow with the number of threads, up to the number
+ * of cores.  Readers of has_row and copy_field run alongside, on the same
+ * tables.
+ */
+
+exio::ConsoleLogger logger(exio::ConsoleLogger::eStdout,
+                           exio::ConsoleLogger::eWarn,
+                           true);
+
+static double now_sec()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static std::string to_s(const char* prefix, int i)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+  return buf;
+}
+
+//----------------------------------------------------------------------
+class Writer
+{
+  public:
+    Writer(exio::AdminInterface& ai, const std::string& table, int n,
+           bool reader)
+      : m_ai(ai), m_table(table), m_n(n), m_reader(reader), m_found(0)
+    {
+      for (int r = 0; r < 1000; ++r) m_rowkeys.push_back( to_s("row", r) );
+    }
+
+    void run()
+    {
+      std::map<std::string, std::string> fields;
+      std::string dest;
+      for (int i = 0; i < m_n; ++i)
+      {
+        const std::string& rowkey = m_rowkeys[i % m_rowkeys.size()];
+        if (m_reader)
+        {
+          m_found += m_ai.has_row(m_table, rowkey);
+          m_found += m_ai.copy_field(m_table, rowkey, "qty", dest);
+        }
+        else
+        {
+          // a new value on each pass over the rows
+          size_t const pass = i / m_rowkeys.size();
+          fields["qty"] = m_rowkeys[pass % m_rowkeys.size()];
+          m_ai.monitor_update(m_table, rowkey, fields);
+        }
+      }
+    }
+
+    int found() const { return m_found; }
+
+  private:
+    exio::AdminInterface& m_ai;
+    std::string m_table;
+    int m_n;
+    bool m_reader;
+    int m_found;
+    std::vector< std::string > m_rowkeys;
+};
+
+//----------------------------------------------------------------------
+static void bench(exio::AdminInterface& ai, int nthreads, int n, bool readers)
+{
+  std::vector<Writer*>        writers;
+  std::vector<cpp11::thread*> threads;
+  for (int i = 0; i < nthreads; ++i)
+  {
+    writers.push_back(new Writer(ai, to_s("table", i), n, false));
+    if (readers)
+      writers.push_back(new Writer(ai, to_s("table", i), n, true));
+  }
+
+  double t0 = now_sec();
+  for (size_t i = 0; i < writers.size(); ++i)
+    threads.push_back(new cpp11::thread(&Writer::run, writers[i]));
+
+  for (size_t i = 0; i < writers.size(); ++i)
+  {
+    threads[i]->join();
+    delete threads[i];
+    delete writers[i];
+  }
+  double secs = now_sec() - t0;
+
+  double total = double(nthreads) * n;
+  std::cout << "writers=" << nthreads
+            << " readers=" << (readers? nthreads : 0)
+            << " updates=" << (long) total
+            << " secs=" << secs
+            << " updates_per_sec=" << (long)(total / secs) << "\n";
+}
+
+//----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  int n = (argc > 1)? atoi(argv[1]) : 200000;
+  int maxthreads = (argc > 2)? atoi(argv[2]) : 8;
+
+  exio::Config config;
+  config.serviceid = "monitor_bench";
+  exio::AdminInterface ai(config, &logger);
+
+  for (int t = 1; t <= maxthreads; t *= 2) bench(ai, t, n, false);
+  for (int t = 1; t <= maxthreads; t *= 2) bench(ai, t, n, true);
+
+  return 0;
+}
@@ -0,0 +1,198 @@
+#include "exio/sam.h"
+#include "exio/SamBuffer.h"
+#include "exio/AppSvc.h"
+
+#include <iostream>
+#include <new>
+#include <stdexcept>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/*
+ * Count the heap allocations made building and destroying txMessage trees,
+ * with the nodes on the heap, and on an arena which is reset after each
+ * message.  Workloads are a single row update, a 100 row snapshot batch, and
+ * decoding an encoded snapshot batch.  Also checks that messages copy
+ * correctly between the heap and an arena.
+ */
+
+static size_t g_allocs = 0;
+
+void* operator new(size_t n)
+{
+  g_allocs++;
+  void* p = malloc(n? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) throw() { free(p); }
+void operator delete(void* p, size_t) throw() { free(p); }
+
+static double now_sec()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static std::string to_s(const char* prefix, int i)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+  return buf;
+}
+
+//----------------------------------------------------------------------
+static void build_update(sam::txMessage& msg)
+{
+  msg.type("tableupdate");
+  msg.root().put_child("head").put_field("tablename", "prices");
+  msg.root().put_child("head").put_field("msgtype", "tableupdate");
+  sam::txContainer& body = msg.root().put_child("body");
+  body.put_field("rows", "1");
+  sam::txContainer& row = body.put_child("row_0");
+  row.put_field("RowKey", "VOD.L");
+  for (int c = 0; c < 10; ++c)
+    row.put_field(to_s("col", c), to_s("", c * 1000 + 7));
+}
+
+static void build_snapshot(sam::txMessage& msg)
+{
+  msg.type("tableupdate");
+  msg.root().put_child("head").put_field("tablename", "prices");
+  sam::txContainer& body = msg.root().put_child("body");
+  body.put_field("rows", "100");
+  for (int r = 0; r < 100; ++r)
+  {
+    sam::txContainer& row = body.put_child(to_s("row_", r));
+    row.put_field("RowKey", to_s("key", r));
+    for (int c = 0; c < 20; ++c)
+      row.put_field(to_s("col", c), to_s("", r * c));
+  }
+}
+
+//----------------------------------------------------------------------
+class Workload
+{
+  public:
+    virtual ~Workload() {}
+    virtual void run(sam::txMessage& msg) = 0;
+};
+
+class Build : public Workload
+{
+  public:
+    Build(void (*fn)(sam::txMessage&)) : m_fn(fn) {}
+    void run(sam::txMessage& msg) { m_fn(msg); }
+  private:
+    void (*m_fn)(sam::txMessage&);
+};
+
+class Decode : public Workload
+{
+  public:
+    Decode(sam::SAMProtocol& samp, const exio::DynamicSamBuffer& sb)
+      : m_samp(samp), m_sb(sb) {}
+    void run(sam::txMessage& msg)
+    {
+      m_samp.decodeMsg(msg, m_sb.msg_start(), m_sb.msg_size());
+    }
+  private:
+    sam::SAMProtocol& m_samp;
+    const exio::DynamicSamBuffer& m_sb;
+};
+
+//----------------------------------------------------------------------
+static void bench(const char* name, Workload& w, int n)
+{
+  sam::txArena arena;
+
+  for (int use_arena = 0; use_arena < 2; ++use_arena)
+  {
+    size_t allocs = g_allocs;
+    double t0 = now_sec();
+
+    for (int i = 0; i < n; ++i)
+    {
+      if (use_arena) arena.reset();
+      sam::txMessage msg("", use_arena? &arena : NULL);
+      w.run(msg);
+    }
+
+    double secs = now_sec() - t0;
+    std::cout << name << (use_arena? " arena" : " heap ")
+              << ": msgs=" << n
+              << " allocs_per_msg=" << double(g_allocs - allocs) / n
+              << " ns_per_msg=" << (secs * 1e9 / n) << "\n";
+  }
+}
+
+//----------------------------------------------------------------------
+static std::string format(const sam::txMessage& msg)
+{
+  exio::AppSvc appsvc;
+  sam::SAMProtocol samp(appsvc);
+  exio::DynamicSamBuffer sb;
+  samp.encodeMsg(msg, &sb);
+  return std::string(sb.msg_start(), sb.msg_size());
+}
+
+static void check_copies()
+{
+  sam::txArena a1, a2;
+
+  sam::txMessage heap;
+  build_snapshot(heap);
+
+  sam::txMessage m1("", &a1);
+  m1 = heap;                     // heap to arena
+  sam::txMessage m2("", &a2);
+  m2 = m1;                       // arena to arena
+  sam::txMessage m3(m2);         // arena to heap
+  m2.root().put_child("body").put_child("row_0").remove("col3");
+
+  if (m1.arena() != &a1 or m2.arena() != &a2 or m3.arena() != NULL)
+    throw std::runtime_error("copy changed arena");
+  if (format(m1) != format(heap) or format(m3) != format(heap)
+      or format(m2) == format(heap))
+    throw std::runtime_error("copy between arenas differs");
+
+  std::cout << "copies ok, arena chunks=" << a1.chunks()
+            << " used=" << a1.used() << "\n";
+}
+
+//----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  int n = (argc > 1)? atoi(argv[1]) : 20000;
+
+  try
+  {
+    check_copies();
+
+    Build update(build_update);
+    bench("update  ", update, n);
+
+    Build snapshot(build_snapshot);
+    bench("snapshot", snapshot, n / 50);
+
+    exio::AppSvc appsvc;
+    sam::SAMProtocol samp(appsvc);
+    sam::txMessage msg;
+    build_snapshot(msg);
+    exio::DynamicSamBuffer sb;
+    samp.encodeMsg(msg, &sb);
+    Decode decode(samp, sb);
+    bench("decode  ", decode, n / 50);
+  }
+  catch (const std::exception& e)
+  {
+    std::cout << "exception: " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,142 @@
+#include "exio/Reactor.h"
+#include "exio/AppSvc.h"
+
+#include "thread.h"
+
+#include <iostream>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/*
+ * Measure the cost of waking the reactor.  Several producer threads call
+ * Reactor::invalidate(), which is what Client::queue() does for every
+ * message queued, while the reactor thread runs its event loop.  Each
+ * producer spreads its calls over a set of idle clients, which the reactor
+ * examines but never has to serve.
+ */
+
+exio::ConsoleLogger logger(exio::ConsoleLogger::eStdout,
+                           exio::ConsoleLogger::eWarn,
+                           true);
+
+static double now_sec()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+//----------------------------------------------------------------------
+class IdleClient : public exio::ReactorClient
+{
+  public:
+    explicit IdleClient(exio::Reactor* r) : exio::ReactorClient(r, -1) {}
+    ~IdleClient() {}
+
+    IOState handle_input()  { return IO_default; }
+    IOState handle_output() { return IO_default; }
+    void handle_close() {}
+    int  events() { return 0; }
+    bool has_work() { return false; }
+    void do_work() {}
+};
+
+#define NCLIENTS 64
+
+//----------------------------------------------------------------------
+class Producer
+{
+  public:
+    Producer(exio::Reactor* r, int n, int burst)
+      : m_reactor(r), m_n(n), m_burst(burst? burst : n), m_busy(0)
+    {
+      for (int i = 0; i < NCLIENTS; ++i)
+        m_clients.push_back( new IdleClient(r) );
+    }
+
+    ~Producer()
+    {
+      for (size_t i = 0; i < m_clients.size(); ++i) delete m_clients[i];
+    }
+
+    /* Invalidate in bursts, like a table update fanned out to 'burst'
+     * subscribers, pausing between bursts so the reactor can sleep.  Only
+     * the time spent inside invalidate() is accumulated. */
+    void run()
+    {
+      for (int i = 0; i < m_n; i += m_burst)
+      {
+        double t0 = now_sec();
+        for (int j = 0; j < m_burst; ++j)
+          m_reactor->invalidate( m_clients[j % NCLIENTS] );
+        m_busy += now_sec() - t0;
+        if (i + m_burst < m_n) usleep(100);
+      }
+    }
+
+    double busy() const { return m_busy; }
+
+  private:
+    exio::Reactor* m_reactor;
+    int m_n;
+    int m_burst;
+    double m_busy;
+    std::vector<IdleClient*> m_clients;
+};
+
+//----------------------------------------------------------------------
+void bench(int nproducers, int n, int burst)
+{
+  exio::Reactor* reactor = new exio::Reactor(&logger, 1);
+
+  std::vector<Producer*>       producers;
+  std::vector<cpp11::thread*>  threads;
+  for (int i = 0; i < nproducers; ++i)
+    producers.push_back(new Producer(reactor, n, burst));
+
+  exio::Reactor::Load before = reactor->load();
+  for (int i = 0; i < nproducers; ++i)
+    threads.push_back(new cpp11::thread(&Producer::run, producers[i]));
+
+  double busy = 0;
+  for (int i = 0; i < nproducers; ++i)
+  {
+    threads[i]->join();
+    busy += producers[i]->busy();
+    delete threads[i];
+  }
+  exio::Reactor::Load after = reactor->load();
+
+  // the reactor can still hold invalidated clients, so goes first
+  delete reactor;
+  for (int i = 0; i < nproducers; ++i) delete producers[i];
+
+  double total = double(nproducers) * n;
+  std::cout << "producers=" << nproducers
+            << " burst=" << burst
+            << " invalidates=" << (long) total
+            << " ns_per_invalidate=" << (busy*1e9/total)
+            << " reactor_wakeups=" << (after.wakeups - before.wakeups)
+            << "\n";
+}
+
+//----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  int n = (argc > 1)? atoi(argv[1]) : 1000000;
+
+  /* continuous invalidation */
+  bench(1, n, 0);
+  bench(2, n, 0);
+  bench(4, n, 0);
+  bench(8, n/2, 0);
+
+  /* bursts of 500 */
+  bench(1, n/10, 500);
+  bench(4, n/10, 500);
+
+  return 0;
+}
@@ -0,0 +1,329 @@
+#include "exio/sam.h"
+#include "exio/SamBuffer.h"
+#include "exio/SamScan.h"
+#include "exio/AppSvc.h"
+#include "exio/AdminCommand.h"
+#include "exio/MsgIDs.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/*
+ * Throughput of the SAM codec on typical workloads: a table snapshot batch,
+ * a single row update, an admin response, and values which are mostly
+ * characters that need escaping.  For the text format, each delimiter
+ * scanning kernel supported by this CPU is measured; the binary format does
+ * no scanning.  Measures encode, decode to a view and to a txMessage, and
+ * calc_encoded_size, as MB of encoded message per second, and the heap
+ * allocations made per message.
+ *
+ * Usage: sam_bench [OUTFILE [MB]]
+ *
+ * Results are printed, and if OUTFILE is given, written to it as CSV, one
+ * line per workload and kernel, for comparing builds.  MB is the volume of
+ * encoded bytes processed for each measurement, default 100.
+ */
+
+static size_t g_allocs = 0;
+
+void* operator new(size_t n)
+{
+  g_allocs++;
+  void* p = malloc(n? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) throw() { free(p); }
+void operator delete(void* p, size_t) throw() { free(p); }
+
+static double now_sec()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+//----------------------------------------------------------------------
+/* A snapshot batch, laid out as DataTable sends it: rows of prices,
+ * quantities, symbols and RowLastUpdated timestamps.  The timestamps contain
+ * ':' and so are escaped, as are a few free text values. */
+static void snapshot(sam::txMessage& msg, int nrows, int ncols)
+{
+  msg.type("tableupdate");
+  msg.root().put_field("head.tablename", "lse");
+  msg.root().put_field("head.msgtype", "tableupdate");
+
+  sam::txContainer& body = msg.root().put_child("body");
+  for (int r = 0; r < nrows; ++r)
+  {
+    std::ostringstream rowname, key;
+    rowname << "row_" << r;
+    key << "SYM" << r << ".L";
+
+    sam::txContainer& row = body.put_child(rowname.str());
+    row.put_field("RowKey", key.str());
+    row.put_field("RowLastUpdated", "2026/10/17 12:34:56");
+
+    for (int c = 0; c < ncols; ++c)
+    {
+      std::ostringstream col, val;
+      col << "column_" << c;
+      if (c % 10 == 9)
+        val << "note [" << r << "], status=ok";
+      else
+        val << (r * 100 + c) << "." << (c * 7 % 100);
+      row.put_field(col.str(), val.str());
+    }
+  }
+  body.put_field("rows", "0");
+}
+
+/* One row, as published for a single update */
+static void update(sam::txMessage& msg)
+{
+  snapshot(msg, 1, 20);
+}
+
+/* Reply to an admin command listing sessions, as a single column table */
+static void admin_response(sam::txMessage& msg)
+{
+  msg.type(exio::id::msg_response);
+  msg.root().put_field(exio::id::QN_head_reqseqno, "42");
+  exio::add_rescode(msg, 0);
+
+  std::list< std::string > values;
+  for (int i = 0; i < 50; ++i)
+  {
+    std::ostringstream os;
+    os << "session " << i << " (service-id 'gui', username 'ops', "
+       << "peer 10.0.0." << i << ":5" << i << ", fd " << (i + 10) << ")";
+    values.push_back(os.str());
+  }
+  exio::formatreply_simplelist(msg.root().put_child(exio::id::body), values,
+                               "sessions");
+}
+
+/* Values which are mostly characters that need escaping */
+static void escape_heavy(sam::txMessage& msg)
+{
+  msg.type("tableupdate");
+  msg.root().put_field("head.tablename", "paths");
+
+  sam::txContainer& row = msg.root().put_child("body").put_child("row_0");
+  row.put_field("RowKey", "key:{0}");
+  for (int c = 0; c < 20; ++c)
+  {
+    std::ostringstream col, val;
+    col << "column_" << c;
+    for (int i = 0; i < 8; ++i) val << "[a=" << c << "],{b:" << i << "}\\\n";
+    row.put_field(col.str(), val.str());
+  }
+}
+
+//----------------------------------------------------------------------
+struct Result
+{
+    std::string workload;
+    std::string kernel;   // "binary" for the binary format
+    size_t bytes;
+    double encode_MBps;
+    double decode_view_MBps;
+    double decode_msg_MBps;
+    double calc_size_MBps;
+    double encode_allocs;
+    double decode_view_allocs;
+    double decode_msg_allocs;
+
+    void print(std::ostream& os, bool csv) const
+    {
+      const char* sep = csv? "," : " ";
+      if (csv)
+        os << workload << sep << kernel << sep << bytes;
+      else
+        os << "workload=" << workload << sep << "kernel=" << kernel << sep
+           << "bytes=" << bytes;
+
+      double v[] = { encode_MBps, decode_view_MBps, decode_msg_MBps,
+                     calc_size_MBps, encode_allocs, decode_view_allocs,
+                     decode_msg_allocs };
+      const char* names[] = { "encode_MBps", "decode_view_MBps",
+                              "decode_msg_MBps", "calc_size_MBps",
+                              "encode_allocs", "decode_view_allocs",
+                              "decode_msg_allocs" };
+      for (size_t i = 0; i < sizeof(v)/sizeof(v[0]); ++i)
+      {
+        os << sep;
+        if (not csv) os << names[i] << "=";
+        os << v[i];
+      }
+      os << "\n";
+    }
+
+    static void header(std::ostream& os)
+    {
+      os << "workload,kernel,bytes,encode_MBps,decode_view_MBps,"
+         << "decode_msg_MBps,calc_size_MBps,encode_allocs,"
+         << "decode_view_allocs,decode_msg_allocs\n";
+    }
+};
+
+//----------------------------------------------------------------------
+static void encode(sam::SAMProtocol& samp, const sam::txMessage& msg,
+                   exio::SamBuffer* sb, bool binary)
+{
+  if (binary)
+    samp.encodeBinary(msg, sb);
+  else
+    samp.encodeMsg(msg, sb);
+}
+
+/* Encode, decode and size a message, in the current scan kernel, or in the
+ * binary format.  Returns false if the kernel is not supported. */
+static bool bench(const char* workload, const char* kernel,
+                  const sam::txMessage& msg, double volume,
+                  std::string& expected, Result& res)
+{
+  bool const binary = (std::string(kernel) == "binary");
+  if (not binary and not sam::set_scan_kernel(kernel)) return false;
+
+  exio::AppSvc appsvc;
+  sam::SAMProtocol samp(appsvc);
+
+  exio::DynamicSamBuffer sbuf;
+  encode(samp, msg, &sbuf, binary);
+  std::string const encoded(sbuf.msg_start(), sbuf.msg_size());
+
+  // all text kernels must produce identical bytes
+  if (not binary)
+  {
+    if (expected.empty()) expected = encoded;
+    if (encoded != expected)
+    {
+      std::cout << workload << ": " << kernel << ": encoding differs\n";
+      exit(1);
+    }
+  }
+
+  // a binary decoder must first be sent the dictionary names
+  if (binary)
+  {
+    exio::DynamicSamBuffer names;
+    samp.encode_names(&names, 0,
+                      sam::SAMProtocol::names_required(encoded.data(),
+                                                       encoded.size()));
+    sam::txView view;
+    samp.decodeView(view, names.msg_start(), names.msg_size());
+  }
+
+  res.workload = workload;
+  res.kernel   = kernel;
+  res.bytes    = encoded.size();
+
+  double const mb = encoded.size() / 1e6;
+  int const n = std::max(10, int(volume / encoded.size()));
+  int const nmsg = std::max(1, n / 10);
+
+  // encode, into a new buffer each time, as for a published message
+  size_t allocs = g_allocs;
+  double t0 = now_sec();
+  for (int i = 0; i < n; ++i)
+  {
+    exio::DynamicSamBuffer b;
+    encode(samp, msg, &b, binary);
+  }
+  res.encode_MBps   = mb * n / (now_sec() - t0);
+  res.encode_allocs = double(g_allocs - allocs) / n;
+
+  // decode to a view which is reused, as a session does
+  sam::txView view;
+  samp.decodeView(view, encoded.data(), encoded.size());
+  allocs = g_allocs;
+  t0 = now_sec();
+  for (int i = 0; i < n; ++i)
+    samp.decodeView(view, encoded.data(), encoded.size());
+  res.decode_view_MBps   = mb * n / (now_sec() - t0);
+  res.decode_view_allocs = double(g_allocs - allocs) / n;
+
+  allocs = g_allocs;
+  t0 = now_sec();
+  for (int i = 0; i < nmsg; ++i)
+  {
+    sam::txMessage m;
+    samp.decodeMsg(m, encoded.data(), encoded.size());
+  }
+  res.decode_msg_MBps   = mb * nmsg / (now_sec() - t0);
+  res.decode_msg_allocs = double(g_allocs - allocs) / nmsg;
+
+  // only the text format has a size calculation
+  res.calc_size_MBps = 0;
+  if (not binary)
+  {
+    size_t total = 0;
+    t0 = now_sec();
+    for (int i = 0; i < n; ++i) total += samp.calc_encoded_size(msg);
+    res.calc_size_MBps = mb * n / (now_sec() - t0);
+    if (total == 0) exit(1);  // keep the loop
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const char* outfile = (argc > 1)? argv[1] : NULL;
+  double volume = ((argc > 2)? atof(argv[2]) : 100) * 1e6;
+
+  sam::txMessage msgs[4];
+  snapshot(msgs[0], 500, 20);
+  update(msgs[1]);
+  admin_response(msgs[2]);
+  escape_heavy(msgs[3]);
+  const char* workloads[] = { "snapshot", "update", "admin_response",
+                              "escape_heavy" };
+
+  const char* kernels[] = { "scalar", "sse2", "avx2", "binary" };
+  std::string const default_kernel = sam::scan_kernel();
+
+  std::cout << "default_kernel=" << default_kernel << "\n";
+
+  std::ostringstream csv;
+  Result::header(csv);
+
+  for (size_t w = 0; w < sizeof(workloads)/sizeof(workloads[0]); ++w)
+  {
+    std::string expected;
+    for (size_t k = 0; k < sizeof(kernels)/sizeof(kernels[0]); ++k)
+    {
+      Result res;
+      if (not bench(workloads[w], kernels[k], msgs[w], volume, expected, res))
+        continue;
+      res.print(std::cout, false);
+      res.print(csv, true);
+    }
+  }
+  sam::set_scan_kernel(default_kernel.c_str());
+
+  if (outfile)
+  {
+    std::ofstream out(outfile);
+    out << csv.str();
+    if (not out)
+    {
+      std::cout << "failed to write " << outfile << "\n";
+      return 1;
+    }
+  }
+
+  return 0;
+}
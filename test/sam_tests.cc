@@ -3,11 +3,17 @@
 
 #include "exio/sam.h"
 #include "exio/SamBuffer.h"
+#include "exio/SamScan.h"
 
 #include "exio/AppSvc.h"
 
+#include "thread.h"
+
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -170,6 +176,458 @@ void test3()
 }
 
 
+//----------------------------------------------------------------------
+std::string format(const sam::txMessage& msg)
+{
+  std::ostringstream os;
+  sam::MessageFormatter formatter(true);
+  formatter.format(msg, os);
+  return os.str();
+}
+
+void test_view()
+{
+  banner();
+
+  sam::txMessage orig("view,test");
+  orig.root().put_field("f0", "plain");
+  orig.root().put_field("f1", "has [special], chars=\\ :{}");
+  orig.root().put_child("head").put_field("command", "table");
+  orig.root().put_child("head").put_field("esc=name", "v");
+  orig.root().put_child("body").put_child("row_0").put_field("RowKey", "k0");
+  orig.root().put_child("body").put_field("rows", "1");
+  orig.root().put_field("f0", "replaced");
+
+  exio::AppSvc appsvc;
+  sam::SAMProtocol samp(appsvc);
+
+  exio::DynamicSamBuffer sbuf;
+  samp.encodeMsg(orig, &sbuf);
+
+  // decode twice into the same view, to check it can be reused
+  sam::txView view;
+  for (int i = 0; i < 2; ++i)
+  {
+    size_t consumed = samp.decodeView(view, sbuf.msg_start(), sbuf.msg_size());
+    if (consumed != sbuf.msg_size())
+      throw std::runtime_error("decodeView consumed wrong length");
+  }
+
+  if (not (view.type() == "view,test"))
+    throw std::runtime_error("decodeView wrong type");
+
+  size_t f = view.find_field(sam::qname::parse("head.command"));
+  if (f == sam::txView::npos or not (view[f].value == "table"))
+    throw std::runtime_error("decodeView failed to find head.command");
+
+  f = view.find_field(sam::txView::npos, "f1");
+  if (f == sam::txView::npos or
+      view[f].value.str() != "has [special], chars=\\ :{}")
+    throw std::runtime_error("decodeView failed to unescape");
+
+  f = view.find_field(sam::qname::parse("body.row_0.RowKey"));
+  if (f == sam::txView::npos or not (view[f].value == "k0"))
+    throw std::runtime_error("decodeView failed to find nested field");
+
+  // adapter, and the decodeMsg built on it, must give the original message
+  sam::txMessage copy;
+  view.copy_to(copy);
+  sam::txMessage decoded;
+  samp.decodeMsg(decoded, sbuf.msg_start(), sbuf.msg_size());
+
+  std::cout << "view: " << format(copy) << "\n";
+  if (format(copy) != format(orig) or format(decoded) != format(orig))
+    throw std::runtime_error("decodeView copy differs from original");
+}
+
+//----------------------------------------------------------------------
+void test_scan_kernels()
+{
+  banner();
+
+  // random strings, of a length either side of the vector widths, with
+  // special characters at random positions
+  const char alphabet[] = "abcdefgh{}\n[],=:\\";
+  char buf[100];
+  srand(1);
+
+  const char* kernels[] = { "scalar", "sse2", "avx2" };
+  for (size_t k = 0; k < sizeof(kernels)/sizeof(kernels[0]); ++k)
+  {
+    if (not sam::set_scan_kernel(kernels[k])) continue;
+    std::cout << "scan kernel: " << sam::scan_kernel() << "\n";
+
+    for (int i = 0; i < 20000; ++i)
+    {
+      size_t len = rand() % 70;
+      for (size_t j = 0; j < len; ++j)
+        buf[j] = (rand() % 8)? 'x' : alphabet[rand() % (sizeof(alphabet)-1)];
+
+      const char* end = buf + len;
+
+      const char* expect = buf;
+      while (expect < end and not sam::SAMProtocol::isSpecialChar(*expect))
+        ++expect;
+      if (sam::find_special(buf, end) != expect)
+        throw std::runtime_error("find_special failed");
+
+      expect = buf;
+      while (expect < end and *expect != ',' and *expect != '\\') ++expect;
+      if (sam::find_either(buf, end, ',', '\\') != expect)
+        throw std::runtime_error("find_either failed");
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+void test_container_lookup()
+{
+  banner();
+
+  // grow past the index threshold, with a field and a child of each name
+  sam::txContainer c("c");
+  for (int i = 0; i < 100; ++i)
+  {
+    std::ostringstream name;
+    name << "item" << i;
+    c.put_field(name.str(), name.str());
+    if (i % 2) c.put_child(name.str()).put_field("x", "y");
+  }
+  c.put_field("item7", "updated");
+
+  for (int i = 0; i < 100; ++i)
+  {
+    std::ostringstream name;
+    name << "item" << i;
+    const sam::txField* f = c.find_field(name.str());
+    const sam::txContainer* child = c.find_child(name.str());
+    if (not f or (i != 7 and f->value() != name.str()) or
+        (child != NULL) != (i % 2 == 1))
+      throw std::runtime_error("container lookup failed");
+  }
+  if (c.find_field("item7")->value() != "updated" or c.find_field("none"))
+    throw std::runtime_error("container lookup failed");
+
+  // removal shifts later items, which must still be found
+  c.remove("item3");
+  c.remove("item50");
+  if (c.find_field("item3") or c.find_child("item3") or
+      c.find_field("item50") or not c.find_field("item51"))
+    throw std::runtime_error("container remove failed");
+  if (not c.find_field("item99") or not c.find_child("item99") or
+      c.count_field() != 98 or c.count_child() != 49)
+    throw std::runtime_error("container lookup after remove failed");
+
+  // kind iterators visit items in name order, as the maps they replace did
+  size_t n = 0;
+  std::string prev;
+  for (sam::FieldMap::const_iterator i = c.field_begin();
+       i != c.field_end(); ++i, ++n)
+  {
+    if (i->second != c.find_field(i->first) or (n and i->first <= prev))
+      throw std::runtime_error("field iterator failed");
+    prev = i->first;
+  }
+  if (n != c.count_field()) throw std::runtime_error("field iterator count");
+
+  n = 0;
+  for (sam::ChildMap::const_iterator i = c.child_begin();
+       i != c.child_end(); ++i, ++n)
+  {
+    if (i->second != c.find_child(i->first) or (n and i->first <= prev))
+      throw std::runtime_error("child iterator failed");
+    prev = i->first;
+  }
+  if (n != c.count_child()) throw std::runtime_error("child iterator count");
+
+  // the order is kept until the container changes, and an iterator begun
+  // before a change keeps to the order it began with
+  sam::FieldMap::const_iterator held = c.field_begin();
+  c.put_field("aaa", "first");
+  if (c.field_begin()->first != "aaa" or held->first == "aaa" or
+      c.field_begin()->second != c.find_field("aaa"))
+    throw std::runtime_error("field order not rebuilt after change");
+
+  // an empty container has nothing to visit
+  sam::txContainer empty;
+  if (empty.field_begin() != empty.field_end() or
+      empty.child_begin() != empty.child_end())
+    throw std::runtime_error("empty iterator failed");
+
+  std::cout << "lookup: fields=" << c.count_field()
+            << " children=" << c.count_child() << "\n";
+}
+
+//----------------------------------------------------------------------
+/* Stream the message of test_stream_encode, with a row backed out */
+std::string stream_encode(sam::SAMProtocol& samp, const sam::txContainer& meta)
+{
+  exio::DynamicSamBuffer sbuf;
+  samp.encode_begin(&sbuf, "tableupdate");
+  samp.encode_open(&sbuf, "head");
+  samp.encode_field(&sbuf, "tablename", "t{1}");
+  samp.encode_field(&sbuf, "snapi", "0");
+  samp.encode_close(&sbuf);
+  samp.encode_open(&sbuf, "body");
+  samp.encode_field(&sbuf, "rows", "1");
+  samp.encode_open(&sbuf, "row_0");
+  samp.encode_field(&sbuf, "RowKey", "k=0");
+  samp.encode_child(&sbuf, meta);
+  samp.encode_close(&sbuf);
+  size_t mark = sbuf.msg_size();
+  samp.encode_open(&sbuf, "row_1");
+  samp.encode_field(&sbuf, "RowKey", "k1");
+  samp.encode_close(&sbuf);
+  sbuf.truncate(mark);
+  samp.encode_close(&sbuf);
+  samp.encode_end(&sbuf);
+
+  return std::string(sbuf.msg_start(), sbuf.msg_size());
+}
+
+void test_stream_encode()
+{
+  banner();
+
+  sam::txMessage msg("tableupdate");
+  sam::txContainer& head = msg.root().put_child("head");
+  head.put_field("tablename", "t{1}");
+  head.put_field("snapi", "0");
+  sam::txContainer& body = msg.root().put_child("body");
+  body.put_field("rows", "1");
+  sam::txContainer& row = body.put_child("row_0");
+  row.put_field("RowKey", "k=0");
+  row.put_child(".meta.c").put_field("colour", "red");
+
+  exio::AppSvc appsvc;
+  sam::SAMProtocol samp(appsvc);
+
+  exio::DynamicSamBuffer expect;
+  samp.encodeMsg(msg, &expect);
+
+  std::string a(expect.msg_start(), expect.msg_size());
+  std::string b = stream_encode(samp, *row.find_child(".meta.c"));
+  std::cout << "streamed: " << b;
+  if (a != b) throw std::runtime_error("streamed encoding differs");
+
+  // and streamed as binary.  The names required trail the message, so the
+  // stream goes first, for the backed out row's name to count in both.
+  sam::SAMProtocol binp(appsvc, sam::eBinaryFormat);
+  b = stream_encode(binp, *row.find_child(".meta.c"));
+
+  exio::DynamicSamBuffer bexpect;
+  binp.encodeBinary(msg, &bexpect);
+  a.assign(bexpect.msg_start(), bexpect.msg_size());
+  std::cout << "streamed binary: bytes=" << b.size() << "\n";
+  if (a != b) throw std::runtime_error("streamed binary encoding differs");
+}
+
+//----------------------------------------------------------------------
+void test_name_capacity()
+{
+  banner();
+
+  sam::txNameDict dict(2);
+  if (dict.lookup("a") != 0 or dict.lookup("b") != 1)
+    throw std::runtime_error("name ids not assigned in order");
+  if (dict.lookup("c") != sam::txNameDict::npos)
+    throw std::runtime_error("name added beyond capacity");
+  if (dict.lookup("a") != 0 or dict.size() != 2)
+    throw std::runtime_error("full dictionary lost a name");
+  if (dict.lookup(std::string(sam::txNameDict::MAX_NAME_LEN + 1, 'x'))
+      != sam::txNameDict::npos)
+    throw std::runtime_error("long name added");
+}
+
+//----------------------------------------------------------------------
+struct NameUser
+{
+    NameUser(sam::txNameDict& d, int n, int step) : dict(d), ids(n)
+    {
+      for (int i = 0; i < n; ++i) order.push_back( (i * step) % n );
+    }
+
+    void run()
+    {
+      for (size_t i = 0; i < order.size(); ++i)
+      {
+        std::ostringstream os;
+        os << "name" << order[i];
+        ids[ order[i] ] = dict.lookup(os.str());
+      }
+    }
+
+    sam::txNameDict& dict;
+    std::vector<int> order;
+    std::vector<size_t> ids;
+};
+
+//----------------------------------------------------------------------
+void test_name_threads()
+{
+  banner();
+
+  // threads adding the same names, in different orders, must agree on ids
+  const int n = 1000;
+  sam::txNameDict dict(n);
+  int const steps[] = {1, 7, 13, 999};
+  std::vector<NameUser*> users;
+  std::vector<cpp11::thread*> threads;
+  for (size_t i = 0; i < sizeof(steps)/sizeof(steps[0]); ++i)
+    users.push_back(new NameUser(dict, n, steps[i]));
+  for (size_t i = 0; i < users.size(); ++i)
+    threads.push_back(new cpp11::thread(&NameUser::run, users[i]));
+  for (size_t i = 0; i < threads.size(); ++i)
+  {
+    threads[i]->join();
+    delete threads[i];
+  }
+
+  std::vector<std::string> names;
+  dict.names(0, dict.size(), names);
+  bool ok = (dict.size() == (size_t) n);
+  for (size_t i = 0; i < users.size(); ++i)
+  {
+    for (int j = 0; ok and j < n; ++j)
+    {
+      std::ostringstream os;
+      os << "name" << j;
+      size_t const id = users[i]->ids[j];
+      ok = (id == users[0]->ids[j] and id < names.size() and
+            names[id] == os.str());
+    }
+  }
+  for (size_t i = 0; i < users.size(); ++i) delete users[i];
+  std::cout << "names=" << names.size() << "\n";
+  if (!ok) throw std::runtime_error("threads disagree on name ids");
+}
+
+//----------------------------------------------------------------------
+void test_partial_decode()
+{
+  banner();
+
+  sam::txMessage msg("partial");
+  sam::txContainer& body = msg.root().put_child("body");
+  for (int i = 0; i < 100; ++i)
+  {
+    std::ostringstream os;
+    os << "f" << i;
+    body.put_field(os.str(), "value=[" + os.str() + "]");
+  }
+
+  exio::AppSvc appsvc;
+  sam::SAMProtocol samp(appsvc);
+
+  exio::DynamicSamBuffer sbuf;
+  samp.encodeMsg(msg, &sbuf);
+
+  // Two messages back to back, presented a few bytes more at a time, from
+  // the start of the first not yet decoded, as a socket reader would.
+  std::string in(sbuf.msg_start(), sbuf.msg_size());
+  in += in;
+
+  size_t const msglen = sbuf.msg_size();
+  size_t pos = 0;
+  size_t avail = 0;
+  int decoded = 0;
+  while (pos < in.size())
+  {
+    avail = std::min(in.size(), avail + 7);
+
+    sam::txMessage out;
+    size_t consumed = samp.decodeMsg(out, in.data() + pos, avail - pos);
+    if (consumed)
+    {
+      if (consumed != msglen or format(out) != format(msg))
+        throw std::runtime_error("partial decode gave wrong message");
+      if (samp.pending_length() != 0)
+        throw std::runtime_error("pending length not reset");
+      pos += consumed;
+      decoded++;
+    }
+    else if (avail - pos > 20 and samp.pending_length() != msglen)
+    {
+      throw std::runtime_error("pending length not known from header");
+    }
+  }
+
+  std::cout << "partial: decoded=" << decoded << ", msglen=" << msglen << "\n";
+  if (decoded != 2) throw std::runtime_error("partial decode missed message");
+}
+
+//----------------------------------------------------------------------
+void test_binary()
+{
+  banner();
+
+  sam::txMessage msg("tableupdate");
+  msg.root().put_child("head").put_field("tablename", "t{1}");
+  sam::txContainer& body = msg.root().put_child("body");
+  body.put_field("rows", "1");
+  sam::txContainer& row = body.put_child("row_0");
+  row.put_field("RowKey", "k=[0],\\:{}\n");
+  row.put_field(std::string(100, 'x'), "long name, sent inline");
+  row.put_field("empty", "");
+  row.put_child(".meta.c").put_field("colour", "red");
+
+  exio::AppSvc appsvc;
+  sam::SAMProtocol enc(appsvc);
+
+  exio::DynamicSamBuffer sbuf;
+  enc.encodeBinary(msg, &sbuf);
+
+  size_t const need = sam::SAMProtocol::names_required(sbuf.msg_start(),
+                                                       sbuf.msg_size());
+  if (need == 0 or need > sam::txNameDict::global().size())
+    throw std::runtime_error("binary message names_required wrong");
+
+  // a decoder which has not been sent the names must reject the message
+  sam::SAMProtocol dec(appsvc);
+  sam::txMessage out;
+  try
+  {
+    dec.decodeMsg(out, sbuf.msg_start(), sbuf.msg_size());
+    throw std::logic_error("undefined names not detected");
+  }
+  catch (const std::runtime_error&) {}
+
+  // send the names in two frames, then the message
+  exio::DynamicSamBuffer names1, names2;
+  enc.encode_names(&names1, 0, need / 2);
+  enc.encode_names(&names2, need / 2, need);
+
+  std::string in(names1.msg_start(), names1.msg_size());
+  in.append(names2.msg_start(), names2.msg_size());
+  in.append(sbuf.msg_start(), sbuf.msg_size());
+
+  sam::txView view;
+  size_t pos = 0;
+  int frames = 0;
+  while (pos < in.size())
+  {
+    bool decoded = false;
+    size_t consumed = dec.decodeView(view, in.data() + pos,
+                                     in.size() - pos, decoded);
+    if (consumed == 0) throw std::runtime_error("binary frame not decoded");
+    if (decoded != (pos + consumed == in.size()))
+      throw std::runtime_error("names frame decoded as a message");
+    pos += consumed;
+    frames++;
+  }
+
+  view.copy_to(out);
+  exio::DynamicSamBuffer text;
+  enc.encodeMsg(msg, &text);
+
+  std::cout << "binary: frames=" << frames
+            << ", bytes=" << sbuf.msg_size()
+            << ", text bytes=" << text.msg_size()
+            << ", names=" << need << "\n";
+  if (format(out) != format(msg))
+    throw std::runtime_error("binary decode differs from original");
+}
+
 int main(int argc, char** argv)
 {
   try
@@ -177,6 +635,14 @@ int main(int argc, char** argv)
     test0();
     test_add_field_and_child_same_name();
     test1();
+    test_view();
+    test_scan_kernels();
+    test_stream_encode();
+    test_name_capacity();
+    test_name_threads();
+    test_container_lookup();
+    test_partial_decode();
+    test_binary();
     //test2();
     test3();
   }
@@ -0,0 +1,168 @@
+#include "exio/AdminInterface.h"
+#include "exio/AppSvc.h"
+
+#include "thread.h"
+#include "mutex.h"
+#include "atomic.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+/*
+ * Measure the latency of table updates while another thread copies the
+ * whole table, as a "table show" admin does, compared with no copies running.
+ * The writer sets every row to the number of its pass over the table, so
+ * that a consistent copy holds one pass number for a leading run of rows,
+ * and the previous for the rest; each copy is checked for that.
+ */
+
+exio::ConsoleLogger logger(exio::ConsoleLogger::eStdout,
+                           exio::ConsoleLogger::eWarn,
+                           true);
+
+static double now_sec()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static std::string to_s(const char* prefix, int i)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+  return buf;
+}
+
+//----------------------------------------------------------------------
+class Copier
+{
+  public:
+    Copier(exio::AdminInterface& ai, const std::string& table)
+      : m_ai(ai), m_table(table), m_copies(0), m_bad(0) {}
+
+    void run()
+    {
+      while (not m_stop.load())
+      {
+        std::vector< std::string > cols;
+        std::vector< std::vector< std::string > > rows;
+        m_ai.copy_table2(m_table, cols, rows);
+
+        std::vector< std::string >::iterator pos =
+          std::find(cols.begin(), cols.end(), "pass");
+        if (pos == cols.end()) continue;
+        size_t const c = pos - cols.begin();
+
+        // pass numbers may only fall, and by one, along the rows
+        if (not rows.empty())
+        {
+          int const first = atoi(rows.front()[c].c_str());
+          int prev = first;
+          for (size_t r = 0; r < rows.size(); ++r)
+          {
+            int const p = atoi(rows[r][c].c_str());
+            if (p > prev or p < first - 1) { m_bad++; break; }
+            prev = p;
+          }
+        }
+        m_copies++;
+      }
+    }
+
+    void stop() { m_stop.store(true); }
+    int copies() const { return m_copies; }
+    int bad() const { return m_bad; }
+
+  private:
+    exio::AdminInterface& m_ai;
+    std::string m_table;
+    cpp11::atomic<bool> m_stop;
+    int m_copies;
+    int m_bad;
+};
+
+//----------------------------------------------------------------------
+static void bench(exio::AdminInterface& ai, const std::string& table,
+                  int nrows, int passes, int& pass, bool copying)
+{
+  Copier copier(ai, table);
+  cpp11::thread* th = NULL;
+  if (copying) th = new cpp11::thread(&Copier::run, &copier);
+
+  exio::TableHandle t = ai.table(table);
+  size_t const col = t.column("pass");
+  std::vector< exio::RowHandle > rows;
+  for (int r = 0; r < nrows; ++r) rows.push_back( t.row(to_s("row", r)) );
+
+  std::vector< double > lat;
+  lat.reserve( (size_t) nrows * passes );
+
+  double t0 = now_sec();
+  for (int p = 0; p < passes; ++p)
+  {
+    ++pass;
+    for (int r = 0; r < nrows; ++r)
+    {
+      double const u0 = now_sec();
+      rows[r].update_int64(col, pass);
+      lat.push_back( now_sec() - u0 );
+    }
+  }
+  double secs = now_sec() - t0;
+
+  if (th)
+  {
+    copier.stop();
+    th->join();
+    delete th;
+  }
+
+  std::sort(lat.begin(), lat.end());
+  std::cout << "copying=" << (copying? "yes" : "no")
+            << " updates=" << lat.size()
+            << " updates_per_sec=" << (long)(lat.size() / secs)
+            << " p99_us=" << lat[lat.size() * 99 / 100] * 1e6
+            << " p999_us=" << lat[lat.size() * 999 / 1000] * 1e6
+            << " max_us=" << lat.back() * 1e6
+            << " copies=" << copier.copies()
+            << " inconsistent=" << copier.bad() << "\n";
+
+  if (copier.bad())
+  {
+    std::cout << "FAIL: inconsistent copies\n";
+    exit(1);
+  }
+}
+
+//----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  int nrows = (argc > 1)? atoi(argv[1]) : 100000;
+  int passes = (argc > 2)? atoi(argv[2]) : 20;
+
+  exio::Config config;
+  config.serviceid = "snapshot_bench";
+  exio::AdminInterface ai(config, &logger);
+
+  // a table of several columns, as a copy would usually see
+  const std::string table = "snap";
+  std::map<std::string, std::string> fields;
+  fields["bid"]  = "100.25";
+  fields["ask"]  = "100.50";
+  fields["qty"]  = "1000";
+  fields["pass"] = "0";
+  for (int r = 0; r < nrows; ++r) ai.monitor_update(table, to_s("row", r),
+                                                    fields);
+
+  int pass = 0;
+  bench(ai, table, nrows, passes, pass, false);
+  bench(ai, table, nrows, passes, pass, true);
+
+  return 0;
+}
@@ -0,0 +1,184 @@
+#include "exio/AdminInterface.h"
+#include "exio/AppSvc.h"
+
+#include <iostream>
+#include <sstream>
+#include <list>
+#include <vector>
+#include <algorithm>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <malloc.h>
+#include <sys/time.h>
+
+/*
+ * Measure table row management.  Loads a table, looks rows up by key, then
+ * churns it by repeatedly deleting the oldest row and inserting a new one.
+ * Updates rows singly, in batches, and through row handles, and checks that
+ * rows are still reported in insertion order, and that a handle to a deleted
+ * row adds it again.  Finally loads a
+ * wide table to measure the heap used per cell.
+ */
+
+exio::ConsoleLogger logger(exio::ConsoleLogger::eStdout,
+                           exio::ConsoleLogger::eWarn,
+                           true);
+
+static double now_sec()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static std::string rowkey(int i)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "row%d", i);
+  return buf;
+}
+
+/* bytes currently allocated from the heap */
+static size_t heap_used()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  struct mallinfo2 mi = mallinfo2();
+#else
+  struct mallinfo mi = mallinfo();
+#endif
+  return mi.uordblks + mi.hblkhd;  // heap, plus large mmap blocks
+}
+
+static void report(const char* phase, int n, double secs)
+{
+  std::cout << phase << ": ops=" << n
+            << " secs=" << secs
+            << " ns_per_op=" << (secs * 1e9 / n) << "\n";
+}
+
+//----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  int n = (argc > 1)? atoi(argv[1]) : 1000000;
+  int wrows = (argc > 2)? atoi(argv[2]) : std::max(1, n / 100);
+
+  exio::Config config;
+  config.serviceid = "table_bench";
+  exio::AdminInterface ai(config, &logger);
+
+  const std::string table = "bench";
+  std::map<std::string, std::string> fields;
+  fields["bid"] = "100.25";
+  fields["ask"] = "100.50";
+  fields["qty"] = "1000";
+
+  /* load */
+  double t0 = now_sec();
+  for (int i = 0; i < n; ++i)
+    ai.monitor_update(table, rowkey(i), fields);
+  report("load", n, now_sec() - t0);
+
+  /* lookup */
+  std::string dest;
+  int found = 0;
+  srand(1);
+  t0 = now_sec();
+  for (int i = 0; i < n; ++i)
+    found += ai.copy_field(table, rowkey(rand() % n), "bid", dest);
+  report("lookup", n, now_sec() - t0);
+
+  /* churn: delete the oldest row, insert a new one */
+  t0 = now_sec();
+  for (int i = 0; i < n; ++i)
+  {
+    ai.delete_row(table, rowkey(i));
+    ai.monitor_update(table, rowkey(n + i), fields);
+  }
+  report("churn", n, now_sec() - t0);
+
+  /* update every row, one call per row, then in batches of 100 */
+  std::map<std::string, std::string> fields2 = fields;
+  std::map<std::string, std::string> fields3 = fields;
+  fields2["qty"] = "2000";
+  fields3["qty"] = "3000";
+  t0 = now_sec();
+  for (int i = 0; i < n; ++i)
+    ai.monitor_update(table, rowkey(n + i), fields2);
+  report("update", n, now_sec() - t0);
+
+  // batches are prepared before timing, as the single row maps were
+  std::vector< exio::AdminInterface::Table > batches( (n + 99) / 100 );
+  for (int i = 0; i < n; ++i)
+    batches[i / 100][rowkey(n + i)] = fields3;
+
+  t0 = now_sec();
+  for (size_t b = 0; b < batches.size(); ++b)
+    ai.monitor_update_batch(table, batches[b]);
+  report("update_batch", n, now_sec() - t0);
+
+  // handles are obtained before timing, as a caller would keep them
+  exio::TableHandle th = ai.table(table);
+  size_t const qty = th.column("qty");
+  std::vector< exio::RowHandle > handles;
+  handles.reserve(n);
+  for (int i = 0; i < n; ++i)
+    handles.push_back( th.row(rowkey(n + i)) );
+
+  const std::string qty4 = "4000";
+  t0 = now_sec();
+  for (int i = 0; i < n; ++i)
+    handles[i].update(qty, qty4);
+  report("update_handle", n, now_sec() - t0);
+
+  /* handle check: values applied, and a deleted row is added again */
+  bool handles_ok = ai.copy_field(table, rowkey(n), "qty", dest)
+    and dest == qty4;
+  ai.delete_row(table, rowkey(n));
+  handles[0].update(qty, "5000");
+  handles_ok = handles_ok and ai.copy_field(table, rowkey(n), "qty", dest)
+    and dest == "5000" and not ai.copy_field(table, rowkey(n), "bid", dest);
+
+  // re-inserted row is now the newest
+  ai.delete_row(table, rowkey(n));
+  ai.monitor_update(table, rowkey(n), fields3);
+
+  /* order check */
+  std::list< std::string > keys;
+  ai.copy_rowkeys(table, keys);
+
+  bool ordered = (keys.size() == (size_t) n);
+  int expect = n + 1;
+  for (std::list< std::string >::iterator it = keys.begin();
+       ordered and it != keys.end(); ++it)
+  {
+    ordered = (*it == rowkey(expect++));
+    if (expect == 2 * n) expect = n;
+  }
+
+  std::cout << "rows=" << keys.size()
+            << " found=" << found
+            << " order=" << (ordered? "ok" : "FAIL")
+            << " handles=" << (handles_ok? "ok" : "FAIL") << "\n";
+
+  /* memory: a wide table, of short values */
+  const int wcols = 50;
+  std::map<std::string, std::string> wide;
+  for (int c = 0; c < wcols; ++c)
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "column_%02d", c);
+    wide[name] = "1234.50";
+  }
+
+  size_t heap0 = heap_used();
+  for (int i = 0; i < wrows; ++i)
+    ai.monitor_update("wide", rowkey(i), wide);
+  size_t heap1 = heap_used();
+
+  std::cout << "wide: rows=" << wrows << " cols=" << wcols
+            << " bytes_per_cell="
+            << double(heap1 - heap0) / (double(wrows) * wcols) << "\n";
+
+  return (ordered and handles_ok)? 0 : 1;
+}
@@ -0,0 +1,546 @@
+#include "exio/AdminInterface.h"
+#include "exio/AppSvc.h"
+
+#include "thread.h"
+#include "mutex.h"
+#include "atomic.h"
+
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Behaviour of monitoring tables, through the AdminInterface.  Each check is
+ * of the table contents or its update counts, so no check depends on timing.
+ */
+
+exio::ConsoleLogger logger(exio::ConsoleLogger::eStdout,
+                           exio::ConsoleLogger::eWarn,
+                           true);
+
+void banner()
+{
+  for (int i = 0; i < 80; ++i)
+    std::cout << "-";
+  std::cout <<"\n";
+}
+
+static std::string to_s(const char* prefix, int i)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+  return buf;
+}
+
+static void check(bool ok, const std::string& what)
+{
+  if (not ok) throw std::runtime_error(what);
+}
+
+static std::string field(exio::AdminInterface& ai, const std::string& table,
+                         const std::string& rowkey, const std::string& name)
+{
+  std::string value;
+  if (not ai.copy_field(table, rowkey, name, value)) return "<absent>";
+  return value;
+}
+
+static uint64_t received(exio::AdminInterface& ai, const std::string& table)
+{
+  uint64_t in = 0, out = 0;
+  check(ai.table_update_counts(table, in, out), "no counts for " + table);
+  return in;
+}
+
+static uint64_t published(exio::AdminInterface& ai, const std::string& table)
+{
+  uint64_t in = 0, out = 0;
+  check(ai.table_update_counts(table, in, out), "no counts for " + table);
+  return out;
+}
+
+//----------------------------------------------------------------------
+/* Rows are found by key, and kept in insertion order, as rows are deleted
+ * and added again */
+void test_row_index(exio::AdminInterface& ai)
+{
+  banner();
+
+  const std::string table = "row_index";
+  const int n = 1000;
+
+  std::map<std::string, std::string> fields;
+  for (int i = 0; i < n; ++i)
+  {
+    fields["n"] = to_s("", i);
+    ai.monitor_update(table, to_s("key", i), fields);
+  }
+
+  for (int i = 0; i < n; i += 3) ai.delete_row(table, to_s("key", i));
+  for (int i = 0; i < n; ++i)
+    check(ai.has_row(table, to_s("key", i)) == (i % 3 != 0),
+          "has_row wrong for " + to_s("key", i));
+
+  // a deleted row added again is the newest
+  for (int i = 0; i < n; i += 6)
+  {
+    fields["n"] = to_s("again", i);
+    ai.monitor_update(table, to_s("key", i), fields);
+  }
+
+  std::vector< std::string > expect;
+  for (int i = 0; i < n; ++i) if (i % 3) expect.push_back( to_s("key", i) );
+  for (int i = 0; i < n; i += 6) expect.push_back( to_s("key", i) );
+
+  std::list< std::string > keys;
+  ai.copy_rowkeys(table, keys);
+  check(keys.size() == expect.size() and
+        std::equal(expect.begin(), expect.end(), keys.begin()),
+        "rows not in insertion order");
+
+  check(field(ai, table, "key6", "n") == "again6", "re-added row lost value");
+  check(field(ai, table, "key7", "n") == "7", "row value lost");
+  check(not ai.has_row(table, "key3"), "deleted row found");
+  check(not ai.has_row(table, "key"), "missing row found");
+
+  std::cout << "row_index: rows=" << keys.size() << "\n";
+}
+
+//----------------------------------------------------------------------
+/* Cells are held by column.  A new column is given the empty value in the
+ * rows already held, while a row added later has only the cells set for it. */
+void test_columns(exio::AdminInterface& ai)
+{
+  banner();
+
+  const std::string table = "columns";
+  std::map<std::string, std::string> fields;
+  fields["a"] = "1";
+  fields["b"] = "2";
+  ai.monitor_update(table, "r1", fields);
+  fields.clear();
+  fields["c"] = "3";
+  ai.monitor_update(table, "r2", fields);
+
+  std::list< std::string > extra(1, "d");
+  ai.add_columns(table, extra);
+
+  std::vector< std::string > cols;
+  std::vector< std::vector< std::string > > rows;
+  ai.copy_table2(table, cols, rows);
+  check(rows.size() == 2, "copy lacks rows");
+
+  const char* names[] = { "a", "b", "c", "d" };
+  const char* r1[]    = { "1", "2", "",  ""  };
+  const char* r2[]    = { "",  "",  "3", ""  };
+  for (size_t i = 0; i < 4; ++i)
+  {
+    std::vector< std::string >::iterator pos =
+      std::find(cols.begin(), cols.end(), names[i]);
+    check(pos != cols.end(), std::string("copy lacks column ") + names[i]);
+    size_t const c = pos - cols.begin();
+    check(rows[0][c] == r1[i] and rows[1][c] == r2[i],
+          std::string("copy wrong in column ") + names[i]);
+  }
+
+  exio::AdminInterface::Row row;
+  ai.copy_row(table, "r2", row);
+  check(row.count("c") == 1 and row.count("d") == 1, "new column not set");
+  check(row.count("a") == 0 and row.count("b") == 0,
+        "row added later has cells not set for it");
+  check(field(ai, table, "r1", "c") == "", "new column not set empty");
+
+  // a wide row, across many new columns
+  fields.clear();
+  for (int c = 0; c < 100; ++c) fields[ to_s("wide_", c) ] = to_s("v", c);
+  ai.monitor_update(table, "r3", fields);
+  for (int c = 0; c < 100; ++c)
+  {
+    check(field(ai, table, "r3", to_s("wide_", c)) == to_s("v", c),
+          "wide row cell lost");
+    check(field(ai, table, "r1", to_s("wide_", c)) == "",
+          "new column not set empty");
+  }
+  check(field(ai, table, "r3", "a") == "<absent>", "unset cell found");
+
+  std::cout << "columns: columns=" << cols.size() << "\n";
+}
+
+//----------------------------------------------------------------------
+/* Copies of a table, which share its blocks, match the table as it was when
+ * copied, as rows across many blocks are changed, deleted and added, and the
+ * table is cleared.  RowLastUpdated is left out of the comparison. */
+void test_shared_blocks(exio::AdminInterface& ai)
+{
+  banner();
+
+  const std::string table = "shared_blocks";
+  const int n = 200;  // several blocks of rows
+
+  exio::AdminInterface::Table model, last;
+  std::map<std::string, std::string> fields;
+
+  for (int round = 0; round < 20; ++round)
+  {
+    // nothing has changed since the last copy
+    exio::AdminInterface::Table before;
+    ai.copy_table(table, before);
+    check(before == last, "table changed between copies");
+
+    for (int i = round % 7; i < n; i += 7)
+    {
+      const std::string key = to_s("key", i);
+      if ((i + round) % 5 == 0)
+      {
+        ai.delete_row(table, key);
+        model.erase(key);
+        continue;
+      }
+
+      fields.clear();
+      fields["round"] = to_s("", round);
+      if (i % 2) fields["odd"] = to_s("", i);
+      ai.monitor_update(table, key, fields);
+
+      for (std::map<std::string, std::string>::iterator f = fields.begin();
+           f != fields.end(); ++f) model[key][f->first] = f->second;
+    }
+
+    if (round == 10)
+    {
+      ai.clear_table(table);
+      model.clear();
+    }
+
+    exio::AdminInterface::Table after;
+    ai.copy_table(table, after);
+
+    check(after.size() == model.size(), "copy size differs from model");
+    for (exio::AdminInterface::Table::iterator r = model.begin();
+         r != model.end(); ++r)
+    {
+      exio::AdminInterface::Table::iterator c = after.find(r->first);
+      check(c != after.end(), "copy lacks row " + r->first);
+      for (exio::AdminInterface::Row::iterator f = r->second.begin();
+           f != r->second.end(); ++f)
+        check(c->second[f->first] == f->second,
+              "copy differs at " + r->first + "." + f->first);
+    }
+
+    last.swap(after);
+  }
+
+  std::cout << "shared_blocks: rows=" << model.size() << "\n";
+}
+
+//----------------------------------------------------------------------
+/* Copies taken while another thread updates the table are consistent.  The
+ * writer sets every row to the number of its pass, in insertion order, so a
+ * copy holds one pass number for a leading run of rows, and the previous for
+ * the rest. */
+class PassWriter
+{
+  public:
+    PassWriter(exio::AdminInterface& ai, const std::string& table,
+               int nrows, int passes)
+      : m_ai(ai), m_table(table), m_nrows(nrows), m_passes(passes) {}
+
+    void run()
+    {
+      exio::TableHandle t = m_ai.table(m_table);
+      size_t const col = t.column("pass");
+      std::vector< exio::RowHandle > rows;
+      for (int r = 0; r < m_nrows; ++r) rows.push_back( t.row(to_s("row", r)) );
+
+      for (int p = 1; p <= m_passes; ++p)
+        for (int r = 0; r < m_nrows; ++r) rows[r].update_int64(col, p);
+
+      m_done.store(true);
+    }
+
+    bool done() const { return m_done.load(); }
+
+  private:
+    exio::AdminInterface& m_ai;
+    std::string m_table;
+    int m_nrows;
+    int m_passes;
+    cpp11::atomic<bool> m_done;
+};
+
+void test_copy_while_updating(exio::AdminInterface& ai)
+{
+  banner();
+
+  const std::string table = "copy_while_updating";
+  const int nrows = 500;
+
+  std::map<std::string, std::string> fields;
+  fields["pass"] = "0";
+  for (int r = 0; r < nrows; ++r)
+    ai.monitor_update(table, to_s("row", r), fields);
+
+  PassWriter writer(ai, table, nrows, 200);
+  cpp11::thread th(&PassWriter::run, &writer);
+
+  int copies = 0;
+  bool last = false;
+  try
+  {
+    while (not last)
+    {
+      last = writer.done();  // so one copy is always of the final table
+
+      std::vector< std::string > cols;
+      std::vector< std::vector< std::string > > rows;
+      ai.copy_table2(table, cols, rows);
+
+      std::vector< std::string >::iterator pos =
+        std::find(cols.begin(), cols.end(), "pass");
+      check(pos != cols.end(), "copy lacks pass column");
+      check(rows.size() == (size_t) nrows, "copy lacks rows");
+
+      size_t const c = pos - cols.begin();
+      int const first = atoi(rows.front()[c].c_str());
+      int prev = first;
+      for (size_t r = 0; r < rows.size(); ++r)
+      {
+        int const p = atoi(rows[r][c].c_str());
+        check(p <= prev and p >= first - 1, "inconsistent copy");
+        prev = p;
+      }
+      if (last) check(first == 200 and prev == 200, "final copy not current");
+      copies++;
+    }
+  }
+  catch (...)
+  {
+    th.join();  // the writer is not stopped early
+    throw;
+  }
+  th.join();
+
+  std::cout << "copy_while_updating: copies=" << copies << "\n";
+}
+
+//----------------------------------------------------------------------
+/* Only a change to a cell is counted as an update.  A typed cell is compared
+ * as a number, and a change of type is a change; values are formatted when
+ * copied. */
+void test_typed_cells(exio::AdminInterface& ai)
+{
+  banner();
+
+  const std::string table = "typed_cells";
+  exio::TableHandle t = ai.table(table);
+  size_t const c = t.column("value");
+  size_t const d = t.column("other");
+  exio::RowHandle row = t.row("r");
+
+  row.update_int64(c, 5);
+  uint64_t const base = received(ai, table);
+
+  row.update_int64(c, 5);
+  check(received(ai, table) == base, "same int64 counted as update");
+  check(field(ai, table, "r", "value") == "5", "int64 formatted wrong");
+
+  // values of the same bits, but another type, are changes
+  row.update_int64(c, 0);
+  row.update_double(c, 0.0);
+  check(received(ai, table) == base + 2, "int64 to double not an update");
+  row.update_double(c, 0.0);
+  check(received(ai, table) == base + 2, "same double counted as update");
+
+  row.update(c, "0");
+  check(received(ai, table) == base + 3, "double to text not an update");
+  row.update(c, "0");
+  check(received(ai, table) == base + 3, "same text counted as update");
+
+  row.update_int64(c, 1);
+  row.update_bool(c, true);
+  check(received(ai, table) == base + 5, "int64 to bool not an update");
+  check(field(ai, table, "r", "value") == "true", "bool formatted wrong");
+  row.update_bool(c, false);
+  check(field(ai, table, "r", "value") == "false", "bool formatted wrong");
+
+  row.update_double(c, 100.25);
+  check(field(ai, table, "r", "value") == "100.25", "double formatted wrong");
+  row.update_int64(c, -42);
+  check(field(ai, table, "r", "value") == "-42", "int64 formatted wrong");
+
+  // several cells are one row update
+  uint64_t const before = received(ai, table);
+  std::vector< exio::RowHandle::TypedCell > cells;
+  cells.push_back( exio::RowHandle::TypedCell::int64(c, 7) );
+  cells.push_back( exio::RowHandle::TypedCell::real(d, 0.5) );
+  row.update(cells);
+  check(received(ai, table) == before + 1, "cells not a single update");
+  check(field(ai, table, "r", "other") == "0.5", "cell of update lost");
+  row.update(cells);
+  check(received(ai, table) == before + 1, "same cells counted as update");
+
+  // the reserved columns cannot be updated
+  bool threw = false;
+  try { t.column("RowKey"); } catch (const std::exception&) { threw = true; }
+  check(threw, "RowKey column allowed");
+
+  std::cout << "typed_cells: updates=" << received(ai, table) << "\n";
+}
+
+//----------------------------------------------------------------------
+/* A conflated table publishes each changed row once per interval, with its
+ * latest values.  The interval here is long enough not to elapse, and
+ * turning conflation off flushes the rows pending. */
+void test_conflation(exio::AdminInterface& ai)
+{
+  banner();
+
+  const std::string table = "conflation";
+  exio::TableHandle t = ai.table(table);
+  size_t const c = t.column("value");
+  exio::RowHandle a = t.row("a");
+  exio::RowHandle b = t.row("b");
+
+  a.update_int64(c, 0);
+  b.update_int64(c, 0);
+  uint64_t const in = received(ai, table);
+  uint64_t const out = published(ai, table);
+
+  ai.table_conflation(table, 3600 * 1000);
+  for (int i = 1; i <= 10; ++i)
+  {
+    a.update_int64(c, i);
+    b.update(c, to_s("", i));
+  }
+  a.update_int64(c, 10);  // unchanged
+
+  check(received(ai, table) == in + 20, "conflated updates not received");
+  check(published(ai, table) == out, "conflated updates published early");
+  check(field(ai, table, "a", "value") == "10", "latest value not held");
+
+  ai.table_conflation(table, 0);
+  check(published(ai, table) == out + 2, "one update per row not flushed");
+
+  a.update_int64(c, 11);
+  check(published(ai, table) == out + 3, "unconflated update not published");
+
+  std::cout << "conflation: received=" << received(ai, table) - in
+            << " published=" << published(ai, table) - out << "\n";
+}
+
+//----------------------------------------------------------------------
+/* A handle finds its row again after the row is deleted, or the table
+ * cleared, and never updates another row added to the slot it held */
+void test_row_handles(exio::AdminInterface& ai)
+{
+  banner();
+
+  const std::string table = "row_handles";
+  exio::TableHandle t = ai.table(table);
+  size_t const c = t.column("value");
+
+  exio::RowHandle a = t.row("a");
+  exio::RowHandle b = t.row("b");
+  a.update(c, "a1");
+  b.update(c, "b1");
+
+  // the slot freed by b is taken by c
+  ai.delete_row(table, "b");
+  std::map<std::string, std::string> fields;
+  fields["other"] = "c1";
+  ai.monitor_update(table, "c", fields);
+
+  b.update(c, "b2");
+  check(field(ai, table, "b", "value") == "b2", "handle did not add row");
+  check(field(ai, table, "c", "value") == "<absent>",
+        "handle updated another row");
+  check(field(ai, table, "c", "other") == "c1", "other row changed");
+  check(field(ai, table, "a", "value") == "a1", "other row changed");
+
+  std::list< std::string > keys;
+  ai.copy_rowkeys(table, keys);
+  check(keys.size() == 3 and keys.back() == "b", "re-added row not newest");
+
+  ai.clear_table(table);
+  a.update(c, "a2");
+  check(field(ai, table, "a", "value") == "a2", "handle lost after clear");
+  check(not ai.has_row(table, "b") and not ai.has_row(table, "c"),
+        "cleared rows found");
+
+  keys.clear();
+  ai.copy_rowkeys(table, keys);
+  check(keys.size() == 1, "clear left rows");
+
+  std::cout << "row_handles: rows=" << keys.size() << "\n";
+}
+
+//----------------------------------------------------------------------
+/* Many tables are each found by name, by the name lookups and the handles */
+void test_registry(exio::AdminInterface& ai)
+{
+  banner();
+
+  const int n = 300;
+  std::map<std::string, std::string> fields;
+  for (int i = 0; i < n; ++i)
+  {
+    fields["n"] = to_s("", i);
+    ai.monitor_update(to_s("reg_", i), "r", fields);
+  }
+
+  for (int i = 0; i < n; ++i)
+  {
+    const std::string name = to_s("reg_", i);
+    check(ai.has_table(name), "table not found: " + name);
+    check(field(ai, name, "r", "n") == to_s("", i), "wrong table: " + name);
+
+    exio::TableHandle t = ai.table(name);
+    check(t.valid() and t.table_name() == name, "wrong handle: " + name);
+    t.row("s").update(t.column("n"), to_s("s", i));
+  }
+
+  for (int i = 0; i < n; ++i)
+  {
+    const std::string name = to_s("reg_", i);
+    check(field(ai, name, "s", "n") == to_s("s", i), "handle wrong table");
+
+    std::list< std::string > keys;
+    ai.copy_rowkeys(name, keys);
+    check(keys.size() == 2, "table has rows of another: " + name);
+  }
+  check(not ai.has_table("reg_missing"), "missing table found");
+
+  std::cout << "registry: tables=" << n << "\n";
+}
+
+//----------------------------------------------------------------------
+int main()
+{
+  exio::Config config;
+  config.serviceid = "table_tests";
+  exio::AdminInterface ai(config, &logger);
+
+  try
+  {
+    test_row_index(ai);
+    test_columns(ai);
+    test_shared_blocks(ai);
+    test_copy_while_updating(ai);
+    test_typed_cells(ai);
+    test_conflation(ai);
+    test_row_handles(ai);
+    test_registry(ai);
+  }
+  catch (const std::exception& e)
+  {
+    std::cout << "exception: "<< e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}